@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+#pragma once
+
+#if !defined(__LOV_CODEC_CONTEXT)
+#define __LOV_CODEC_CONTEXT
+
+#include "OpenViewer/common.hpp"
+
+#include "stdromano/string.hpp"
+
+#include <cstdarg>
+#include <string>
+#include <vector>
+
+LOV_NAMESPACE_BEGIN
+
+/*
+ * Codec state of a thread. Codec libraries report errors through process-wide callbacks (libtiff)
+ * or thread local globals (stb), readers and writers route them to the context of the thread doing
+ * the work, so that messages are attributed to the right file when decoding files concurrently
+ */
+class LOV_API CodecContext
+{
+private:
+    friend class CodecContextScope;
+
+    /* File the thread is reading or writing, empty if none */
+    stdromano::StringD _path;
+
+    /* Last error reported by a codec while working on the file */
+    std::string _error;
+
+    /* Scratch buffer formatting the messages of the codecs, grown as needed */
+    std::vector<char> _message;
+
+    CodecContext() = default;
+
+public:
+    /* Context of the calling thread */
+    static CodecContext& get() noexcept;
+
+    LOV_NON_COPYABLE(CodecContext)
+
+    LOV_FORCE_INLINE const stdromano::StringD& path() const noexcept
+    {
+        return this->_path;
+    }
+
+    LOV_FORCE_INLINE bool has_error() const noexcept
+    {
+        return !this->_error.empty();
+    }
+
+    LOV_FORCE_INLINE const char* error() const noexcept
+    {
+        return this->_error.c_str();
+    }
+
+    void set_error(const char* error) noexcept;
+
+    /* Formats a printf style message of a codec, valid until the next call on the thread */
+    const char* format_message(const char* fmt, va_list args) noexcept;
+};
+
+/* Makes the calling thread work on the file until the end of the scope, scopes can be nested */
+class LOV_API CodecContextScope
+{
+private:
+    stdromano::StringD _previous_path;
+    std::string _previous_error;
+
+public:
+    CodecContextScope(const stdromano::StringD& path) noexcept;
+
+    ~CodecContextScope() noexcept;
+
+    LOV_NON_COPYABLE(CodecContextScope)
+};
+
+LOV_NAMESPACE_END
+
+#endif /* !defined(__LOV_CODEC_CONTEXT) */
@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+#pragma once
+
+#if !defined(__LOV_FILE_HANDLE_CACHE)
+#define __LOV_FILE_HANDLE_CACHE
+
+#include "OpenViewer/common.hpp"
+
+#include "stdromano/string.hpp"
+#include "stdromano/hashmap.hpp"
+
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+
+LOV_NAMESPACE_BEGIN
+
+/*
+ * Open file kept by the cache, readers derive from it to hold its mapping and parsed headers. A
+ * handle is shared by concurrent reads and never modified once opened, so decoders, which keep
+ * state while reading, are built by each read
+ */
+class LOV_API FileHandle
+{
+public:
+    virtual ~FileHandle() = default;
+};
+
+/* Opens a file, returns nullptr if it cannot be opened */
+using FileHandleOpenFunc = std::shared_ptr<FileHandle>(*)(const stdromano::StringD& path) noexcept;
+
+struct FileHandleCacheStats
+{
+    std::uint64_t hits;
+    std::uint64_t misses;
+    std::uint64_t evictions;
+
+    std::size_t num_open_files;
+    std::size_t max_open_files;
+};
+
+/*
+ * Process-wide cache of open files, so reading another layer of a file does not open it and parse
+ * its headers again. Handles are keyed by path and reopened when the modification time or the size
+ * of the file changes, a mapping outliving a truncation of its file faulting when read. The
+ * least recently used handles are closed once more than max_open_files are open, handles still
+ * in use being closed when their last user releases them. A cap of 0 disables the cache
+ */
+class LOV_API FileHandleCache
+{
+private:
+    struct Entry
+    {
+        stdromano::StringD path;
+        std::filesystem::file_time_type mtime;
+        std::uintmax_t size;
+        FileHandleOpenFunc open_func;
+        std::shared_ptr<FileHandle> handle;
+    };
+
+    /* Most recently used entries first */
+    std::list<Entry> _entries;
+
+    stdromano::HashMap<stdromano::StringD, std::list<Entry>::iterator> _entries_map;
+
+    mutable std::mutex _mutex;
+
+    std::size_t _max_open_files;
+
+    std::uint64_t _hits;
+    std::uint64_t _misses;
+    std::uint64_t _evictions;
+
+    FileHandleCache();
+
+    /* Closes the least recently used handles until num_files more fit under the cap */
+    void evict(std::size_t num_files) noexcept;
+
+    void erase(std::list<Entry>::iterator it) noexcept;
+
+public:
+    static constexpr std::size_t DEFAULT_MAX_OPEN_FILES = 32;
+
+    static FileHandleCache& get_instance() noexcept;
+
+    LOV_NON_COPYABLE(FileHandleCache)
+
+    void set_max_open_files(std::size_t max_open_files) noexcept;
+
+    std::size_t max_open_files() const noexcept;
+
+    /*
+     * Returns the handle of the file, opening it with open_func if it is not cached, if it was
+     * opened by another function or if the file has been modified since. Returns nullptr if the
+     * file cannot be opened
+     */
+    std::shared_ptr<FileHandle> acquire(const stdromano::StringD& path,
+                                        FileHandleOpenFunc open_func) noexcept;
+
+    /* Closes the handle of the file, to call when it changed on disk */
+    void invalidate(const stdromano::StringD& path) noexcept;
+
+    void clear() noexcept;
+
+    FileHandleCacheStats stats() const noexcept;
+
+    void reset_stats() noexcept;
+};
+
+LOV_NAMESPACE_END
+
+#endif /* !defined(__LOV_FILE_HANDLE_CACHE) */
@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+#pragma once
+
+#if !defined(__LOV_FRAME_CACHE)
+#define __LOV_FRAME_CACHE
+
+#include "OpenViewer/common.hpp"
+
+#include "stdromano/string.hpp"
+#include "stdromano/hashmap.hpp"
+
+#include "Imath/ImathBox.h"
+
+#include <list>
+#include <mutex>
+
+LOV_NAMESPACE_BEGIN
+
+struct FrameCacheStats
+{
+    std::uint64_t hits;
+    std::uint64_t misses;
+    std::uint64_t evictions;
+
+    std::size_t num_entries;
+    std::size_t bytes;
+    std::size_t budget;
+};
+
+/*
+ * Process-wide cache of decoded layer buffers, bounded by a budget in bytes.
+ * Images hand the buffers of their unmodified layers to the cache when they release them, and
+ * take them back instead of decoding the file again. The least recently used buffers are freed
+ * when the budget is exceeded. The cache is disabled while its budget is 0 (the default).
+ * The cache is never destroyed, as images can release their layers during static destruction
+ */
+class LOV_API FrameCache
+{
+private:
+    struct Entry
+    {
+        stdromano::StringD key;
+        void* data;
+        std::size_t nbytes;
+    };
+
+    /* Most recently used entries first */
+    std::list<Entry> _entries;
+
+    stdromano::HashMap<stdromano::StringD, std::list<Entry>::iterator> _entries_map;
+
+    mutable std::mutex _mutex;
+
+    std::size_t _budget;
+    std::size_t _bytes;
+
+    std::uint64_t _hits;
+    std::uint64_t _misses;
+    std::uint64_t _evictions;
+
+    FrameCache();
+
+    /* Frees the least recently used entries until nbytes fit in the budget */
+    void evict(std::size_t nbytes) noexcept;
+
+    void erase(std::list<Entry>::iterator it) noexcept;
+
+public:
+    static FrameCache& get_instance() noexcept;
+
+    LOV_NON_COPYABLE(FrameCache)
+
+    /* The modification time and size of the file make rewritten files miss the old buffers */
+    static stdromano::StringD make_key(const stdromano::StringD& path,
+                                       std::int64_t file_mtime,
+                                       std::uint64_t file_size,
+                                       const stdromano::StringD& layer_name,
+                                       std::uint8_t depth,
+                                       std::uint8_t nchannels,
+                                       const stdromano::StringD& mask,
+                                       std::uint8_t level,
+                                       const Imath::Box2i& window) noexcept;
+
+    void set_budget(std::size_t budget) noexcept;
+
+    std::size_t budget() const noexcept;
+
+    bool is_enabled() const noexcept;
+
+    /*
+     * Hands a buffer allocated with mem_aligned_alloc to the cache, which then owns it.
+     * Returns false if the buffer does not fit in the budget, the caller keeps ownership then
+     */
+    bool put(const stdromano::StringD& key, void* data, std::size_t nbytes) noexcept;
+
+    /* Removes the buffer from the cache and gives its ownership to the caller, nullptr on miss */
+    void* take(const stdromano::StringD& key, std::size_t nbytes) noexcept;
+
+    /* Frees all the buffers read from the given file, to call when it changed on disk */
+    void invalidate(const stdromano::StringD& path) noexcept;
+
+    void clear() noexcept;
+
+    FrameCacheStats stats() const noexcept;
+
+    void reset_stats() noexcept;
+};
+
+LOV_NAMESPACE_END
+
+#endif /* !defined(__LOV_FRAME_CACHE) */
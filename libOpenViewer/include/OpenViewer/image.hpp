@@ -11,10 +11,16 @@
 
 #include "stdromano/string.hpp"
 #include "stdromano/hashmap.hpp"
+#include "stdromano/vector.hpp"
 
 #include "Imath/ImathBox.h"
 #include "Imath/half.h"
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <tuple>
+
 LOV_NAMESPACE_BEGIN
 
 enum LayerDepth_ : std::uint8_t
@@ -42,6 +48,19 @@ using depth_to_type_t = typename depth_to_type<depth>::type;
 
 LOV_API std::size_t layer_depth_as_byte_size(std::uint8_t layer_depth) noexcept;
 
+LOV_API Imath::Box2i box_intersection(const Imath::Box2i& a, const Imath::Box2i& b) noexcept;
+
+LOV_API bool box_contains(const Imath::Box2i& outer, const Imath::Box2i& inner) noexcept;
+
+enum LayerLoadState_ : std::uint8_t
+{
+    LayerLoadState_Idle,
+    /* A thread is reading the data of the layer, the others wait for it */
+    LayerLoadState_Loading,
+    /* The data has been published and is not modified by the lazy loading anymore */
+    LayerLoadState_Loaded,
+};
+
 enum ResizeMode_ : std::uint8_t
 {
     ResizeMode_BiLinear,
@@ -62,9 +81,47 @@ private:
 
     void* _data;
 
+    /* Region of the data window held by the layer, empty means the whole data window */
+    Imath::Box2i _window;
+
     std::uint8_t _depth;
     std::uint8_t _nchannels;
 
+    /* Mip level of the image the layer holds, 0 being the full resolution */
+    std::uint8_t _level;
+
+    /* True while the data holds the pixels as read from the file, so it can be cached */
+    bool _unmodified;
+
+    /* Depth and number of channels of the layer in the file */
+    std::uint8_t _file_depth;
+    std::uint8_t _file_nchannels;
+
+    /* Shuffle mask the data has been read with, empty when holding all the channels of the file */
+    stdromano::StringD _mask;
+
+    /* Only the thread that moved the layer to the loading state touches its data until it leaves it */
+    std::atomic<std::uint8_t> _load_state;
+
+    /*
+     * Regions, mip levels and converted reads of the layer, each read in its own layer published
+     * at the front of the list and kept until the layer is destroyed or its variants released. On a
+     * variant, the next one
+     */
+    std::atomic<Layer*> _variants;
+
+    /* Loading while a thread reads a variant, the others wait for it before adding theirs */
+    std::atomic<std::uint8_t> _variants_state;
+
+    /* Returns the variant holding the window with the given level, depth and mask, nullptr if none */
+    Layer* find_variant(std::uint32_t level,
+                        const Imath::Box2i& window,
+                        std::uint8_t depth,
+                        const stdromano::StringD& mask) const noexcept;
+
+    /* Frees the variants, nobody may use them anymore */
+    void clear_variants() noexcept;
+
     void resize(const Imath::Box2i& new_window,
                 std::uint32_t mode = ResizeMode_BiCubic) noexcept;
 
@@ -74,7 +131,14 @@ public:
     Layer(const Image* parent) : _parent(parent),
                                  _data(nullptr),
                                  _depth(LayerDepth_NONE),
-                                 _nchannels(0) {}
+                                 _nchannels(0),
+                                 _level(0),
+                                 _unmodified(false),
+                                 _file_depth(LayerDepth_NONE),
+                                 _file_nchannels(0),
+                                 _load_state(LayerLoadState_Idle),
+                                 _variants(nullptr),
+                                 _variants_state(LayerLoadState_Idle) {}
 
     Layer(const Image* parent,
           void* data,
@@ -82,14 +146,28 @@ public:
           std::uint8_t nchannels) : _parent(parent),
                                     _data(data),
                                     _depth(depth),
-                                    _nchannels(nchannels) {}
+                                    _nchannels(nchannels),
+                                    _level(0),
+                                    _unmodified(false),
+                                    _file_depth(depth),
+                                    _file_nchannels(nchannels),
+                                    _load_state(LayerLoadState_Idle),
+                                    _variants(nullptr),
+                                    _variants_state(LayerLoadState_Idle) {}
 
     Layer(const Image* parent,
           std::uint8_t depth,
           std::uint8_t nchannels) : _parent(parent),
                                     _data(nullptr),
                                     _depth(depth),
-                                    _nchannels(nchannels) {}
+                                    _nchannels(nchannels),
+                                    _level(0),
+                                    _unmodified(false),
+                                    _file_depth(depth),
+                                    _file_nchannels(nchannels),
+                                    _load_state(LayerLoadState_Idle),
+                                    _variants(nullptr),
+                                    _variants_state(LayerLoadState_Idle) {}
 
     ~Layer() noexcept;
 
@@ -143,9 +221,16 @@ public:
         return static_cast<T*>(this->_data);
     }
 
+    /* The layer takes ownership of the data, which must come from mem_aligned_alloc */
     LOV_FORCE_INLINE void set_data(void* data) noexcept
     {
+        if(this->_data != nullptr && this->_data != data)
+        {
+            stdromano::mem_aligned_free(this->_data);
+        }
+
         this->_data = data;
+        this->_unmodified = false;
     }
 
     LOV_FORCE_INLINE std::uint8_t depth() const noexcept
@@ -158,6 +243,45 @@ public:
         return this->_nchannels;
     }
 
+    LOV_FORCE_INLINE std::uint8_t level() const noexcept
+    {
+        return this->_level;
+    }
+
+    LOV_FORCE_INLINE std::uint8_t file_depth() const noexcept
+    {
+        return this->_file_depth;
+    }
+
+    LOV_FORCE_INLINE std::uint8_t file_nchannels() const noexcept
+    {
+        return this->_file_nchannels;
+    }
+
+    /* Shuffle mask the data has been read with, empty if it holds all the channels */
+    LOV_FORCE_INLINE const stdromano::StringD& mask() const noexcept
+    {
+        return this->_mask;
+    }
+
+    /* Region of the parent data window held by the layer */
+    LOV_FORCE_INLINE const Imath::Box2i& window() const noexcept;
+
+    LOV_FORCE_INLINE bool is_full_window() const noexcept
+    {
+        return this->_window.isEmpty();
+    }
+
+    LOV_FORCE_INLINE std::int32_t width() const noexcept
+    {
+        return this->window().max.x - this->window().min.x + 1;
+    }
+
+    LOV_FORCE_INLINE std::int32_t height() const noexcept
+    {
+        return this->window().max.y - this->window().min.y + 1;
+    }
+
     /* width * height */
     LOV_FORCE_INLINE std::size_t npixels() const noexcept;
 
@@ -216,9 +340,80 @@ public:
 
     void convert(const std::uint8_t new_depth) noexcept;
 
+    /*
+     * Shuffles and converts the layer in a single pass over its data, an empty mask keeps the
+     * channels. Returns false, leaving the layer untouched, if the mask is invalid
+     */
+    bool shuffle_convert(const stdromano::StringD& mask, const std::uint8_t new_depth) noexcept;
+
+    /*
+     * Same as above, writing the result in a buffer of npixels * mask size * new depth bytes and
+     * leaving the layer untouched. Returns false if the mask is invalid
+     */
+    bool shuffle_convert(const stdromano::StringD& mask,
+                         const std::uint8_t new_depth,
+                         void* to) const noexcept;
+
     bool compare(const Layer* other, const float tolerance = 0.001f) const noexcept;
 };
 
+/*
+ * Returns the bit mask of the shuffle mask and its number of channels for a layer of nchannels_input
+ * channels, the bit mask being 0 if the mask is invalid
+ */
+std::tuple<std::int32_t, std::size_t> build_shuffle_mask(const stdromano::StringD& mask,
+                                                         std::uint32_t nchannels_input) noexcept;
+
+namespace detail
+{
+    /* Kernels behind Layer::convert and Layer::shuffle, dispatched on the vectorization mode */
+
+    /* Converts size values, both buffers being aligned on 32 bytes */
+    void layer_convert(const void* __restrict from,
+                       void* __restrict to,
+                       std::uint8_t from_depth,
+                       std::uint8_t to_depth,
+                       std::size_t size) noexcept;
+
+    enum LayerConvertTier_ : std::uint8_t
+    {
+        LayerConvertTier_Scalar,
+        LayerConvertTier_SSE,
+        LayerConvertTier_AVX,
+        LayerConvertTier_AVX2,
+        LayerConvertTier_AVX512,
+    };
+
+    /*
+     * Same as above with the kernels of the given tier, to compare and benchmark them. Returns
+     * false without converting if the cpu does not support the tier
+     */
+    LOV_API bool layer_convert_tier(const void* __restrict from,
+                                    void* __restrict to,
+                                    std::uint8_t from_depth,
+                                    std::uint8_t to_depth,
+                                    std::size_t size,
+                                    std::uint8_t tier) noexcept;
+
+    /* bit_mask is built by build_shuffle_mask */
+    void layer_shuffle(const void* __restrict from,
+                       void* __restrict to,
+                       std::uint32_t bit_mask,
+                       std::size_t npixels,
+                       std::uint8_t nchannels,
+                       std::uint8_t depth,
+                       std::uint8_t output_channels) noexcept;
+
+    /*
+     * Calls func(start, count) over ranges of npixels covering them, on the library thread pool
+     * when the data is large enough. Ranges start on a multiple of 1024 pixels so the kernels keep
+     * aligned accesses. pixel_size is the largest size in bytes of a pixel read or written
+     */
+    void layer_parallel_for(std::size_t npixels,
+                            std::size_t pixel_size,
+                            const std::function<void(std::size_t, std::size_t)>& func) noexcept;
+} /* namespace detail */
+
 using Layers = stdromano::HashMap<stdromano::StringD, Layer>;
 
 class LOV_API Image
@@ -231,16 +426,30 @@ static constexpr const char* MAIN_LAYER_NAME = "main";
 
 private:
     friend class Layer;
+    friend class ProgressiveReader;
 
     stdromano::StringD _path;
 
+    /* Name of the format detected when reading the metadata, empty if not read from a file */
+    stdromano::StringD _format;
+
+    /* Modification time and size of the file when its metadata was read, 0 if not read from a file */
+    std::int64_t _file_mtime = 0;
+    std::uint64_t _file_size = 0;
+
     Layers _layers;
 
     Imath::Box2i _data_window;
     Imath::Box2i _display_window;
 
+    /* Data windows of the mip levels, empty if the image is not mipmapped */
+    stdromano::Vector<Imath::Box2i> _level_data_windows;
+
     float _aspect_ratio;
 
+    /* Buffer the image is read from when loaded from memory, _path is then a memory path */
+    std::shared_ptr<const void> _memory;
+
     static bool read_image_metadata(const stdromano::StringD& path,
                                     Image& image) noexcept;
 
@@ -248,6 +457,25 @@ private:
                                   const stdromano::StringD& layer_name,
                                   Layer& layer) noexcept;
 
+    static bool read_layers_pixels(const stdromano::StringD& path,
+                                   const stdromano::Vector<stdromano::StringD>& layer_names,
+                                   Image& image) noexcept;
+
+    /*
+     * Hands the data of the layer and of its variants to the frame cache if it is unmodified,
+     * frees it otherwise
+     */
+    void release_layer_data(const stdromano::StringD& name, Layer& layer) const noexcept;
+
+    /* Same as above for the variants of the layer only, which stay linked without data */
+    void release_variants_data(const stdromano::StringD& name, Layer& layer) const noexcept;
+
+    /* Same as above for the data of the layer only */
+    void release_data(const stdromano::StringD& name, Layer& layer) const noexcept;
+
+    /* Takes the data matching the layer depth, level and window from the frame cache */
+    bool take_cached_layer_data(const stdromano::StringD& name, Layer& layer) const noexcept;
+
 public:
     Image() = default;
 
@@ -261,6 +489,39 @@ public:
                                                 _display_window(display_window),
                                                 _aspect_ratio(1.0) {}
 
+    Image(const Image& other) = default;
+    Image& operator=(const Image& other) = default;
+
+    Image(Image&& other) noexcept = default;
+    Image& operator=(Image&& other) noexcept = default;
+
+    /* The unmodified layers are handed to the frame cache */
+    ~Image() noexcept;
+
+    /* Returns true if a reader is available for the format of the file */
+    static bool is_readable(const stdromano::StringD& path) noexcept;
+
+    /*
+     * Returns the image held in the buffer with its metadata read, nullptr if it cannot be read.
+     * The format is detected from the content, the hint (an extension such as "exr") being used
+     * when it is not recognized. Layers are lazy loaded from the buffer like from a file
+     */
+    static std::shared_ptr<Image> from_memory(const void* data,
+                                              std::size_t size,
+                                              const stdromano::StringD& format_hint = stdromano::StringD()) noexcept;
+
+    /* Same as above without copying the buffer, the image keeps a reference on it */
+    static std::shared_ptr<Image> from_memory(std::shared_ptr<const void> data,
+                                              std::size_t size,
+                                              const stdromano::StringD& format_hint = stdromano::StringD()) noexcept;
+
+    /*
+     * Same as above for a buffer already registered in MemoryFiles under the path, the image
+     * keeping a reference on owner, which keeps the buffer registered
+     */
+    static std::shared_ptr<Image> from_memory_path(const stdromano::StringD& path,
+                                                   std::shared_ptr<const void> owner) noexcept;
+
     const stdromano::StringD& get_path() const noexcept
     {
 #if defined(LOV_PARANOID)
@@ -270,6 +531,11 @@ public:
         return this->_path;
     }
 
+    LOV_FORCE_INLINE const stdromano::StringD& format() const noexcept
+    {
+        return this->_format;
+    }
+
     /* Methods for layers */
 
     const Layers& get_layers() const noexcept { return this->_layers; }
@@ -284,12 +550,62 @@ public:
 
     const Layer* main() const noexcept;
 
-    /* Returns nullptr if the layer can't be found */
+    /*
+     * The lazy loading get_layer and load_layers can be called from several threads at once, a
+     * layer being read once while the other threads asking for it wait. Loaded layers are returned
+     * without locking. Layers must not be created, removed or renamed meanwhile.
+     * A returned layer is never modified nor freed by later requests: the layer itself only holds
+     * the whole level 0 as stored in the file, and regions, mip levels and converted reads are
+     * read in variants of the layer kept until the image is destroyed or release_variants is called
+     */
+
+    /* Returns nullptr if the layer can't be found or read */
     /* Lazy loads the data of the layer if it exists */
     Layer* get_layer(const stdromano::StringD& name) noexcept;
 
+    /* Lazy loads only the region of interest (clipped to the data window) of the layer */
+    /* Formats supporting it (exr) only decode the scanline blocks intersecting the roi */
+    Layer* get_layer(const stdromano::StringD& name, const Imath::Box2i& roi) noexcept;
+
+    /* Lazy loads the region of interest of the given mip level of the layer */
+    /* The roi is expressed in full resolution pixel coordinates */
+    Layer* get_layer(const stdromano::StringD& name,
+                     const Imath::Box2i& roi,
+                     std::uint32_t level) noexcept;
+
+    /* Lazy loads the layer converted to the given depth, holding the channels of the shuffle mask */
+    /* LayerDepth_NONE keeps the depth of the file, an empty mask keeps all the channels */
+    /* Formats supporting it (exr) convert and select the channels while decoding */
+    Layer* get_layer(const stdromano::StringD& name,
+                     std::uint8_t depth,
+                     const stdromano::StringD& mask) noexcept;
+
+    Layer* get_layer(const stdromano::StringD& name,
+                     const Imath::Box2i& roi,
+                     std::uint32_t level,
+                     std::uint8_t depth,
+                     const stdromano::StringD& mask) noexcept;
+
     const Layer* get_layer(const stdromano::StringD& name) const noexcept;
 
+    /* Loads the data of all the given layers that are not loaded yet */
+    /* Formats supporting it (exr) decode all the layers in a single pass over the file */
+    bool load_layers(const stdromano::Vector<stdromano::StringD>& names) noexcept;
+
+    /* Loads the data of all the layers of the image in a single pass when possible */
+    bool load_all_layers() noexcept;
+
+    /*
+     * Hands the data of the variants of the layer to the frame cache, so asking for them again
+     * does not read the file, and frees them. Every layer returned for a region, mip level or
+     * converted read of the layer is invalidated, and no get_layer or load_layers call may run
+     * meanwhile. Viewers panning and zooming over an image call it to bound its memory
+     */
+    void release_variants(const stdromano::StringD& name) noexcept;
+
+    /* Same as above for all the layers of the image */
+    void release_all_variants() noexcept;
+
     void remove_layer(const stdromano::StringD& name) noexcept;
 
     void rename_layer(const stdromano::StringD& name, const stdromano::StringD& new_name) noexcept;
@@ -341,6 +657,28 @@ public:
         return this->_display_window.max.y - this->_display_window.min.y + 1;
     }
 
+    /* Methods for mip levels */
+
+    LOV_FORCE_INLINE std::uint32_t num_levels() const noexcept
+    {
+        return this->_level_data_windows.empty() ? 1 : static_cast<std::uint32_t>(this->_level_data_windows.size());
+    }
+
+    LOV_FORCE_INLINE const stdromano::Vector<Imath::Box2i>& level_data_windows() const noexcept
+    {
+        return this->_level_data_windows;
+    }
+
+    LOV_FORCE_INLINE stdromano::Vector<Imath::Box2i>& level_data_windows() noexcept
+    {
+        return this->_level_data_windows;
+    }
+
+    const Imath::Box2i& level_data_window(std::uint32_t level) const noexcept;
+
+    /* Returns the coarsest mip level that still has one pixel per screen pixel at the given zoom */
+    std::uint32_t level_for_zoom(float zoom) const noexcept;
+
     LOV_FORCE_INLINE const float& aspect_ratio() const noexcept
     {
         return this->_aspect_ratio;
@@ -376,10 +714,14 @@ public:
                     const stdromano::StringD& output_cs) noexcept;
 };
 
+LOV_FORCE_INLINE const Imath::Box2i& Layer::window() const noexcept
+{
+    return this->_window.isEmpty() ? this->_parent->data_window() : this->_window;
+}
+
 LOV_FORCE_INLINE std::size_t Layer::npixels() const noexcept
 {
-    return static_cast<std::size_t>(this->_parent->get_display_width()) *
-           static_cast<std::size_t>(this->_parent->get_display_height());
+    return static_cast<std::size_t>(this->width()) * static_cast<std::size_t>(this->height());
 }
 
 
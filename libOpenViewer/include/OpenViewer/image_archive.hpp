@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+#pragma once
+
+#if !defined(__LOV_IMAGE_ARCHIVE)
+#define __LOV_IMAGE_ARCHIVE
+
+#include "OpenViewer/image.hpp"
+#include "OpenViewer/mapped_file.hpp"
+
+#include <functional>
+#include <memory>
+
+LOV_NAMESPACE_BEGIN
+
+/*
+ * Images of a zip archive, read without extracting it. Only the central directory is read when
+ * opening. Members stored without compression are read in place from the mapping of the archive.
+ * For compressed ones, only the first bytes are inflated to read their headers, the whole member
+ * being inflated in memory when its pixels are first loaded. The images keep the mapping alive
+ * once the archive is closed
+ */
+class LOV_API ImageArchive
+{
+private:
+    static constexpr std::uint64_t NO_DATA_OFFSET = ~static_cast<std::uint64_t>(0);
+
+    /* Bytes of a compressed member inflated to read its headers */
+    static constexpr std::uint64_t HEADER_PREFIX_SIZE = 256 * 1024;
+
+    struct Member
+    {
+        stdromano::StringD name;
+
+        /* Position of the entry in the central directory */
+        std::int64_t cd_position;
+
+        /* Uncompressed */
+        std::uint64_t size;
+
+        /* Offset of the data in the archive for stored members, NO_DATA_OFFSET for compressed ones */
+        std::uint64_t data_offset;
+    };
+
+    stdromano::StringD _path;
+
+    std::shared_ptr<MappedFile> _file;
+
+    /* Sorted by name */
+    stdromano::Vector<Member> _members;
+
+    const Member* find_member(const stdromano::StringD& name) const noexcept;
+
+    /*
+     * Returns nullptr if no reader recognizes the member or if it cannot be read. zip is the
+     * minizip handle of the calling thread, only used for compressed members
+     */
+    std::shared_ptr<Image> read_member(const Member& member, void* zip) const noexcept;
+
+    std::shared_ptr<Image> read_compressed_member(const Member& member, void* zip) const noexcept;
+
+    /* Reads the readable members on the library thread pool, each worker with its own zip reader */
+    void read_members(const std::function<void(std::size_t, std::shared_ptr<Image>)>& func) const noexcept;
+
+public:
+    ImageArchive() = default;
+
+    LOV_NON_COPYABLE(ImageArchive)
+
+    /* Reads the list of members of the archive */
+    bool open(const stdromano::StringD& path) noexcept;
+
+    void close() noexcept;
+
+    LOV_FORCE_INLINE bool is_open() const noexcept
+    {
+        return this->_file != nullptr;
+    }
+
+    LOV_FORCE_INLINE const stdromano::StringD& path() const noexcept
+    {
+        return this->_path;
+    }
+
+    LOV_FORCE_INLINE std::size_t num_members() const noexcept
+    {
+        return this->_members.size();
+    }
+
+    /* Names of the files of the archive (directories excluded), sorted */
+    stdromano::Vector<stdromano::StringD> member_names() const noexcept;
+
+    bool has_member(const stdromano::StringD& name) const noexcept;
+
+    /* Returns the image of the member with its metadata read, nullptr if it cannot be read */
+    std::shared_ptr<Image> image(const stdromano::StringD& name) const noexcept;
+
+    /* Images of all the readable members (metadata read, no pixels loaded), sorted by member name */
+    stdromano::Vector<std::shared_ptr<Image>> images() const noexcept;
+
+    /*
+     * Calls func on the library thread pool with the image of every readable member (metadata
+     * read, no pixels loaded). Returns once all the calls are done
+     */
+    void for_each_image(const std::function<void(const stdromano::StringD&, Image&)>& func) const noexcept;
+};
+
+LOV_NAMESPACE_END
+
+#endif /* !defined(__LOV_IMAGE_ARCHIVE) */
@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+#pragma once
+
+#if !defined(__LOV_IMAGE_CATALOG)
+#define __LOV_IMAGE_CATALOG
+
+#include "OpenViewer/image.hpp"
+
+#include <memory>
+
+LOV_NAMESPACE_BEGIN
+
+/*
+ * Images of a directory, with their metadata (windows, layers) read but no pixels loaded.
+ * Scanning only reads the headers of the files, spread over the library thread pool
+ */
+class LOV_API ImageCatalog
+{
+private:
+    /* Sorted by path */
+    stdromano::Vector<std::shared_ptr<Image>> _images;
+
+public:
+    ImageCatalog() = default;
+
+    LOV_NON_COPYABLE(ImageCatalog)
+
+    /*
+     * Replaces the content of the catalog with the readable images of the directory.
+     * Files that cannot be read are skipped. Returns false if the directory cannot be listed
+     */
+    bool scan(const stdromano::StringD& directory, bool recursive = false) noexcept;
+
+    /* Returns nullptr if the image is not in the catalog */
+    std::shared_ptr<Image> find(const stdromano::StringD& path) const noexcept;
+
+    LOV_FORCE_INLINE const stdromano::Vector<std::shared_ptr<Image>>& images() const noexcept
+    {
+        return this->_images;
+    }
+
+    LOV_FORCE_INLINE std::size_t size() const noexcept
+    {
+        return this->_images.size();
+    }
+
+    LOV_FORCE_INLINE bool empty() const noexcept
+    {
+        return this->_images.empty();
+    }
+
+    void clear() noexcept;
+};
+
+LOV_NAMESPACE_END
+
+#endif /* !defined(__LOV_IMAGE_CATALOG) */
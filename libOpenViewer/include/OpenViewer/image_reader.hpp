@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+#pragma once
+
+#if !defined(__LOV_IMAGE_READER)
+#define __LOV_IMAGE_READER
+
+#include "OpenViewer/image.hpp"
+
+#include <memory>
+#include <shared_mutex>
+#include <vector>
+
+LOV_NAMESPACE_BEGIN
+
+enum ImageReaderFlags_ : std::uint32_t
+{
+    ImageReaderFlags_None = 0,
+    /* Reads tiled files and their mip levels */
+    ImageReaderFlags_Tiled = 1 << 0,
+    /* Only decodes the window of the layer being read */
+    ImageReaderFlags_ROI = 1 << 1,
+    /* Reads several layers in a single pass over the file */
+    ImageReaderFlags_MultiLayer = 1 << 2,
+    /* Reads files that are still being written */
+    ImageReaderFlags_Streaming = 1 << 3,
+    /*
+     * Decodes to the float depth of the layer and only the channels of its shuffle mask, for masks
+     * made of R, G, B, A (at most once each), 0 and 1
+     */
+    ImageReaderFlags_DepthMask = 1 << 4,
+};
+
+/* Returns true if the first bytes of a file belong to the format */
+using ImageProbeFunc = bool(*)(const std::uint8_t* header, std::size_t size) noexcept;
+
+using ImageMetadataReadFunc = bool(*)(const stdromano::StringD& path, Image& image) noexcept;
+
+using LayerPixelsReadFunc = bool(*)(const stdromano::StringD& path,
+                                    const stdromano::StringD& layer_name,
+                                    Layer& layer) noexcept;
+
+using LayersPixelsReadFunc = bool(*)(const stdromano::StringD& path,
+                                     const stdromano::Vector<stdromano::StringD>& layer_names,
+                                     Image& image) noexcept;
+
+struct ImageReader
+{
+    /* Name of the file format, several readers can be registered for the same format */
+    stdromano::StringD format;
+
+    /* Comma separated lowercase extensions, used for the files whose content no probe recognizes */
+    stdromano::StringD extensions;
+
+    ImageProbeFunc probe;
+
+    ImageMetadataReadFunc read_metadata;
+
+    LayerPixelsReadFunc read_layer_pixels;
+
+    /* Only used with ImageReaderFlags_MultiLayer */
+    LayersPixelsReadFunc read_layers_pixels;
+
+    std::uint32_t flags;
+
+    /* Readers with the highest priority are preferred among the ones having the needed flags */
+    std::int32_t priority;
+};
+
+/*
+ * Readers available to the library. The format of a file is detected from its first bytes, and
+ * from its extension if none of the readers recognizes them. The builtin readers are registered
+ * when the registry is first used
+ */
+class LOV_API ImageReaderRegistry
+{
+private:
+    /* Readers are never removed, so the pointers handed out stay valid */
+    std::vector<std::unique_ptr<ImageReader>> _readers;
+
+    mutable std::shared_mutex _mutex;
+
+    ImageReaderRegistry();
+
+public:
+    /* Number of bytes read at the start of a file to detect its format */
+    static constexpr std::size_t PROBE_SIZE = 64;
+
+    static ImageReaderRegistry& get_instance() noexcept;
+
+    LOV_NON_COPYABLE(ImageReaderRegistry)
+
+    void register_reader(ImageReader&& reader) noexcept;
+
+    /* Returns the name of the format of the file, an empty string if it is unknown */
+    stdromano::StringD detect_format(const stdromano::StringD& path) const noexcept;
+
+    /* Same as above from the first bytes of a file (up to PROBE_SIZE), the name giving its extension */
+    stdromano::StringD detect_format(const std::uint8_t* header,
+                                     std::size_t header_size,
+                                     const stdromano::StringD& name) const noexcept;
+
+    /* Returns true if the extension of the path is one of a registered reader, no file is read */
+    bool has_extension(const stdromano::StringD& path) const noexcept;
+
+    /*
+     * Returns the reader of the format with the highest priority among the ones having all the
+     * given flags, or the reader with the highest priority if none has them. Returns nullptr if
+     * no reader is registered for the format
+     */
+    const ImageReader* find_reader(const stdromano::StringD& format,
+                                   std::uint32_t flags = ImageReaderFlags_None) const noexcept;
+};
+
+LOV_NAMESPACE_END
+
+#endif /* !defined(__LOV_IMAGE_READER) */
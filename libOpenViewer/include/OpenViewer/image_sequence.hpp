@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+#pragma once
+
+#if !defined(__LOV_IMAGE_SEQUENCE)
+#define __LOV_IMAGE_SEQUENCE
+
+#include "OpenViewer/image.hpp"
+
+#include <functional>
+#include <memory>
+
+LOV_NAMESPACE_BEGIN
+
+/*
+ * Range of frames following a file name pattern, where the frame number is written as
+ * shot.####.exr, shot.%04d.exr or shot.@@@@.exr (the padding being the number of # or @).
+ * Frame numbers with more digits than the padding are accepted, as long as they are not padded
+ */
+class LOV_API ImageSequence
+{
+private:
+    /* Path up to the frame number, and after it */
+    stdromano::StringD _head;
+    stdromano::StringD _tail;
+
+    std::uint32_t _padding;
+
+    std::int32_t _first_frame;
+    std::int32_t _last_frame;
+
+    /* Sorted */
+    stdromano::Vector<std::int32_t> _missing_frames;
+
+    bool parse_pattern(const stdromano::StringD& pattern) noexcept;
+
+    void find_missing_frames() noexcept;
+
+public:
+    ImageSequence();
+
+    /* Parses the pattern and finds the frame range from the files on disk */
+    bool open(const stdromano::StringD& pattern) noexcept;
+
+    /* Parses the pattern and uses the given frame range, frames not found on disk are missing */
+    bool open(const stdromano::StringD& pattern,
+              std::int32_t first_frame,
+              std::int32_t last_frame) noexcept;
+
+    /* Finds the sequence the file is a frame of, from the last number of its file name */
+    bool open_from_frame(const stdromano::StringD& frame_path) noexcept;
+
+    LOV_FORCE_INLINE bool is_valid() const noexcept
+    {
+        return this->_first_frame <= this->_last_frame;
+    }
+
+    LOV_FORCE_INLINE std::int32_t first_frame() const noexcept
+    {
+        return this->_first_frame;
+    }
+
+    LOV_FORCE_INLINE std::int32_t last_frame() const noexcept
+    {
+        return this->_last_frame;
+    }
+
+    LOV_FORCE_INLINE std::uint32_t num_frames() const noexcept
+    {
+        return this->is_valid() ? static_cast<std::uint32_t>(this->_last_frame - this->_first_frame + 1) : 0;
+    }
+
+    LOV_FORCE_INLINE std::uint32_t padding() const noexcept
+    {
+        return this->_padding;
+    }
+
+    LOV_FORCE_INLINE const stdromano::Vector<std::int32_t>& missing_frames() const noexcept
+    {
+        return this->_missing_frames;
+    }
+
+    /* Pattern of the sequence written with # */
+    stdromano::StringD pattern() const noexcept;
+
+    bool has_frame(std::int32_t frame) const noexcept;
+
+    stdromano::StringD frame_path(std::int32_t frame) const noexcept;
+
+    /* Paths of all the frames of the range, empty for the missing frames */
+    stdromano::Vector<stdromano::StringD> frame_paths() const noexcept;
+
+    /* Returns the image of the frame with its metadata read, nullptr if the frame is missing */
+    std::shared_ptr<Image> frame(std::int32_t frame) const noexcept;
+
+    /*
+     * Calls func on the library thread pool for every frame that is not missing, with the image
+     * of the frame (metadata read, no pixels loaded). Returns once all the calls are done
+     */
+    void for_each_frame(const std::function<void(std::int32_t, Image&)>& func) const noexcept;
+};
+
+LOV_NAMESPACE_END
+
+#endif /* !defined(__LOV_IMAGE_SEQUENCE) */
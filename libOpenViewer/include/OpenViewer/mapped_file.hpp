@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+#pragma once
+
+#if !defined(__LOV_MAPPED_FILE)
+#define __LOV_MAPPED_FILE
+
+#include "OpenViewer/common.hpp"
+
+#include "stdromano/string.hpp"
+#include "stdromano/hashmap.hpp"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+
+LOV_NAMESPACE_BEGIN
+
+enum MappedFileHint_ : std::uint8_t
+{
+    /* The file will be read front to back (scanline images, headers) */
+    MappedFileHint_Sequential,
+    /* The file will be read at arbitrary offsets (tiles, mip levels) */
+    MappedFileHint_Random,
+};
+
+/*
+ * Content of a memory file produced on its first read, such as a compressed archive member only
+ * inflated once its pixels are loaded. The content is kept as long as the file is
+ */
+class LOV_API LazyMemoryFile
+{
+private:
+    std::function<std::shared_ptr<const void>()> _load;
+
+    std::shared_ptr<const void> _data;
+
+    std::mutex _mutex;
+
+public:
+    LazyMemoryFile(std::function<std::shared_ptr<const void>()>&& load) : _load(std::move(load)) {}
+
+    LOV_NON_COPYABLE(LazyMemoryFile)
+
+    /* Returns the content, loading it on the first call, nullptr if it cannot be loaded */
+    std::shared_ptr<const void> get() noexcept;
+};
+
+/*
+ * Buffers registered under a memory path (memory://<id>.<extension>), that MappedFile opens in
+ * place of a file on disk. This lets all the readers read images held in memory. A buffer stays
+ * registered as long as someone holds a reference on it
+ */
+class LOV_API MemoryFiles
+{
+private:
+    struct Entry
+    {
+        std::weak_ptr<const void> data;
+        std::size_t size;
+
+        /* Set in place of data for the buffers loaded on their first read */
+        std::weak_ptr<LazyMemoryFile> lazy;
+    };
+
+    stdromano::HashMap<stdromano::StringD, Entry> _entries;
+
+    mutable std::mutex _mutex;
+
+    std::uint64_t _next_id;
+
+    MemoryFiles();
+
+    stdromano::StringD add_entry(Entry&& new_entry, const stdromano::StringD& extension) noexcept;
+
+public:
+    static constexpr const char* PATH_PREFIX = "memory://";
+
+    static MemoryFiles& get_instance() noexcept;
+
+    LOV_NON_COPYABLE(MemoryFiles)
+
+    static bool is_memory_path(const stdromano::StringD& path) noexcept;
+
+    /* Registers the buffer and returns its path, the extension helping to detect its format */
+    stdromano::StringD add(std::shared_ptr<const void> data,
+                           std::size_t size,
+                           const stdromano::StringD& extension) noexcept;
+
+    /* Same as above for a buffer of the given size loaded by the first find of its path */
+    stdromano::StringD add(std::shared_ptr<LazyMemoryFile> file,
+                           std::size_t size,
+                           const stdromano::StringD& extension) noexcept;
+
+    /*
+     * Returns a reference on the buffer registered under the path, nullptr if there is none or
+     * if it cannot be loaded
+     */
+    std::shared_ptr<const void> find(const stdromano::StringD& path, std::size_t& size) const noexcept;
+};
+
+/* Read-only memory mapping of a whole file, or of a buffer registered in MemoryFiles */
+class LOV_API MappedFile
+{
+private:
+    const std::uint8_t* _data;
+    std::size_t _size;
+
+    /* Set when the path is a memory path or a scoped mapping is shared, nothing is mapped then */
+    std::shared_ptr<const void> _memory;
+
+#if defined(LOV_WIN)
+    void* _file_handle;
+    void* _mapping_handle;
+#endif /* defined(LOV_WIN) */
+
+    bool open_memory(const stdromano::StringD& path) noexcept;
+
+    /* Shares the mapping of the MappedFileScope of the calling thread if it is one of the path */
+    bool open_scoped(const stdromano::StringD& path) noexcept;
+
+public:
+    MappedFile();
+
+    MappedFile(const stdromano::StringD& path,
+               std::uint8_t hint = MappedFileHint_Sequential);
+
+    ~MappedFile() noexcept;
+
+    LOV_NON_COPYABLE(MappedFile)
+
+    bool open(const stdromano::StringD& path,
+              std::uint8_t hint = MappedFileHint_Sequential) noexcept;
+
+    void close() noexcept;
+
+    /* Tells the kernel how the mapping will be accessed to tune read-ahead */
+    void advise(std::uint8_t hint) noexcept;
+
+    LOV_FORCE_INLINE bool is_open() const noexcept
+    {
+        return this->_data != nullptr;
+    }
+
+    LOV_FORCE_INLINE const std::uint8_t* data() const noexcept
+    {
+        return this->_data;
+    }
+
+    LOV_FORCE_INLINE std::size_t size() const noexcept
+    {
+        return this->_size;
+    }
+};
+
+/*
+ * Read-only file read at given offsets, without mapping it, for files that can be truncated while
+ * being read (accessing the truncated pages of a mapping faults). Reads can be issued from several
+ * threads at once
+ */
+class LOV_API FileReader
+{
+private:
+#if defined(LOV_WIN)
+    void* _handle;
+#else
+    int _fd;
+#endif /* defined(LOV_WIN) */
+
+public:
+    FileReader();
+
+    ~FileReader() noexcept;
+
+    LOV_NON_COPYABLE(FileReader)
+
+    bool open(const stdromano::StringD& path) noexcept;
+
+    void close() noexcept;
+
+    bool is_open() const noexcept;
+
+    /* Current size of the file, 0 on error */
+    std::uint64_t size() const noexcept;
+
+    /* Identifies the file on its volume, another file replacing it at the path has another one. 0 on error */
+    std::uint64_t identity() const noexcept;
+
+    /* Reads up to size bytes at the offset, returns the number of bytes read (less at the end) */
+    std::size_t read(std::uint64_t offset, void* buffer, std::size_t size) const noexcept;
+};
+
+/*
+ * While alive, the MappedFile opened on the calling thread for the path share the given mapping
+ * instead of mapping the file again, so the readers reuse the mapping the format was detected from
+ */
+class LOV_API MappedFileScope
+{
+private:
+    stdromano::StringD _previous_path;
+    std::shared_ptr<const MappedFile> _previous_mapping;
+
+public:
+    MappedFileScope(const stdromano::StringD& path, std::shared_ptr<const MappedFile> mapping) noexcept;
+
+    ~MappedFileScope() noexcept;
+
+    LOV_NON_COPYABLE(MappedFileScope)
+};
+
+LOV_NAMESPACE_END
+
+#endif /* !defined(__LOV_MAPPED_FILE) */
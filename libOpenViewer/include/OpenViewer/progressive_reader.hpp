@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+#pragma once
+
+#if !defined(__LOV_PROGRESSIVE_READER)
+#define __LOV_PROGRESSIVE_READER
+
+#include "OpenViewer/image.hpp"
+#include "OpenViewer/mapped_file.hpp"
+
+#include <memory>
+
+LOV_NAMESPACE_BEGIN
+
+/*
+ * Reads an exr file while the renderer is still writing it. The offset table of the chunks is only
+ * filled when the file is closed, so each poll scans the headers of the chunks appended since the
+ * previous one, and decodes the complete scanline blocks and tiles in the layers of the image at
+ * the offsets found by the scans. Chunks already read are never read again, unless the file is
+ * written again from its start: it shrinks, is replaced by another file, or its header or filled
+ * offset table change. Chunks failing to decode are retried by the next polls. The file is read
+ * without mapping it since it can be truncated meanwhile. Only single part files without deep data
+ * are supported, and tiled files are read at full resolution.
+ * The layers are written by poll, the image must not be read meanwhile
+ */
+class LOV_API ProgressiveReader
+{
+private:
+    stdromano::StringD _path;
+
+    std::shared_ptr<Image> _image;
+
+    /* Layers decoded by the polls, with the names of their channels in the file */
+    stdromano::Vector<stdromano::StringD> _layer_names;
+    stdromano::Vector<stdromano::Vector<stdromano::StringD>> _layer_channels;
+
+    Imath::Box2i _data_window;
+
+    std::int32_t _lines_per_block;
+
+    /* Tiles description, levels being stored in the order of the file */
+    bool _tiled;
+    std::uint8_t _level_mode;
+    std::int32_t _tile_width;
+    std::int32_t _tile_height;
+    std::uint32_t _num_levels_x;
+    std::uint32_t _num_levels_y;
+    stdromano::Vector<std::uint64_t> _level_first_chunk;
+    stdromano::Vector<std::int32_t> _level_num_tiles_x;
+    stdromano::Vector<std::int32_t> _level_num_tiles_y;
+
+    /* One entry per chunk of the file (scanline block or tile of any level), 1 once read */
+    stdromano::Vector<std::uint8_t> _read_chunks;
+    std::size_t _num_read_chunks;
+
+    /* Position of each chunk found by the scans, indexed like _read_chunks, 0 if not found yet */
+    stdromano::Vector<std::uint64_t> _chunk_offsets;
+
+    /* Chunks found by the scans that failed to decode, retried by the next polls */
+    std::size_t _num_failed_chunks;
+
+    /* Position of the offset table, following the header */
+    std::uint64_t _table_offset;
+
+    /* Bytes of the header and of the offset table as last read, to tell when the file is written again */
+    stdromano::Vector<std::uint8_t> _header;
+    stdromano::Vector<std::uint8_t> _offset_table;
+
+    /* Identity of the file on its volume, changing when another file replaces it */
+    std::uint64_t _file_identity;
+
+    /* Position of the first chunk not scanned yet */
+    std::uint64_t _scan_offset;
+
+    /* Polls return early while the size and the modification time of the file do not change */
+    std::uint64_t _file_size;
+    std::int64_t _file_mtime;
+
+    /* Returns the index of the chunk, or -1 if its coordinates are not valid */
+    std::int64_t tile_chunk_index(std::int32_t dx, std::int32_t dy, std::int32_t lx, std::int32_t ly) const noexcept;
+
+    /* Forgets the chunks read so far and clears the layers (black) */
+    void reset_chunks() noexcept;
+
+    /*
+     * Returns true if the file has been written again from its start since the last poll, with
+     * header_changed set when it has a different header, the layers then having to be set up again
+     */
+    bool is_rewritten(const FileReader& file, std::uint64_t file_size, bool& header_changed) noexcept;
+
+public:
+    ProgressiveReader();
+
+    LOV_NON_COPYABLE(ProgressiveReader)
+
+    /* Reads the header and allocates the layers (black), an empty list meaning all the layers */
+    bool open(const stdromano::StringD& path,
+              const stdromano::Vector<stdromano::StringD>& layer_names = stdromano::Vector<stdromano::StringD>()) noexcept;
+
+    void close() noexcept;
+
+    /* Decodes the chunks written since the last poll, returns their number */
+    std::size_t poll() noexcept;
+
+    LOV_FORCE_INLINE bool is_open() const noexcept
+    {
+        return this->_image != nullptr;
+    }
+
+    LOV_FORCE_INLINE bool is_complete() const noexcept
+    {
+        return this->is_open() && this->_num_read_chunks == this->_read_chunks.size();
+    }
+
+    LOV_FORCE_INLINE std::size_t num_chunks() const noexcept
+    {
+        return this->_read_chunks.size();
+    }
+
+    LOV_FORCE_INLINE std::size_t num_read_chunks() const noexcept
+    {
+        return this->_num_read_chunks;
+    }
+
+    /* Fraction of the chunks of the file read so far */
+    LOV_FORCE_INLINE float progress() const noexcept
+    {
+        return this->_read_chunks.empty() ? 0.0f :
+                                            static_cast<float>(this->_num_read_chunks) /
+                                            static_cast<float>(this->_read_chunks.size());
+    }
+
+    /* Replaced by poll when the file is written again with another header */
+    LOV_FORCE_INLINE const std::shared_ptr<Image>& image() const noexcept
+    {
+        return this->_image;
+    }
+};
+
+LOV_NAMESPACE_END
+
+#endif /* !defined(__LOV_PROGRESSIVE_READER) */
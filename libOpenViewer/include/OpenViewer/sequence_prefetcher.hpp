@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+#pragma once
+
+#if !defined(__LOV_SEQUENCE_PREFETCHER)
+#define __LOV_SEQUENCE_PREFETCHER
+
+#include "OpenViewer/image.hpp"
+#include "OpenViewer/image_sequence.hpp"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+LOV_NAMESPACE_BEGIN
+
+enum PlaybackDirection_ : std::uint8_t
+{
+    PlaybackDirection_Forward,
+    PlaybackDirection_Backward,
+};
+
+/*
+ * Decodes the frames following the playhead on the library thread pool, so that playing back a
+ * sequence finds its frames already loaded. The frames ahead wrap around the frame range, as
+ * playback loops
+ */
+class LOV_API SequencePrefetcher
+{
+private:
+    enum FrameState_ : std::uint8_t
+    {
+        FrameState_Queued,
+        FrameState_Loading,
+        FrameState_Ready,
+    };
+
+    struct PrefetchedFrame
+    {
+        std::shared_ptr<Image> image;
+        std::uint8_t state;
+    };
+
+    /* Frame n is at index n - first_frame, missing frames have an empty path */
+    stdromano::Vector<stdromano::StringD> _frame_paths;
+
+    /* Layers to load for each frame, all of them if empty */
+    stdromano::Vector<stdromano::StringD> _layers;
+
+    stdromano::HashMap<std::int32_t, PrefetchedFrame> _frames;
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+
+    std::int32_t _first_frame;
+    std::int32_t _playhead;
+
+    std::uint32_t _num_frames_ahead;
+    std::uint32_t _num_pending;
+
+    std::uint8_t _direction;
+
+    bool _stop;
+
+    bool is_in_window(std::int32_t frame) const noexcept;
+
+    void schedule_frames() noexcept;
+
+    void load_frame(std::int32_t frame) noexcept;
+
+    /*
+     * Called without the lock, the layers being copied while holding it. Returns nullptr if the
+     * frame is missing or if any of its layers cannot be loaded
+     */
+    std::shared_ptr<Image> load_image(std::int32_t frame,
+                                      const stdromano::Vector<stdromano::StringD>& layers) const noexcept;
+
+public:
+    SequencePrefetcher(const stdromano::Vector<stdromano::StringD>& frame_paths,
+                       std::int32_t first_frame,
+                       std::uint32_t num_frames_ahead = 8);
+
+    /* Prefetches the frames of the sequence, missing frames are returned as nullptr */
+    SequencePrefetcher(const ImageSequence& sequence, std::uint32_t num_frames_ahead = 8);
+
+    ~SequencePrefetcher() noexcept;
+
+    LOV_NON_COPYABLE(SequencePrefetcher)
+
+    LOV_FORCE_INLINE std::int32_t first_frame() const noexcept
+    {
+        return this->_first_frame;
+    }
+
+    LOV_FORCE_INLINE std::int32_t last_frame() const noexcept
+    {
+        return this->_first_frame + static_cast<std::int32_t>(this->_frame_paths.size()) - 1;
+    }
+
+    /* Restricts the layers decoded for each frame, all the layers are decoded by default */
+    void set_layers(const stdromano::Vector<stdromano::StringD>& layers) noexcept;
+
+    void set_direction(std::uint8_t direction) noexcept;
+
+    void set_num_frames_ahead(std::uint32_t num_frames_ahead) noexcept;
+
+    /* Moves the playhead and queues the decoding of the frames ahead of it */
+    void set_playhead(std::int32_t frame) noexcept;
+
+    /*
+     * Moves the playhead to the frame and returns it fully loaded, waiting for it if it is being
+     * decoded. Returns nullptr if the frame is missing or cannot be read
+     */
+    std::shared_ptr<Image> get_frame(std::int32_t frame) noexcept;
+};
+
+LOV_NAMESPACE_END
+
+#endif /* !defined(__LOV_SEQUENCE_PREFETCHER) */
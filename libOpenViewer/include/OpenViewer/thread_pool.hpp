@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+#pragma once
+
+#if !defined(__LOV_THREAD_POOL)
+#define __LOV_THREAD_POOL
+
+#include "OpenViewer/common.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+LOV_NAMESPACE_BEGIN
+
+class LOV_API ThreadPool
+{
+private:
+    std::vector<std::thread> _workers;
+
+    std::deque<std::function<void()>> _work;
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+
+    bool _stop;
+
+    void worker_loop() noexcept;
+
+public:
+    /* 0 threads means one worker per hardware thread minus one (the caller takes part) */
+    ThreadPool(std::uint32_t num_threads = 0);
+
+    ~ThreadPool() noexcept;
+
+    LOV_NON_COPYABLE(ThreadPool)
+
+    /* Library-wide pool used by the readers and the layer operations */
+    static ThreadPool& get_global_threadpool() noexcept;
+
+    LOV_FORCE_INLINE std::uint32_t num_threads() const noexcept
+    {
+        return static_cast<std::uint32_t>(this->_workers.size());
+    }
+
+    /* Queues some work to be executed asynchronously by a worker */
+    void add_work(std::function<void()>&& work) noexcept;
+
+    /*
+     * Calls func(i) for every i in [0, count) and returns once all calls are done.
+     * The calling thread takes part in the work, so it is safe to call from a worker
+     */
+    void parallel_for(std::size_t count, const std::function<void(std::size_t)>& func) noexcept;
+};
+
+LOV_NAMESPACE_END
+
+#endif /* !defined(__LOV_THREAD_POOL) */
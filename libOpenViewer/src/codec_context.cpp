@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+#include "OpenViewer/codec_context.hpp"
+
+#include <cstdio>
+
+LOV_NAMESPACE_BEGIN
+
+CodecContext& CodecContext::get() noexcept
+{
+    static thread_local CodecContext context;
+
+    return context;
+}
+
+void CodecContext::set_error(const char* error) noexcept
+{
+    this->_error = error;
+}
+
+const char* CodecContext::format_message(const char* fmt, va_list args) noexcept
+{
+    va_list size_args;
+    va_copy(size_args, args);
+
+    const int size = std::vsnprintf(nullptr, 0, fmt, size_args);
+
+    va_end(size_args);
+
+    if(size < 0)
+    {
+        return fmt;
+    }
+
+    this->_message.resize(static_cast<std::size_t>(size) + 1);
+
+    std::vsnprintf(this->_message.data(), this->_message.size(), fmt, args);
+
+    return this->_message.data();
+}
+
+CodecContextScope::CodecContextScope(const stdromano::StringD& path) noexcept
+{
+    CodecContext& context = CodecContext::get();
+
+    this->_previous_path = std::move(context._path);
+    this->_previous_error = std::move(context._error);
+
+    context._path = path.copy();
+    context._error.clear();
+}
+
+CodecContextScope::~CodecContextScope() noexcept
+{
+    CodecContext& context = CodecContext::get();
+
+    context._path = std::move(this->_previous_path);
+    context._error = std::move(this->_previous_error);
+}
+
+LOV_NAMESPACE_END
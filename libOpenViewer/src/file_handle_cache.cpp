@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+#include "OpenViewer/file_handle_cache.hpp"
+#include "OpenViewer/mapped_file.hpp"
+
+#include "stdromano/logger.hpp"
+
+LOV_NAMESPACE_BEGIN
+
+FileHandleCache::FileHandleCache() : _max_open_files(FileHandleCache::DEFAULT_MAX_OPEN_FILES),
+                                     _hits(0),
+                                     _misses(0),
+                                     _evictions(0)
+{
+}
+
+FileHandleCache& FileHandleCache::get_instance() noexcept
+{
+    static FileHandleCache cache;
+
+    return cache;
+}
+
+void FileHandleCache::erase(std::list<Entry>::iterator it) noexcept
+{
+    this->_entries_map.erase(it->path);
+    this->_entries.erase(it);
+}
+
+void FileHandleCache::evict(std::size_t num_files) noexcept
+{
+    while(!this->_entries.empty() && this->_entries.size() + num_files > this->_max_open_files)
+    {
+        this->erase(std::prev(this->_entries.end()));
+        this->_evictions++;
+    }
+}
+
+void FileHandleCache::set_max_open_files(std::size_t max_open_files) noexcept
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    this->_max_open_files = max_open_files;
+    this->evict(0);
+}
+
+std::size_t FileHandleCache::max_open_files() const noexcept
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    return this->_max_open_files;
+}
+
+std::shared_ptr<FileHandle> FileHandleCache::acquire(const stdromano::StringD& path,
+                                                     FileHandleOpenFunc open_func) noexcept
+{
+    /* Buffers registered under memory paths never change */
+    const bool is_memory = MemoryFiles::is_memory_path(path);
+
+    std::error_code ec;
+    const std::filesystem::file_time_type mtime = is_memory ? std::filesystem::file_time_type() :
+                                                              std::filesystem::last_write_time(path.c_str(), ec);
+
+    const std::uintmax_t size = is_memory || ec ? 0 : std::filesystem::file_size(path.c_str(), ec);
+
+    if(ec)
+    {
+        stdromano::log_error("Cannot open file \"{}\" ({})", path, ec.message().c_str());
+        return nullptr;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+
+        auto it = this->_entries_map.find(path);
+
+        if(it != this->_entries_map.end())
+        {
+            auto entry = it->second;
+
+            if(entry->mtime == mtime && entry->size == size && entry->open_func == open_func)
+            {
+                this->_entries.splice(this->_entries.begin(), this->_entries, entry);
+                this->_hits++;
+
+                return entry->handle;
+            }
+
+            this->erase(entry);
+        }
+
+        this->_misses++;
+    }
+
+    /* Opening can be slow on network shares, do not block the other files meanwhile */
+    std::shared_ptr<FileHandle> handle = open_func(path);
+
+    if(handle == nullptr)
+    {
+        return nullptr;
+    }
+
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    if(this->_max_open_files == 0)
+    {
+        return handle;
+    }
+
+    /* Another thread may have opened the file in the meantime */
+    auto it = this->_entries_map.find(path);
+
+    if(it != this->_entries_map.end())
+    {
+        this->erase(it->second);
+    }
+
+    this->evict(1);
+
+    this->_entries.push_front({ path.copy(), mtime, size, open_func, handle });
+    this->_entries_map.emplace(this->_entries.front().path.copy(), this->_entries.begin());
+
+    return handle;
+}
+
+void FileHandleCache::invalidate(const stdromano::StringD& path) noexcept
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    auto it = this->_entries_map.find(path);
+
+    if(it != this->_entries_map.end())
+    {
+        this->erase(it->second);
+    }
+}
+
+void FileHandleCache::clear() noexcept
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    this->_entries.clear();
+    this->_entries_map.clear();
+}
+
+FileHandleCacheStats FileHandleCache::stats() const noexcept
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    FileHandleCacheStats stats;
+    stats.hits = this->_hits;
+    stats.misses = this->_misses;
+    stats.evictions = this->_evictions;
+    stats.num_open_files = this->_entries.size();
+    stats.max_open_files = this->_max_open_files;
+
+    return stats;
+}
+
+void FileHandleCache::reset_stats() noexcept
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    this->_hits = 0;
+    this->_misses = 0;
+    this->_evictions = 0;
+}
+
+LOV_NAMESPACE_END
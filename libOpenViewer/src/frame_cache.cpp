@@ -0,0 +1,210 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+#include "OpenViewer/frame_cache.hpp"
+
+#include "stdromano/logger.hpp"
+#include "stdromano/memory.hpp"
+
+LOV_NAMESPACE_BEGIN
+
+FrameCache::FrameCache() : _budget(0),
+                           _bytes(0),
+                           _hits(0),
+                           _misses(0),
+                           _evictions(0)
+{
+}
+
+FrameCache& FrameCache::get_instance() noexcept
+{
+    /* Leaked on purpose, images destroyed after the function-local statics still release to it */
+    static FrameCache* cache = new FrameCache();
+
+    return *cache;
+}
+
+stdromano::StringD FrameCache::make_key(const stdromano::StringD& path,
+                                        std::int64_t file_mtime,
+                                        std::uint64_t file_size,
+                                        const stdromano::StringD& layer_name,
+                                        std::uint8_t depth,
+                                        std::uint8_t nchannels,
+                                        const stdromano::StringD& mask,
+                                        std::uint8_t level,
+                                        const Imath::Box2i& window) noexcept
+{
+    return stdromano::StringD("{}|{}|{}|{}|{}|{}|{}|{}|{},{},{},{}",
+                              path,
+                              file_mtime,
+                              file_size,
+                              layer_name,
+                              depth,
+                              nchannels,
+                              mask,
+                              level,
+                              window.min.x,
+                              window.min.y,
+                              window.max.x,
+                              window.max.y);
+}
+
+void FrameCache::erase(std::list<Entry>::iterator it) noexcept
+{
+    stdromano::mem_aligned_free(it->data);
+
+    this->_bytes -= it->nbytes;
+    this->_entries_map.erase(it->key);
+    this->_entries.erase(it);
+}
+
+void FrameCache::evict(std::size_t nbytes) noexcept
+{
+    while(!this->_entries.empty() && this->_bytes + nbytes > this->_budget)
+    {
+        this->erase(std::prev(this->_entries.end()));
+        this->_evictions++;
+    }
+}
+
+void FrameCache::set_budget(std::size_t budget) noexcept
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    this->_budget = budget;
+    this->evict(0);
+}
+
+std::size_t FrameCache::budget() const noexcept
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    return this->_budget;
+}
+
+bool FrameCache::is_enabled() const noexcept
+{
+    return this->budget() > 0;
+}
+
+bool FrameCache::put(const stdromano::StringD& key, void* data, std::size_t nbytes) noexcept
+{
+    if(data == nullptr)
+    {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    if(nbytes > this->_budget)
+    {
+        return false;
+    }
+
+    auto it = this->_entries_map.find(key);
+
+    if(it != this->_entries_map.end())
+    {
+        this->erase(it->second);
+    }
+
+    this->evict(nbytes);
+
+    this->_entries.push_front({ key, data, nbytes });
+    this->_entries_map.emplace(key, this->_entries.begin());
+    this->_bytes += nbytes;
+
+    return true;
+}
+
+void* FrameCache::take(const stdromano::StringD& key, std::size_t nbytes) noexcept
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    auto it = this->_entries_map.find(key);
+
+    if(it == this->_entries_map.end())
+    {
+        this->_misses++;
+        return nullptr;
+    }
+
+    auto entry = it->second;
+
+    if(entry->nbytes != nbytes)
+    {
+        stdromano::log_error("Frame cache entry {} has an unexpected size", key);
+        this->erase(entry);
+        this->_misses++;
+        return nullptr;
+    }
+
+    void* data = entry->data;
+
+    this->_bytes -= entry->nbytes;
+    this->_entries_map.erase(it);
+    this->_entries.erase(entry);
+    this->_hits++;
+
+    return data;
+}
+
+void FrameCache::invalidate(const stdromano::StringD& path) noexcept
+{
+    const stdromano::StringD prefix("{}|", path);
+
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    for(auto it = this->_entries.begin(); it != this->_entries.end();)
+    {
+        auto next = std::next(it);
+
+        if(it->key.startswith(prefix.c_str()))
+        {
+            this->erase(it);
+        }
+
+        it = next;
+    }
+}
+
+void FrameCache::clear() noexcept
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    for(Entry& entry : this->_entries)
+    {
+        stdromano::mem_aligned_free(entry.data);
+    }
+
+    this->_entries.clear();
+    this->_entries_map.clear();
+    this->_bytes = 0;
+}
+
+FrameCacheStats FrameCache::stats() const noexcept
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    FrameCacheStats stats;
+    stats.hits = this->_hits;
+    stats.misses = this->_misses;
+    stats.evictions = this->_evictions;
+    stats.num_entries = this->_entries.size();
+    stats.bytes = this->_bytes;
+    stats.budget = this->_budget;
+
+    return stats;
+}
+
+void FrameCache::reset_stats() noexcept
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    this->_hits = 0;
+    this->_misses = 0;
+    this->_evictions = 0;
+}
+
+LOV_NAMESPACE_END
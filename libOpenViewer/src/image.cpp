@@ -3,13 +3,35 @@
 // All rights reserved.
 
 #include "OpenViewer/image.hpp"
+#include "OpenViewer/frame_cache.hpp"
+#include "OpenViewer/file_handle_cache.hpp"
+#include "OpenViewer/mapped_file.hpp"
+#include "OpenViewer/thread_pool.hpp"
 
 #include "stdromano/logger.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+
 LOV_NAMESPACE_BEGIN
 
 /* Helpers */
 
+Imath::Box2i box_intersection(const Imath::Box2i& a, const Imath::Box2i& b) noexcept
+{
+    return Imath::Box2i(Imath::V2i(std::max(a.min.x, b.min.x), std::max(a.min.y, b.min.y)),
+                        Imath::V2i(std::min(a.max.x, b.max.x), std::min(a.max.y, b.max.y)));
+}
+
+bool box_contains(const Imath::Box2i& outer, const Imath::Box2i& inner) noexcept
+{
+    return inner.min.x >= outer.min.x && inner.min.y >= outer.min.y &&
+           inner.max.x <= outer.max.x && inner.max.y <= outer.max.y;
+}
+
 std::size_t layer_depth_as_byte_size(std::uint8_t layer_depth) noexcept
 {
     switch(layer_depth)
@@ -30,10 +52,98 @@ std::size_t layer_depth_as_byte_size(std::uint8_t layer_depth) noexcept
     }
 }
 
+/* Parallel processing */
+
+/* Layers smaller than this are processed on the calling thread */
+static constexpr std::size_t LAYER_PARALLEL_MIN_BYTES = 4 * 1024 * 1024;
+
+/* Size of the data touched by a range, small enough to stay in L2 */
+static constexpr std::size_t LAYER_PARALLEL_RANGE_BYTES = 256 * 1024;
+
+static constexpr std::size_t LAYER_PARALLEL_RANGE_ALIGNMENT = 1024;
+
+void detail::layer_parallel_for(std::size_t npixels,
+                                std::size_t pixel_size,
+                                const std::function<void(std::size_t, std::size_t)>& func) noexcept
+{
+    if(npixels * pixel_size < LAYER_PARALLEL_MIN_BYTES)
+    {
+        func(0, npixels);
+        return;
+    }
+
+    const std::size_t range_pixels = std::max(LAYER_PARALLEL_RANGE_ALIGNMENT,
+                                              (LAYER_PARALLEL_RANGE_BYTES / pixel_size) /
+                                              LAYER_PARALLEL_RANGE_ALIGNMENT *
+                                              LAYER_PARALLEL_RANGE_ALIGNMENT);
+
+    const std::size_t num_ranges = (npixels + range_pixels - 1) / range_pixels;
+
+    ThreadPool::get_global_threadpool().parallel_for(num_ranges, [&](std::size_t i) {
+        const std::size_t start = i * range_pixels;
+
+        func(start, std::min(range_pixels, npixels - start));
+    });
+}
+
+/* Lazy loading */
+
+/* Threads waiting for layers being loaded share a few condition variables, picked by address */
+struct LayerLoadWaiters
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+};
+
+LayerLoadWaiters& layer_load_waiters(const std::atomic<std::uint8_t>& load_state) noexcept
+{
+    static LayerLoadWaiters waiters[64];
+
+    return waiters[(reinterpret_cast<std::uintptr_t>(std::addressof(load_state)) / alignof(std::max_align_t)) % 64];
+}
+
+/* Moves the layer to the loading state, returns false if another thread did it first */
+bool layer_load_try_begin(std::atomic<std::uint8_t>& load_state) noexcept
+{
+    std::uint8_t expected = LayerLoadState_Idle;
+
+    return load_state.compare_exchange_strong(expected,
+                                              LayerLoadState_Loading,
+                                              std::memory_order_acq_rel,
+                                              std::memory_order_acquire);
+}
+
+/* Moves the layer out of the loading state, to loaded if its data has been published */
+void layer_load_end(std::atomic<std::uint8_t>& load_state, std::uint8_t state) noexcept
+{
+    LayerLoadWaiters& waiters = layer_load_waiters(load_state);
+
+    {
+        /* Taking the mutex makes sure waiters are either waiting or will see the new state */
+        std::unique_lock<std::mutex> lock(waiters.mutex);
+        load_state.store(state, std::memory_order_release);
+    }
+
+    waiters.cv.notify_all();
+}
+
+void layer_load_wait(const std::atomic<std::uint8_t>& load_state) noexcept
+{
+    LayerLoadWaiters& waiters = layer_load_waiters(load_state);
+
+    std::unique_lock<std::mutex> lock(waiters.mutex);
+
+    waiters.cv.wait(lock, [&]() -> bool {
+        return load_state.load(std::memory_order_acquire) != LayerLoadState_Loading;
+    });
+}
+
 /* Layer */
 
 Layer::~Layer() noexcept
 {
+    this->clear_variants();
+
     if(this->_data != nullptr)
     {
         stdromano::mem_aligned_free(this->_data);
@@ -41,9 +151,54 @@ Layer::~Layer() noexcept
     }
 }
 
+Layer* Layer::find_variant(std::uint32_t level,
+                           const Imath::Box2i& window,
+                           std::uint8_t depth,
+                           const stdromano::StringD& mask) const noexcept
+{
+    Layer* variant = this->_variants.load(std::memory_order_acquire);
+
+    for(; variant != nullptr; variant = variant->_variants.load(std::memory_order_relaxed))
+    {
+        if(variant->_level == level &&
+           variant->_depth == depth &&
+           std::strcmp(variant->_mask.c_str(), mask.c_str()) == 0 &&
+           box_contains(variant->window(), window))
+        {
+            return variant;
+        }
+    }
+
+    return nullptr;
+}
+
+void Layer::clear_variants() noexcept
+{
+    Layer* variant = this->_variants.exchange(nullptr, std::memory_order_acq_rel);
+
+    while(variant != nullptr)
+    {
+        /* Unlinked first so deleting a variant does not recurse through the list */
+        Layer* next = variant->_variants.exchange(nullptr, std::memory_order_relaxed);
+
+        delete variant;
+
+        variant = next;
+    }
+}
+
 Layer::Layer(const Layer& other) : _parent(other._parent),
+                                   _window(other._window),
                                    _depth(other._depth),
-                                   _nchannels(other._nchannels)
+                                   _nchannels(other._nchannels),
+                                   _level(other._level),
+                                   _unmodified(other._unmodified),
+                                   _file_depth(other._file_depth),
+                                   _file_nchannels(other._file_nchannels),
+                                   _mask(other._mask.copy()),
+                                   _load_state(LayerLoadState_Idle),
+                                   _variants(nullptr),
+                                   _variants_state(LayerLoadState_Idle)
 {
     this->_data = stdromano::mem_aligned_alloc(this->nbytes(), ALIGNMENT);
     std::memcpy(this->_data, other._data, this->nbytes());
@@ -53,14 +208,22 @@ Layer& Layer::operator=(const Layer& other) noexcept
 {
     if(this != &other)
     {
+        this->clear_variants();
+
         if(this->_data != nullptr)
         {
             stdromano::mem_aligned_free(this->_data);
         }
 
         this->_parent = other._parent;
+        this->_window = other._window;
         this->_depth = other._depth;
         this->_nchannels = other._nchannels;
+        this->_level = other._level;
+        this->_unmodified = other._unmodified;
+        this->_file_depth = other._file_depth;
+        this->_file_nchannels = other._file_nchannels;
+        this->_mask = other._mask.copy();
 
         if(other._data != nullptr)
         {
@@ -73,13 +236,23 @@ Layer& Layer::operator=(const Layer& other) noexcept
 }
 
 Layer::Layer(Layer&& other) noexcept : _parent(other._parent),
+                                       _window(other._window),
                                        _depth(other._depth),
                                        _nchannels(other._nchannels),
+                                       _level(other._level),
+                                       _unmodified(other._unmodified),
+                                       _file_depth(other._file_depth),
+                                       _file_nchannels(other._file_nchannels),
+                                       _mask(std::move(other._mask)),
+                                       _load_state(LayerLoadState_Idle),
+                                       _variants(other._variants.exchange(nullptr)),
+                                       _variants_state(LayerLoadState_Idle),
                                        _data(other._data)
 {
     other._parent = nullptr;
     other._depth = 0;
     other._nchannels = 0;
+    other._unmodified = false;
     other._data = nullptr;
 }
 
@@ -87,19 +260,29 @@ Layer& Layer::operator=(Layer&& other) noexcept
 {
     if(this != &other)
     {
+        this->clear_variants();
+
         if(this->_data != nullptr)
         {
             stdromano::mem_aligned_free(this->_data);
         }
 
         this->_parent = other._parent;
+        this->_window = other._window;
         this->_depth = other._depth;
         this->_nchannels = other._nchannels;
+        this->_level = other._level;
+        this->_unmodified = other._unmodified;
+        this->_file_depth = other._file_depth;
+        this->_file_nchannels = other._file_nchannels;
+        this->_mask = std::move(other._mask);
+        this->_variants.store(other._variants.exchange(nullptr));
         this->_data = other._data;
 
         other._parent = nullptr;
         other._depth = 0;
         other._nchannels = 0;
+        other._unmodified = false;
         other._data = nullptr;
     }
 
@@ -142,10 +325,158 @@ void Layer::set_pixel(std::int32_t x, std::int32_t y, void* pixel) noexcept
     std::memcpy(std::addressof(static_cast<char*>(this->_data)[offset]),
                 pixel,
                 this->_nchannels * layer_depth_as_byte_size(this->_depth));
+
+    this->_unmodified = false;
+}
+
+void Layer::crop(const Imath::Box2i& new_window) noexcept
+{
+    const Imath::Box2i window = this->window();
+
+    LOV_ASSERT(box_contains(window, new_window), "Crop window is not contained in the layer window");
+
+    const Imath::Box2i& data_window = this->_parent->data_window();
+
+    Imath::Box2i cropped_window;
+
+    if(new_window != data_window)
+    {
+        cropped_window = new_window;
+    }
+
+    if(this->_data == nullptr)
+    {
+        this->_window = cropped_window;
+        return;
+    }
+
+    const std::size_t pixel_size = this->pixel_size();
+    const std::size_t src_stride = static_cast<std::size_t>(this->width()) * pixel_size;
+    const std::size_t dst_stride = static_cast<std::size_t>(new_window.max.x - new_window.min.x + 1) *
+                                   pixel_size;
+    const std::size_t x_offset = static_cast<std::size_t>(new_window.min.x - window.min.x) *
+                                 pixel_size;
+
+    void* new_data = stdromano::mem_aligned_alloc(dst_stride * (new_window.max.y - new_window.min.y + 1),
+                                                  Layer::ALIGNMENT);
+
+    for(std::int32_t y = new_window.min.y; y <= new_window.max.y; y++)
+    {
+        std::memcpy(static_cast<char*>(new_data) + (y - new_window.min.y) * dst_stride,
+                    static_cast<const char*>(this->_data) + (y - window.min.y) * src_stride + x_offset,
+                    dst_stride);
+    }
+
+    stdromano::mem_aligned_free(this->_data);
+
+    this->_data = new_data;
+    this->_window = cropped_window;
 }
 
 /* Image */
 
+Image::~Image() noexcept
+{
+    for(auto& [name, layer] : this->_layers)
+    {
+        this->release_layer_data(name, layer);
+    }
+
+    /* Cached handles would keep the buffer alive */
+    if(this->_memory != nullptr)
+    {
+        FileHandleCache::get_instance().invalidate(this->_path);
+    }
+}
+
+void Image::release_layer_data(const stdromano::StringD& name, Layer& layer) const noexcept
+{
+    this->release_variants_data(name, layer);
+    this->release_data(name, layer);
+}
+
+void Image::release_variants_data(const stdromano::StringD& name, Layer& layer) const noexcept
+{
+    /* On a variant the list holds the next ones, so each one only releases its own data */
+    Layer* variant = layer._variants.load(std::memory_order_acquire);
+
+    for(; variant != nullptr; variant = variant->_variants.load(std::memory_order_relaxed))
+    {
+        this->release_data(name, *variant);
+    }
+}
+
+void Image::release_data(const stdromano::StringD& name, Layer& layer) const noexcept
+{
+    if(layer._data == nullptr)
+    {
+        return;
+    }
+
+    FrameCache& cache = FrameCache::get_instance();
+
+    /* Images held in memory are not read again from a file, their layers would only fill the cache */
+    const bool cached = layer._unmodified &&
+                        !this->_path.empty() &&
+                        !MemoryFiles::is_memory_path(this->_path) &&
+                        cache.is_enabled() &&
+                        cache.put(FrameCache::make_key(this->_path,
+                                                       this->_file_mtime,
+                                                       this->_file_size,
+                                                       name,
+                                                       layer._depth,
+                                                       layer._nchannels,
+                                                       layer._mask,
+                                                       layer._level,
+                                                       layer.window()),
+                                  layer._data,
+                                  layer.nbytes());
+
+    if(!cached)
+    {
+        stdromano::mem_aligned_free(layer._data);
+    }
+
+    layer._data = nullptr;
+    layer._unmodified = false;
+}
+
+bool Image::take_cached_layer_data(const stdromano::StringD& name, Layer& layer) const noexcept
+{
+    FrameCache& cache = FrameCache::get_instance();
+
+    if(this->_path.empty() || MemoryFiles::is_memory_path(this->_path) || !cache.is_enabled())
+    {
+        return false;
+    }
+
+    void* data = cache.take(FrameCache::make_key(this->_path,
+                                                 this->_file_mtime,
+                                                 this->_file_size,
+                                                 name,
+                                                 layer._depth,
+                                                 layer._nchannels,
+                                                 layer._mask,
+                                                 layer._level,
+                                                 layer.window()),
+                            layer.nbytes());
+
+    if(data == nullptr)
+    {
+        return false;
+    }
+
+    if(layer._data != nullptr)
+    {
+        stdromano::mem_aligned_free(layer._data);
+    }
+
+    layer._data = data;
+    layer._unmodified = true;
+
+    return true;
+}
+
 Layer* Image::create_layer(const stdromano::StringD& name,
                            std::uint8_t depth,
                            std::uint8_t nchannels) noexcept
@@ -166,6 +497,34 @@ const Layer* Image::main() const noexcept
 }
 
 Layer* Image::get_layer(const stdromano::StringD& name) noexcept
+{
+    return this->get_layer(name, this->_data_window);
+}
+
+Layer* Image::get_layer(const stdromano::StringD& name, const Imath::Box2i& roi) noexcept
+{
+    return this->get_layer(name, roi, 0);
+}
+
+Layer* Image::get_layer(const stdromano::StringD& name,
+                        const Imath::Box2i& roi,
+                        std::uint32_t level) noexcept
+{
+    return this->get_layer(name, roi, level, LayerDepth_NONE, stdromano::StringD());
+}
+
+Layer* Image::get_layer(const stdromano::StringD& name,
+                        std::uint8_t depth,
+                        const stdromano::StringD& mask) noexcept
+{
+    return this->get_layer(name, this->_data_window, 0, depth, mask);
+}
+
+Layer* Image::get_layer(const stdromano::StringD& name,
+                        const Imath::Box2i& roi,
+                        std::uint32_t level,
+                        std::uint8_t depth,
+                        const stdromano::StringD& mask) noexcept
 {
     auto it = this->_layers.find(name);
 
@@ -176,19 +535,170 @@ Layer* Image::get_layer(const stdromano::StringD& name) noexcept
 
     Layer& layer = it->second;
 
-    if(!layer.is_loaded())
+    /* A variant is only published with the shape of a valid mask */
+    if(!mask.empty() && std::get<0>(build_shuffle_mask(mask, layer._file_nchannels)) == 0)
+    {
+        stdromano::log_error("Invalid shuffle mask {} for layer {} of image {}", mask, name, this->_path);
+        return nullptr;
+    }
+
+    const std::uint8_t target_depth = depth == LayerDepth_NONE ? layer._file_depth : depth;
+    const std::uint8_t target_nchannels = mask.empty() ? layer._file_nchannels :
+                                                         static_cast<std::uint8_t>(mask.size());
+
+    level = std::min(level, this->num_levels() - 1);
+
+    const Imath::Box2i& level_window = this->level_data_window(level);
+
+    /* Bring the roi to the pixel coordinates of the level */
+    const Imath::Box2i level_roi(Imath::V2i(this->_data_window.min.x + ((roi.min.x - this->_data_window.min.x) >> level),
+                                            this->_data_window.min.y + ((roi.min.y - this->_data_window.min.y) >> level)),
+                                 Imath::V2i(this->_data_window.min.x + ((roi.max.x - this->_data_window.min.x) >> level),
+                                            this->_data_window.min.y + ((roi.max.y - this->_data_window.min.y) >> level)));
+
+    const Imath::Box2i window = box_intersection(level_roi, level_window);
+
+    if(window.isEmpty())
+    {
+        stdromano::log_error("Region of interest of layer {} does not intersect the data window of image {}",
+                             name,
+                             this->_path);
+        return nullptr;
+    }
+
+    /* The layer itself only holds the whole level 0 as stored in the file */
+    const bool is_file_read = level == 0 &&
+                              window == this->_data_window &&
+                              target_depth == layer._file_depth &&
+                              target_nchannels == layer._file_nchannels &&
+                              mask.empty();
+
+    while(true)
     {
-        layer.allocate(layer.nbytes());
+        const std::uint8_t state = layer._load_state.load(std::memory_order_acquire);
+
+        if(state == LayerLoadState_Loading)
+        {
+            layer_load_wait(layer._load_state);
+            continue;
+        }
+
+        if(state == LayerLoadState_Loaded)
+        {
+            if(layer._level == level &&
+               box_contains(layer.window(), window) &&
+               layer._depth == target_depth &&
+               layer._nchannels == target_nchannels &&
+               std::strcmp(layer._mask.c_str(), mask.c_str()) == 0)
+            {
+                return std::addressof(layer);
+            }
+
+            break;
+        }
+
+        if(!layer_load_try_begin(layer._load_state))
+        {
+            continue;
+        }
+
+        /* Data given to the layer by the user is published as is */
+        if(layer.is_loaded())
+        {
+            layer_load_end(layer._load_state, LayerLoadState_Loaded);
+            continue;
+        }
+
+        if(!is_file_read)
+        {
+            layer_load_end(layer._load_state, LayerLoadState_Idle);
+            break;
+        }
+
+        const bool loaded = this->take_cached_layer_data(name, layer) ||
+                            Image::read_layer_pixels(this->_path, name, layer);
 
-        if(!Image::read_layer_pixels(layer.parent()->get_path(), name, layer))
+        if(!loaded)
         {
             stdromano::log_error("Error during pixel read of layer {} of image {}",
                                  name,
                                  this->_path);
+
+            /* Leave the layer unloaded so the next request tries again */
+            layer.set_data(nullptr);
+            layer_load_end(layer._load_state, LayerLoadState_Idle);
+
+            return nullptr;
         }
+
+        layer._unmodified = true;
+
+        layer_load_end(layer._load_state, LayerLoadState_Loaded);
+
+        return std::addressof(layer);
     }
 
-    return std::addressof(layer);
+    /* Regions, mip levels and converted reads are read in variants, never in a layer handed out */
+    while(true)
+    {
+        Layer* variant = layer.find_variant(level, window, target_depth, mask);
+
+        if(variant != nullptr)
+        {
+            return variant;
+        }
+
+        if(layer_load_try_begin(layer._variants_state))
+        {
+            break;
+        }
+
+        layer_load_wait(layer._variants_state);
+    }
+
+    /* Another thread may have published it between the lookup and taking the loading state */
+    Layer* published = layer.find_variant(level, window, target_depth, mask);
+
+    if(published != nullptr)
+    {
+        layer_load_end(layer._variants_state, LayerLoadState_Idle);
+
+        return published;
+    }
+
+    Layer* variant = new Layer(this, target_depth, target_nchannels);
+
+    variant->_level = static_cast<std::uint8_t>(level);
+    variant->_window = (level == 0 && window == this->_data_window) ? Imath::Box2i() : window;
+    variant->_file_depth = layer._file_depth;
+    variant->_file_nchannels = layer._file_nchannels;
+    variant->_mask = mask.copy();
+
+    const bool loaded = this->take_cached_layer_data(name, *variant) ||
+                        Image::read_layer_pixels(this->_path, name, *variant);
+
+    if(!loaded)
+    {
+        stdromano::log_error("Error during pixel read of layer {} of image {}",
+                             name,
+                             this->_path);
+
+        delete variant;
+
+        layer_load_end(layer._variants_state, LayerLoadState_Idle);
+
+        return nullptr;
+    }
+
+    variant->_unmodified = true;
+    variant->_load_state.store(LayerLoadState_Loaded, std::memory_order_relaxed);
+    variant->_variants.store(layer._variants.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+    layer._variants.store(variant, std::memory_order_release);
+
+    layer_load_end(layer._variants_state, LayerLoadState_Idle);
+
+    return variant;
 }
 
 const Layer* Image::get_layer(const stdromano::StringD& name) const noexcept
@@ -205,16 +715,165 @@ const Layer* Image::get_layer(const stdromano::StringD& name) const noexcept
     return std::addressof(layer);
 }
 
+const Imath::Box2i& Image::level_data_window(std::uint32_t level) const noexcept
+{
+    if(level == 0 || this->_level_data_windows.empty())
+    {
+        return this->_data_window;
+    }
+
+    return this->_level_data_windows[std::min(level, this->num_levels() - 1)];
+}
+
+std::uint32_t Image::level_for_zoom(float zoom) const noexcept
+{
+    if(zoom >= 1.0f || zoom <= 0.0f)
+    {
+        return 0;
+    }
+
+    const std::uint32_t level = static_cast<std::uint32_t>(std::floor(std::log2(1.0f / zoom)));
+
+    return std::min(level, this->num_levels() - 1);
+}
+
+bool Image::load_layers(const stdromano::Vector<stdromano::StringD>& names) noexcept
+{
+    stdromano::Vector<stdromano::StringD> to_load;
+
+    /* Layers being loaded by other threads */
+    stdromano::Vector<Layer*> to_wait;
+
+    bool found_all = true;
+
+    for(const auto& name : names)
+    {
+        auto it = this->_layers.find(name);
+
+        if(it == this->_layers.end())
+        {
+            stdromano::log_error("Cannot find layer {} in image {}", name, this->_path);
+            found_all = false;
+            continue;
+        }
+
+        Layer& layer = it->second;
+
+        const std::uint8_t state = layer._load_state.load(std::memory_order_acquire);
+
+        if(state == LayerLoadState_Loaded)
+        {
+            continue;
+        }
+
+        if(state == LayerLoadState_Loading || !layer_load_try_begin(layer._load_state))
+        {
+            to_wait.push_back(std::addressof(layer));
+            continue;
+        }
+
+        /* Data given to the layer by the user is published as is */
+        if(layer.is_loaded() || this->take_cached_layer_data(name, layer))
+        {
+            layer_load_end(layer._load_state, LayerLoadState_Loaded);
+            continue;
+        }
+
+        to_load.push_back(name);
+    }
+
+    bool success = true;
+
+    if(!to_load.empty())
+    {
+        success = Image::read_layers_pixels(this->_path, to_load, *this);
+
+        if(!success)
+        {
+            stdromano::log_error("Error during pixel read of {} layers of image {}",
+                                 to_load.size(),
+                                 this->_path);
+        }
+
+        for(const auto& name : to_load)
+        {
+            Layer& layer = this->_layers.find(name)->second;
+
+            if(success)
+            {
+                layer._unmodified = true;
+            }
+            else
+            {
+                layer.set_data(nullptr);
+            }
+
+            layer_load_end(layer._load_state, success ? LayerLoadState_Loaded : LayerLoadState_Idle);
+        }
+    }
+
+    /* The loads of the other threads can fail too, leaving their layers idle */
+    for(Layer* layer : to_wait)
+    {
+        layer_load_wait(layer->_load_state);
+
+        if(layer->_load_state.load(std::memory_order_acquire) != LayerLoadState_Loaded)
+        {
+            stdromano::log_error("Layer of image {} loaded by another thread could not be read", this->_path);
+            success = false;
+        }
+    }
+
+    return success && found_all;
+}
+
+bool Image::load_all_layers() noexcept
+{
+    stdromano::Vector<stdromano::StringD> names;
+
+    for(const auto& [name, _] : this->_layers)
+    {
+        names.push_back(name);
+    }
+
+    return this->load_layers(names);
+}
+
 void Image::remove_layer(const stdromano::StringD& name) noexcept
 {
     auto it = this->_layers.find(name);
 
     if(it != this->_layers.end())
     {
+        this->release_layer_data(name, it->second);
         this->_layers.erase(it);
     }
 }
 
+void Image::release_variants(const stdromano::StringD& name) noexcept
+{
+    auto it = this->_layers.find(name);
+
+    if(it == this->_layers.end())
+    {
+        return;
+    }
+
+    this->release_variants_data(name, it->second);
+
+    it->second.clear_variants();
+}
+
+void Image::release_all_variants() noexcept
+{
+    for(auto& [name, layer] : this->_layers)
+    {
+        this->release_variants_data(name, layer);
+
+        layer.clear_variants();
+    }
+}
+
 void Image::rename_layer(const stdromano::StringD& name, const stdromano::StringD& new_name) noexcept
 {
     auto it = this->_layers.find(name);
@@ -0,0 +1,501 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+#include "OpenViewer/image_archive.hpp"
+#include "OpenViewer/image_reader.hpp"
+#include "OpenViewer/thread_pool.hpp"
+
+#include "stdromano/logger.hpp"
+#include "stdromano/memory.hpp"
+
+#include "mz.h"
+#include "mz_strm.h"
+#include "mz_strm_os.h"
+#include "mz_zip.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+LOV_NAMESPACE_BEGIN
+
+/* Minizip handles are not thread safe, each thread reading compressed members opens its own */
+struct ZipReader
+{
+    void* stream = nullptr;
+    void* zip = nullptr;
+
+    ZipReader() = default;
+
+    LOV_NON_COPYABLE(ZipReader)
+
+    ~ZipReader()
+    {
+        this->close();
+    }
+
+    bool open(const stdromano::StringD& path) noexcept
+    {
+        this->stream = mz_stream_os_create();
+
+        if(mz_stream_os_open(this->stream, path.c_str(), MZ_OPEN_MODE_READ) != MZ_OK)
+        {
+            this->close();
+            return false;
+        }
+
+        this->zip = mz_zip_create();
+
+        if(mz_zip_open(this->zip, this->stream, MZ_OPEN_MODE_READ) != MZ_OK)
+        {
+            this->close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void close() noexcept
+    {
+        if(this->zip != nullptr)
+        {
+            mz_zip_close(this->zip);
+            mz_zip_delete(&this->zip);
+        }
+
+        if(this->stream != nullptr)
+        {
+            mz_stream_os_close(this->stream);
+            mz_stream_os_delete(&this->stream);
+        }
+
+        this->zip = nullptr;
+        this->stream = nullptr;
+    }
+};
+
+/*
+ * Offset of the data of a stored member, found from its local header since its name and extra
+ * field can differ from the ones of the central directory. Returns ~0 if the header is invalid
+ */
+std::uint64_t zip_stored_data_offset(const MappedFile& file, std::int64_t header_offset) noexcept
+{
+    constexpr std::uint64_t local_header_size = 30;
+    constexpr std::uint32_t local_header_signature = 0x04034b50;
+
+    if(header_offset < 0 || static_cast<std::uint64_t>(header_offset) + local_header_size > file.size())
+    {
+        return ~static_cast<std::uint64_t>(0);
+    }
+
+    const std::uint8_t* header = file.data() + header_offset;
+
+    const std::uint32_t signature = static_cast<std::uint32_t>(header[0]) |
+                                    static_cast<std::uint32_t>(header[1]) << 8 |
+                                    static_cast<std::uint32_t>(header[2]) << 16 |
+                                    static_cast<std::uint32_t>(header[3]) << 24;
+
+    if(signature != local_header_signature)
+    {
+        return ~static_cast<std::uint64_t>(0);
+    }
+
+    const std::uint64_t name_size = static_cast<std::uint64_t>(header[26]) | static_cast<std::uint64_t>(header[27]) << 8;
+    const std::uint64_t extra_size = static_cast<std::uint64_t>(header[28]) | static_cast<std::uint64_t>(header[29]) << 8;
+
+    return static_cast<std::uint64_t>(header_offset) + local_header_size + name_size + extra_size;
+}
+
+/* Reads the first size bytes of the member at the position in the central directory */
+bool zip_read_entry(void* zip, std::int64_t cd_position, std::uint8_t* buffer, std::uint64_t size) noexcept
+{
+    if(mz_zip_goto_entry(zip, cd_position) != MZ_OK ||
+       mz_zip_entry_read_open(zip, 0, nullptr) != MZ_OK)
+    {
+        return false;
+    }
+
+    std::uint64_t read_size = 0;
+
+    while(read_size < size)
+    {
+        const std::int32_t chunk_size = static_cast<std::int32_t>(std::min(size - read_size,
+                                                                           static_cast<std::uint64_t>(std::numeric_limits<std::int32_t>::max())));
+
+        const std::int32_t result = mz_zip_entry_read(zip, buffer + read_size, chunk_size);
+
+        if(result <= 0)
+        {
+            break;
+        }
+
+        read_size += static_cast<std::uint64_t>(result);
+    }
+
+    mz_zip_entry_close(zip);
+
+    return read_size == size;
+}
+
+/* Extension of the member name, passed as format hint since the members have no path on disk */
+stdromano::StringD zip_member_extension(const stdromano::StringD& name) noexcept
+{
+    const char* extension = "";
+
+    for(const char* c = name.c_str(); *c != '\0'; c++)
+    {
+        if(*c == '.')
+        {
+            extension = c + 1;
+        }
+        else if(*c == '/' || *c == '\\')
+        {
+            extension = "";
+        }
+    }
+
+    return stdromano::StringD(extension);
+}
+
+bool ImageArchive::open(const stdromano::StringD& path) noexcept
+{
+    this->close();
+
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+
+    if(!file->open(path, MappedFileHint_Random))
+    {
+        return false;
+    }
+
+    ZipReader reader;
+
+    if(!reader.open(path))
+    {
+        stdromano::log_error("Cannot read the central directory of archive \"{}\"", path);
+        return false;
+    }
+
+    stdromano::Vector<Member> members;
+
+    std::int32_t err;
+
+    for(err = mz_zip_goto_first_entry(reader.zip); err == MZ_OK; err = mz_zip_goto_next_entry(reader.zip))
+    {
+        mz_zip_file* info = nullptr;
+
+        if(mz_zip_entry_get_info(reader.zip, &info) != MZ_OK || mz_zip_entry_is_dir(reader.zip) == MZ_OK)
+        {
+            continue;
+        }
+
+        if((info->flag & MZ_ZIP_FLAG_ENCRYPTED) != 0)
+        {
+            stdromano::log_warn("Skipping encrypted member \"{}\" of archive \"{}\"", info->filename, path);
+            continue;
+        }
+
+        Member member;
+        member.name = stdromano::StringD(info->filename);
+        member.cd_position = mz_zip_get_entry(reader.zip);
+        member.size = static_cast<std::uint64_t>(info->uncompressed_size);
+        member.data_offset = ImageArchive::NO_DATA_OFFSET;
+
+        if(info->compression_method == MZ_COMPRESS_METHOD_STORE && info->disk_number == 0)
+        {
+            const std::uint64_t data_offset = zip_stored_data_offset(*file, info->disk_offset);
+
+            if(data_offset != ImageArchive::NO_DATA_OFFSET && data_offset + member.size <= file->size())
+            {
+                member.data_offset = data_offset;
+            }
+        }
+
+        members.push_back(std::move(member));
+    }
+
+    if(err != MZ_END_OF_LIST)
+    {
+        stdromano::log_error("Error while listing the members of archive \"{}\" ({})", path, err);
+        return false;
+    }
+
+    std::sort(members.begin(), members.end(), [](const Member& a, const Member& b) -> bool {
+        return std::strcmp(a.name.c_str(), b.name.c_str()) < 0;
+    });
+
+    this->_path = path.copy();
+    this->_file = std::move(file);
+    this->_members = std::move(members);
+
+    stdromano::log_debug("Opened archive \"{}\" ({} members)", path, this->_members.size());
+
+    return true;
+}
+
+void ImageArchive::close() noexcept
+{
+    this->_path = stdromano::StringD();
+    this->_file.reset();
+    this->_members.clear();
+}
+
+stdromano::Vector<stdromano::StringD> ImageArchive::member_names() const noexcept
+{
+    stdromano::Vector<stdromano::StringD> names;
+
+    for(const Member& member : this->_members)
+    {
+        names.push_back(member.name.copy());
+    }
+
+    return names;
+}
+
+const ImageArchive::Member* ImageArchive::find_member(const stdromano::StringD& name) const noexcept
+{
+    auto it = std::lower_bound(this->_members.begin(),
+                               this->_members.end(),
+                               name,
+                               [](const Member& member, const stdromano::StringD& name) -> bool {
+                                   return std::strcmp(member.name.c_str(), name.c_str()) < 0;
+                               });
+
+    if(it == this->_members.end() || std::strcmp(it->name.c_str(), name.c_str()) != 0)
+    {
+        return nullptr;
+    }
+
+    return &(*it);
+}
+
+bool ImageArchive::has_member(const stdromano::StringD& name) const noexcept
+{
+    return this->find_member(name) != nullptr;
+}
+
+/* Inflates the first size bytes of the member in a new buffer, nullptr on failure */
+std::shared_ptr<const void> zip_inflate_entry(void* zip, std::int64_t cd_position, std::uint64_t size) noexcept
+{
+    std::uint8_t* buffer = static_cast<std::uint8_t*>(stdromano::mem_aligned_alloc(static_cast<std::size_t>(size), 32));
+
+    std::shared_ptr<const void> data(buffer, [](const void* ptr) {
+        stdromano::mem_aligned_free(const_cast<void*>(ptr));
+    });
+
+    if(!zip_read_entry(zip, cd_position, buffer, size))
+    {
+        return nullptr;
+    }
+
+    return data;
+}
+
+std::shared_ptr<Image> ImageArchive::read_member(const Member& member, void* zip) const noexcept
+{
+    if(member.size == 0)
+    {
+        return nullptr;
+    }
+
+    if(member.data_offset == ImageArchive::NO_DATA_OFFSET)
+    {
+        return this->read_compressed_member(member, zip);
+    }
+
+    const std::uint8_t* member_data = this->_file->data() + member.data_offset;
+
+    const std::size_t header_size = static_cast<std::size_t>(std::min(member.size,
+                                                                      static_cast<std::uint64_t>(ImageReaderRegistry::PROBE_SIZE)));
+
+    /* Skip the members no reader recognizes */
+    if(ImageReaderRegistry::get_instance().detect_format(member_data, header_size, member.name).empty())
+    {
+        return nullptr;
+    }
+
+    /* Shares the ownership of the mapping */
+    return Image::from_memory(std::shared_ptr<const void>(this->_file, member_data),
+                              static_cast<std::size_t>(member.size),
+                              zip_member_extension(member.name));
+}
+
+std::shared_ptr<Image> ImageArchive::read_compressed_member(const Member& member, void* zip) const noexcept
+{
+    const stdromano::StringD extension = zip_member_extension(member.name);
+
+    /* Only the start of the member is inflated to probe it and read its headers */
+    const std::uint64_t prefix_size = std::min(member.size, ImageArchive::HEADER_PREFIX_SIZE);
+
+    std::shared_ptr<const void> prefix = zip_inflate_entry(zip, member.cd_position, prefix_size);
+
+    if(prefix == nullptr)
+    {
+        stdromano::log_error("Cannot inflate member \"{}\" of archive \"{}\"", member.name, this->_path);
+        return nullptr;
+    }
+
+    const std::size_t header_size = static_cast<std::size_t>(std::min(prefix_size,
+                                                                      static_cast<std::uint64_t>(ImageReaderRegistry::PROBE_SIZE)));
+
+    const std::uint8_t* header = static_cast<const std::uint8_t*>(prefix.get());
+
+    if(ImageReaderRegistry::get_instance().detect_format(header, header_size, member.name).empty())
+    {
+        return nullptr;
+    }
+
+    if(prefix_size == member.size)
+    {
+        return Image::from_memory(std::move(prefix), static_cast<std::size_t>(member.size), extension);
+    }
+
+    /* The whole member is inflated by the first read of its pixels, with a zip reader of its own */
+    std::shared_ptr<LazyMemoryFile> lazy = std::make_shared<LazyMemoryFile>(
+        [archive_path = this->_path.copy(),
+         member_name = member.name.copy(),
+         cd_position = member.cd_position,
+         size = member.size]() -> std::shared_ptr<const void> {
+            ZipReader reader;
+
+            std::shared_ptr<const void> data;
+
+            if(reader.open(archive_path))
+            {
+                data = zip_inflate_entry(reader.zip, cd_position, size);
+            }
+
+            if(data == nullptr)
+            {
+                stdromano::log_error("Cannot inflate member \"{}\" of archive \"{}\"", member_name, archive_path);
+            }
+
+            return data;
+        });
+
+    const stdromano::StringD path = MemoryFiles::get_instance().add(lazy, static_cast<std::size_t>(member.size), extension);
+
+    /* The prefix stands for the member while its headers are read */
+    const stdromano::StringD prefix_path = MemoryFiles::get_instance().add(prefix, static_cast<std::size_t>(prefix_size), extension);
+
+    std::shared_ptr<Image> image;
+
+    {
+        MappedFileScope scope(path, std::make_shared<MappedFile>(prefix_path));
+
+        image = Image::from_memory_path(path, lazy);
+    }
+
+    if(image == nullptr)
+    {
+        /* Headers past the prefix, such as the directories at the end of some tiff files */
+        stdromano::log_debug("Headers of member \"{}\" of archive \"{}\" exceed {} bytes, inflating it",
+                             member.name,
+                             this->_path,
+                             prefix_size);
+
+        image = Image::from_memory_path(path, lazy);
+    }
+
+    return image;
+}
+
+std::shared_ptr<Image> ImageArchive::image(const stdromano::StringD& name) const noexcept
+{
+    const Member* member = this->find_member(name);
+
+    if(member == nullptr)
+    {
+        stdromano::log_error("No member \"{}\" in archive \"{}\"", name, this->_path);
+        return nullptr;
+    }
+
+    ZipReader reader;
+
+    if(member->data_offset == ImageArchive::NO_DATA_OFFSET && !reader.open(this->_path))
+    {
+        stdromano::log_error("Cannot open archive \"{}\"", this->_path);
+        return nullptr;
+    }
+
+    std::shared_ptr<Image> image = this->read_member(*member, reader.zip);
+
+    if(image == nullptr)
+    {
+        stdromano::log_error("Cannot read member \"{}\" of archive \"{}\"", name, this->_path);
+    }
+
+    return image;
+}
+
+void ImageArchive::read_members(const std::function<void(std::size_t, std::shared_ptr<Image>)>& func) const noexcept
+{
+    ThreadPool& pool = ThreadPool::get_global_threadpool();
+
+    const std::size_t num_workers = std::min(this->_members.size(),
+                                             static_cast<std::size_t>(pool.num_threads() + 1));
+
+    std::atomic<std::size_t> next_member(0);
+
+    pool.parallel_for(num_workers, [&](std::size_t) {
+        /* Opened on the first compressed member */
+        ZipReader reader;
+
+        std::size_t i;
+
+        while((i = next_member.fetch_add(1, std::memory_order_relaxed)) < this->_members.size())
+        {
+            const Member& member = this->_members[i];
+
+            /* Only this member is skipped, the open is retried on the next compressed one */
+            if(member.data_offset == ImageArchive::NO_DATA_OFFSET &&
+               reader.zip == nullptr &&
+               !reader.open(this->_path))
+            {
+                stdromano::log_error("Cannot open archive \"{}\" to read member \"{}\"", this->_path, member.name);
+                continue;
+            }
+
+            std::shared_ptr<Image> image = this->read_member(member, reader.zip);
+
+            if(image != nullptr)
+            {
+                func(i, std::move(image));
+            }
+        }
+    });
+}
+
+stdromano::Vector<std::shared_ptr<Image>> ImageArchive::images() const noexcept
+{
+    stdromano::Vector<std::shared_ptr<Image>> member_images;
+    member_images.resize(this->_members.size());
+
+    this->read_members([&](std::size_t i, std::shared_ptr<Image> image) {
+        member_images[i] = std::move(image);
+    });
+
+    stdromano::Vector<std::shared_ptr<Image>> images;
+
+    for(std::shared_ptr<Image>& image : member_images)
+    {
+        if(image != nullptr)
+        {
+            images.push_back(std::move(image));
+        }
+    }
+
+    return images;
+}
+
+void ImageArchive::for_each_image(const std::function<void(const stdromano::StringD&, Image&)>& func) const noexcept
+{
+    this->read_members([&](std::size_t i, std::shared_ptr<Image> image) {
+        func(this->_members[i].name, *image);
+    });
+}
+
+LOV_NAMESPACE_END
@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+#include "OpenViewer/image_catalog.hpp"
+#include "OpenViewer/image_reader.hpp"
+#include "OpenViewer/thread_pool.hpp"
+
+#include "stdromano/logger.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+LOV_NAMESPACE_BEGIN
+
+/*
+ * Iterates with error codes, the range-for of the directory iterators throws on errors. Files are
+ * only filtered by extension here, their content is probed when reading their metadata
+ */
+template<typename Iterator>
+void list_image_files(Iterator it, stdromano::Vector<stdromano::StringD>& paths, std::error_code& ec) noexcept
+{
+    const ImageReaderRegistry& registry = ImageReaderRegistry::get_instance();
+
+    for(; !ec && it != Iterator(); it.increment(ec))
+    {
+        std::error_code file_ec;
+
+        if(!it->is_regular_file(file_ec))
+        {
+            continue;
+        }
+
+        stdromano::StringD path(it->path().string().c_str());
+
+        if(registry.has_extension(path))
+        {
+            paths.push_back(std::move(path));
+        }
+    }
+}
+
+bool ImageCatalog::scan(const stdromano::StringD& directory, bool recursive) noexcept
+{
+    this->clear();
+
+    stdromano::Vector<stdromano::StringD> paths;
+    std::error_code ec;
+
+    if(recursive)
+    {
+        list_image_files(std::filesystem::recursive_directory_iterator(directory.c_str(),
+                                                                       std::filesystem::directory_options::skip_permission_denied,
+                                                                       ec),
+                         paths,
+                         ec);
+    }
+    else
+    {
+        list_image_files(std::filesystem::directory_iterator(directory.c_str(), ec), paths, ec);
+    }
+
+    if(ec)
+    {
+        stdromano::log_error("Cannot list directory \"{}\" ({})", directory, ec.message().c_str());
+        return false;
+    }
+
+    std::sort(paths.begin(), paths.end(), [](const stdromano::StringD& a, const stdromano::StringD& b) -> bool {
+        return std::strcmp(a.c_str(), b.c_str()) < 0;
+    });
+
+    /*
+     * Only headers are read, so the work is mostly waiting on the file system. Files whose content
+     * is not an image end up invalid and are dropped
+     */
+    stdromano::Vector<std::shared_ptr<Image>> images;
+    images.resize(paths.size());
+
+    ThreadPool::get_global_threadpool().parallel_for(paths.size(), [&](std::size_t i) {
+        images[i] = std::make_shared<Image>(paths[i]);
+    });
+
+    for(std::shared_ptr<Image>& image : images)
+    {
+        if(image->is_valid())
+        {
+            this->_images.push_back(std::move(image));
+        }
+    }
+
+    stdromano::log_debug("Scanned {} images in directory \"{}\"", this->_images.size(), directory);
+
+    return true;
+}
+
+std::shared_ptr<Image> ImageCatalog::find(const stdromano::StringD& path) const noexcept
+{
+    auto it = std::lower_bound(this->_images.begin(),
+                               this->_images.end(),
+                               path,
+                               [](const std::shared_ptr<Image>& image, const stdromano::StringD& path) -> bool {
+                                   return std::strcmp(image->get_path().c_str(), path.c_str()) < 0;
+                               });
+
+    if(it == this->_images.end() || std::strcmp((*it)->get_path().c_str(), path.c_str()) != 0)
+    {
+        return nullptr;
+    }
+
+    return *it;
+}
+
+void ImageCatalog::clear() noexcept
+{
+    this->_images.clear();
+}
+
+LOV_NAMESPACE_END
@@ -3,39 +3,104 @@
 // All rights reserved.
 
 #include "OpenViewer/image.hpp"
+#include "OpenViewer/image_reader.hpp"
+#include "OpenViewer/thread_pool.hpp"
+#include "OpenViewer/mapped_file.hpp"
+#include "OpenViewer/file_handle_cache.hpp"
+#include "OpenViewer/codec_context.hpp"
+#include "OpenViewer/progressive_reader.hpp"
+
+#include "stdromano/memory.hpp"
+
+/*
+ * stb allocates the decoded image itself, so it goes through the same aligned allocator as the
+ * layers. The buffer it returns is then adopted by the layer as is, without copy
+ */
+static void* stbi_aligned_realloc_sized(void* ptr, std::size_t old_size, std::size_t new_size) noexcept
+{
+    void* new_ptr = stdromano::mem_aligned_alloc(new_size, 32);
+
+    if(ptr != nullptr)
+    {
+        std::memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+        stdromano::mem_aligned_free(ptr);
+    }
+
+    return new_ptr;
+}
 
 #define STB_IMAGE_IMPLEMENTATION
-#define STBI_MALLOC stdromano::mem_alloc
-#define STBI_REALLOC stdromano::mem_realloc
-#define STBI_FREE stdromano::mem_free
+#define STBI_MALLOC(size) stdromano::mem_aligned_alloc(size, 32)
+#define STBI_REALLOC_SIZED(ptr, old_size, new_size) stbi_aligned_realloc_sized(ptr, old_size, new_size)
+#define STBI_FREE(ptr) stdromano::mem_aligned_free(ptr)
 #include "stb_image_read.hpp"
 
 #include "stdromano/logger.hpp"
 #include "stdromano/vector.hpp"
 #include "stdromano/filesystem.hpp"
 
-#include "OpenEXR/ImfInputFile.h"
+#include "OpenEXR/ImfTileDescription.h"
+#include "OpenEXR/ImfMultiPartInputFile.h"
+#include "OpenEXR/ImfInputPart.h"
+#include "OpenEXR/ImfTiledInputPart.h"
+#include "OpenEXR/ImfDeepScanLineInputPart.h"
+#include "OpenEXR/ImfDeepTiledInputPart.h"
+#include "OpenEXR/ImfDeepFrameBuffer.h"
+#include "OpenEXR/ImfPartType.h"
 #include "OpenEXR/ImfChannelList.h"
 #include "OpenEXR/ImfFrameBuffer.h"
+#include "OpenEXR/ImfIO.h"
+#include "OpenEXR/ImfXdr.h"
+#include "OpenEXR/ImfVersion.h"
+#include "OpenEXR/ImfHeader.h"
+#include "OpenEXR/IexBaseExc.h"
 #include "Imath/half.h"
 #include "Imath/ImathBox.h"
 
 #include "tiffio.h"
 
+#include <intrin.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
 #include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
 
 LOV_NAMESPACE_BEGIN
 
+/* stb keeps the reason of its last failure in a thread local, recorded in the codec context */
+const char* stb_failure_reason() noexcept
+{
+    const char* reason = stbi_failure_reason();
+
+    CodecContext::get().set_error(reason != nullptr ? reason : "unknown error");
+
+    return CodecContext::get().error();
+}
+
 /* JPEG */
 
+bool image_probe_jpeg(const std::uint8_t* header, std::size_t size) noexcept
+{
+    return size >= 3 && header[0] == 0xFF && header[1] == 0xD8 && header[2] == 0xFF;
+}
+
 bool image_read_metadata_jpeg(const stdromano::StringD& path,
                               Image& img) noexcept
 {
     int x, y, n;
 
-    if(stbi_info(path.c_str(), &x, &y, &n) == 0)
+    MappedFile file(path);
+
+    if(!file.is_open() ||
+       stbi_info_from_memory(file.data(), static_cast<int>(file.size()), &x, &y, &n) == 0)
     {
-        stdromano::log_error("Error while loading image: \"{}\"", path);
+        stdromano::log_error("Error while loading image: \"{}\" ({})",
+                             path,
+                             file.is_open() ? stb_failure_reason() : "cannot open file");
         return false;
     }
 
@@ -63,30 +128,71 @@ bool layer_pixel_read_jpeg(const stdromano::StringD& path,
 {
     int x, y, n;
 
-    layer.set_data(static_cast<void*>(stbi_load(path.c_str(), &x, &y, &n, 0)));
+    MappedFile file(path);
 
-    if(layer.data<unsigned char>() == nullptr)
+    if(!file.is_open())
     {
         stdromano::log_error("Error while loading layer \"{}\" from image: \"{}\"",
                              layer_name,
                              path);
+        return false;
+    }
+
+    stbi_uc* data = stbi_load_from_memory(file.data(),
+                                          static_cast<int>(file.size()),
+                                          &x,
+                                          &y,
+                                          &n,
+                                          0);
+
+    if(data == nullptr)
+    {
+        stdromano::log_error("Error while loading layer \"{}\" from image: \"{}\" ({})",
+                             layer_name,
+                             path,
+                             stb_failure_reason());
+
+        return false;
+    }
 
+    if(x != layer.parent()->get_data_width() ||
+       y != layer.parent()->get_data_height() ||
+       n != static_cast<int>(layer.nchannels()))
+    {
+        stdromano::log_error("Layer \"{}\" from image: \"{}\" does not match its metadata",
+                             layer_name,
+                             path);
+        stdromano::mem_aligned_free(data);
         return false;
     }
 
+    layer.set_data(static_cast<void*>(data));
+
     return true;
 }
 
 /* PNG */
 
+bool image_probe_png(const std::uint8_t* header, std::size_t size) noexcept
+{
+    static constexpr std::uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+    return size >= sizeof(signature) && std::memcmp(header, signature, sizeof(signature)) == 0;
+}
+
 bool image_read_metadata_png(const stdromano::StringD& path,
                              Image& img) noexcept
 {
     int x, y, n;
 
-    if(stbi_info(path.c_str(), &x, &y, &n) == 0)
+    MappedFile file(path);
+
+    if(!file.is_open() ||
+       stbi_info_from_memory(file.data(), static_cast<int>(file.size()), &x, &y, &n) == 0)
     {
-        stdromano::log_error("Error while loading image: \"{}\"", path);
+        stdromano::log_error("Error while loading image: \"{}\" ({})",
+                             path,
+                             file.is_open() ? stb_failure_reason() : "cannot open file");
         return false;
     }
 
@@ -114,30 +220,70 @@ bool layer_pixel_read_png(const stdromano::StringD& path,
 {
     int x, y, n;
 
-    layer.set_data(static_cast<void*>(stbi_load(path.c_str(), &x, &y, &n, 0)));
+    MappedFile file(path);
 
-    if(layer.data<unsigned char>() == nullptr)
+    if(!file.is_open())
     {
         stdromano::log_error("Error while loading layer \"{}\" from image: \"{}\"",
                              layer_name,
                              path);
+        return false;
+    }
+
+    stbi_uc* data = stbi_load_from_memory(file.data(),
+                                          static_cast<int>(file.size()),
+                                          &x,
+                                          &y,
+                                          &n,
+                                          0);
+
+    if(data == nullptr)
+    {
+        stdromano::log_error("Error while loading layer \"{}\" from image: \"{}\" ({})",
+                             layer_name,
+                             path,
+                             stb_failure_reason());
 
         return false;
     }
 
+    if(x != layer.parent()->get_data_width() ||
+       y != layer.parent()->get_data_height() ||
+       n != static_cast<int>(layer.nchannels()))
+    {
+        stdromano::log_error("Layer \"{}\" from image: \"{}\" does not match its metadata",
+                             layer_name,
+                             path);
+        stdromano::mem_aligned_free(data);
+        return false;
+    }
+
+    layer.set_data(static_cast<void*>(data));
+
     return true;
 }
 
 /* HDR */
 
+bool image_probe_hdr(const std::uint8_t* header, std::size_t size) noexcept
+{
+    return (size >= 10 && std::memcmp(header, "#?RADIANCE", 10) == 0) ||
+           (size >= 6 && std::memcmp(header, "#?RGBE", 6) == 0);
+}
+
 bool image_read_metadata_hdr(const stdromano::StringD& path,
                              Image& img) noexcept
 {
     int x, y, n;
 
-    if(stbi_info(path.c_str(), &x, &y, &n) == 0)
+    MappedFile file(path);
+
+    if(!file.is_open() ||
+       stbi_info_from_memory(file.data(), static_cast<int>(file.size()), &x, &y, &n) == 0)
     {
-        stdromano::log_error("Error while loading image: \"{}\"", path);
+        stdromano::log_error("Error while loading image: \"{}\" ({})",
+                             path,
+                             file.is_open() ? stb_failure_reason() : "cannot open file");
         return false;
     }
 
@@ -165,9 +311,9 @@ bool layer_pixel_read_hdr(const stdromano::StringD& path,
 {
     int x, y, n;
 
-    layer.set_data(static_cast<void*>(stbi_loadf(path.c_str(), &x, &y, &n, 0)));
+    MappedFile file(path);
 
-    if(layer.data<unsigned char>() == nullptr)
+    if(!file.is_open())
     {
         stdromano::log_error("Error while loading layer \"{}\" from image: \"{}\"",
                              layer_name,
@@ -175,60 +321,96 @@ bool layer_pixel_read_hdr(const stdromano::StringD& path,
         return false;
     }
 
+    float* data = stbi_loadf_from_memory(file.data(),
+                                         static_cast<int>(file.size()),
+                                         &x,
+                                         &y,
+                                         &n,
+                                         0);
+
+    if(data == nullptr)
+    {
+        stdromano::log_error("Error while loading layer \"{}\" from image: \"{}\" ({})",
+                             layer_name,
+                             path,
+                             stb_failure_reason());
+        return false;
+    }
+
+    if(x != layer.parent()->get_data_width() ||
+       y != layer.parent()->get_data_height() ||
+       n != static_cast<int>(layer.nchannels()))
+    {
+        stdromano::log_error("Layer \"{}\" from image: \"{}\" does not match its metadata",
+                             layer_name,
+                             path);
+        stdromano::mem_aligned_free(data);
+        return false;
+    }
+
+    layer.set_data(static_cast<void*>(data));
+
     return true;
 }
 
 /* Tiff */
 
+/*
+ * libtiff reports through process-wide handlers, installed once with the builtin readers. They
+ * format the message in the codec context of the thread, which knows the file being read
+ */
 void tiff_error_handler(const char* module, const char* fmt, va_list ap)
 {
-    char buf[1024];
-    std::memset(buf, 0, sizeof(buf));
+    CodecContext& context = CodecContext::get();
 
-    vsnprintf(buf, 1024, fmt, ap);
+    const char* message = context.format_message(fmt, ap);
 
-    stdromano::log_error("{}", buf);
+    context.set_error(message);
+
+    stdromano::log_error("\"{}\": {}", context.path(), message);
 }
 
 void tiff_warning_handler(const char* module, const char* fmt, va_list ap)
 {
-    char buf[1024];
-    std::memset(buf, 0, sizeof(buf));
-
-    vsnprintf(buf, 1024, fmt, ap);
+    CodecContext& context = CodecContext::get();
 
-    stdromano::log_warn("{}", buf);
+    stdromano::log_warn("\"{}\": {}", context.path(), context.format_message(fmt, ap));
 }
 
-bool image_read_metadata_tiff(const stdromano::StringD& path,
-                              Image& img) noexcept
+/* Classic and BigTIFF, in both byte orders */
+bool image_probe_tiff(const std::uint8_t* header, std::size_t size) noexcept
 {
-    TIFFSetErrorHandler(tiff_error_handler);
-    TIFFSetWarningHandler(tiff_warning_handler);
-
-    TIFF* tif = TIFFOpen(path.c_str(), "r");
-
-    if(tif == nullptr)
+    if(size < 4)
     {
-        stdromano::log_error("Error while loading image: \"{}\"", path);
         return false;
     }
 
-    std::uint32_t width, height;
-
-    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
-    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
+    return (header[0] == 'I' && header[1] == 'I' && (header[2] == 42 || header[2] == 43) && header[3] == 0) ||
+           (header[0] == 'M' && header[1] == 'M' && header[2] == 0 && (header[3] == 42 || header[3] == 43));
+}
 
-    img.data_window() = Imath::Box2i(Imath::V2i(0, 0), Imath::V2i(width, height));
-    img.display_window() = Imath::Box2i(Imath::V2i(0, 0), Imath::V2i(width, height));
-    img.aspect_ratio() = static_cast<float>(width) / static_cast<float>(height);
+/*
+ * Returns the depth of the samples if they can be decoded as they are stored, LayerDepth_NONE if
+ * the image has to go through the RGBA interface of libtiff (palette, YCbCr, bilevel, signed
+ * samples, non top-left orientations...)
+ */
+std::uint8_t tiff_native_depth(TIFF* tif) noexcept
+{
+    std::uint16_t bits_per_sample = 1;
+    std::uint16_t sample_format = SAMPLEFORMAT_UINT;
+    std::uint16_t photometric = PHOTOMETRIC_MINISBLACK;
+    std::uint16_t orientation = ORIENTATION_TOPLEFT;
 
-    std::uint16_t n_channels = 1, bits_per_sample = 1, sample_format = SAMPLEFORMAT_UINT;
-    TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLESPERPIXEL, &n_channels);
     TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &bits_per_sample);
     TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLEFORMAT, &sample_format);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_ORIENTATION, &orientation);
+    TIFFGetField(tif, TIFFTAG_PHOTOMETRIC, &photometric);
 
-    std::uint8_t depth;
+    if(orientation != ORIENTATION_TOPLEFT ||
+       (photometric != PHOTOMETRIC_MINISBLACK && photometric != PHOTOMETRIC_RGB))
+    {
+        return LayerDepth_NONE;
+    }
 
     switch(sample_format)
     {
@@ -236,309 +418,3283 @@ bool image_read_metadata_tiff(const stdromano::StringD& path,
             switch(bits_per_sample)
             {
                 case 8:
-                    depth = LayerDepth_U8;
-                    break;
+                    return LayerDepth_U8;
                 case 16:
-                    depth = LayerDepth_U16;
-                    break;
+                    return LayerDepth_U16;
                 case 32:
-                    depth = LayerDepth_U32;
-                    break;
+                    return LayerDepth_U32;
                 default:
-                    stdromano::log_error("Unknown uint bit depth: {}", bits_per_sample);
-                    return false;
+                    return LayerDepth_NONE;
             }
 
-            break;
-
         case SAMPLEFORMAT_IEEEFP:
             switch(bits_per_sample)
             {
                 case 16:
-                    depth = LayerDepth_F16;
-                    break;
+                    return LayerDepth_F16;
                 case 32:
-                    depth = LayerDepth_F32;
-                    break;
+                    return LayerDepth_F32;
                 default:
-                    stdromano::log_error("Unknown float bit depth: {}", bits_per_sample);
-                    return false;
+                    return LayerDepth_NONE;
             }
 
-            break;
-
         default:
-            stdromano::log_error("Unsupported sample format: {}", sample_format);
-            return false;
+            return LayerDepth_NONE;
     }
-
-    img.get_layers().emplace(std::make_pair(Image::MAIN_LAYER_NAME,
-                                            Layer(std::addressof(img),
-                                                  depth,
-                                                  static_cast<std::uint8_t>(n_channels))));
-
-    TIFFClose(tif);
-
-    return true;
 }
 
-bool layer_pixel_read_tiff(const stdromano::StringD& path,
-                           const stdromano::StringD& layer_name,
-                           Layer& layer) noexcept
+/*
+ * libtiff reads the files through their mapping rather than its own file descriptor, so files on
+ * disk and buffers registered in MemoryFiles are read the same way
+ */
+struct TIFFMappedSource
 {
-    TIFF* tif = TIFFOpen(path.c_str(), "r");
+    MappedFile file;
+    std::uint64_t position = 0;
+};
 
-    layer.allocate(layer.nbytes());
+tmsize_t tiff_source_read(thandle_t handle, void* buffer, tmsize_t size)
+{
+    TIFFMappedSource* source = static_cast<TIFFMappedSource*>(handle);
 
-    if(!TIFFReadRGBAImage(tif,
-                          layer.parent()->get_data_width(),
-                          layer.parent()->get_data_height(),
-                          layer.data<uint32_t>(),
-                          0))
+    if(size <= 0 || source->position >= source->file.size())
     {
-        TIFFClose(tif);
-
-        stdromano::log_error("Error while loading layer \"{}\" from image: \"{}\"",
-                             layer_name,
-                             path);
-
-        return false;
+        return 0;
     }
 
-    TIFFClose(tif);
+    const std::uint64_t read_size = std::min(static_cast<std::uint64_t>(size),
+                                             source->file.size() - source->position);
 
-    return true;
-}
+    std::memcpy(buffer, source->file.data() + source->position, static_cast<std::size_t>(read_size));
 
-/* EXR */
+    source->position += read_size;
 
-using EXRLayerNames = stdromano::HashMap<stdromano::StringD, stdromano::Vector<stdromano::StringD>>;
+    return static_cast<tmsize_t>(read_size);
+}
 
-EXRLayerNames image_get_layer_names_exr(const Imf::ChannelList& channels) noexcept
+tmsize_t tiff_source_write(thandle_t handle, void* buffer, tmsize_t size)
 {
-    EXRLayerNames layer_names;
+    LOV_UNUSED(handle);
+    LOV_UNUSED(buffer);
+    LOV_UNUSED(size);
 
-    for(Imf::ChannelList::ConstIterator it = channels.begin(); it != channels.end(); ++it)
-    {
-        stdromano::StringD name;
-        stdromano::StringD channel_name = stdromano::StringD::make_ref(it.name()).rsplit(".",
-                                                                                         &name);
+    return 0;
+}
 
-        if(name.size() == 0)
-        {
-            layer_names["default"].push_back(channel_name);
-        }
-        else
-        {
-            layer_names[name].push_back(channel_name);
-        }
-    }
+toff_t tiff_source_seek(thandle_t handle, toff_t offset, int whence)
+{
+    TIFFMappedSource* source = static_cast<TIFFMappedSource*>(handle);
 
-    if(layer_names.contains("default"))
-    {
-        std::sort(layer_names["default"].begin(),
-                  layer_names["default"].end(),
-                  [](const auto& lhs, const auto& rhs) -> bool {
-                      return lhs[0] > rhs[0];
-                  });
+    std::uint64_t position;
 
-        layer_names[Image::MAIN_LAYER_NAME] = std::move(layer_names["default"]);
-        layer_names.erase("default");
-    }
-    else
+    switch(whence)
     {
-        stdromano::log_error("No default layer has been found in exr file");
+        case SEEK_SET:
+            position = offset;
+            break;
+        case SEEK_CUR:
+            position = source->position + offset;
+            break;
+        case SEEK_END:
+            position = source->file.size() + offset;
+            break;
+        default:
+            return static_cast<toff_t>(-1);
     }
 
-    return layer_names;
+    source->position = position;
+
+    return static_cast<toff_t>(position);
 }
 
-bool image_read_metadata_exr(const stdromano::StringD& path,
-                             Image& img) noexcept
+int tiff_source_close(thandle_t handle)
 {
-    try
-    {
-        Imf::InputFile file(path.c_str());
-        const Imf::Header& header = file.header();
-        const Imf::ChannelList& channels = header.channels();
+    delete static_cast<TIFFMappedSource*>(handle);
 
-        img.data_window() = file.header().dataWindow();
-        img.display_window() = file.header().displayWindow();
-        img.aspect_ratio() = file.header().pixelAspectRatio();
+    return 0;
+}
 
-        EXRLayerNames layers = image_get_layer_names_exr(channels);
+toff_t tiff_source_size(thandle_t handle)
+{
+    return static_cast<toff_t>(static_cast<TIFFMappedSource*>(handle)->file.size());
+}
 
-        for(const auto& exr_layer : layers)
-        {
-            const stdromano::Vector<stdromano::StringD>& layer_channels = exr_layer.second;
+/* Hands the mapping to libtiff, which then decodes strips and tiles without copying them */
+int tiff_source_map(thandle_t handle, void** base, toff_t* size)
+{
+    TIFFMappedSource* source = static_cast<TIFFMappedSource*>(handle);
 
-            if(layer_channels.empty())
-            {
-                continue;
-            }
+    *base = const_cast<std::uint8_t*>(source->file.data());
+    *size = static_cast<toff_t>(source->file.size());
 
-            const Imf::PixelType channel_type = channels.find(layer_channels[0].c_str()).channel().type;
-            const std::uint8_t depth = (channel_type == Imf::HALF) ? LayerDepth_F16 : LayerDepth_F32;
-            const std::size_t channel_size = layer_depth_as_byte_size(depth);
+    return 1;
+}
 
-            Layer layer(std::addressof(img),
-                        depth,
-                        static_cast<std::uint8_t>(layer_channels.size()));
+void tiff_source_unmap(thandle_t handle, void* base, toff_t size)
+{
+    LOV_UNUSED(handle);
+    LOV_UNUSED(base);
+    LOV_UNUSED(size);
+}
 
-            img.get_layers().emplace(std::make_pair(exr_layer.first.copy(), std::move(layer)));
-        }
+TIFF* tiff_open(const stdromano::StringD& path) noexcept
+{
+    TIFFMappedSource* source = new TIFFMappedSource();
 
-        stdromano::log_debug("Loaded exr file {} (w: {}, h:{}, l:{})",
-                             stdromano::fs_filename(path),
-                             img.get_data_width(),
-                             img.get_data_height(),
-                             img.get_layers().size());
-    }
-    catch(const std::exception& e)
+    if(!source->file.open(path, MappedFileHint_Random))
     {
-        stdromano::log_error("Error while loading image \"{}\": {}", path, e.what());
-        return false;
+        delete source;
+        return nullptr;
     }
 
+    TIFF* tif = TIFFClientOpen(path.c_str(),
+                               "r",
+                               static_cast<thandle_t>(source),
+                               tiff_source_read,
+                               tiff_source_write,
+                               tiff_source_seek,
+                               tiff_source_close,
+                               tiff_source_size,
+                               tiff_source_map,
+                               tiff_source_unmap);
+
+    /* The close procedure is not called when opening fails */
+    if(tif == nullptr)
+    {
+        delete source;
+    }
 
-    return true;
+    return tif;
 }
 
-bool layer_pixel_read_exr(const stdromano::StringD& path,
-                          const stdromano::StringD& layer_name,
-                          Layer& layer) noexcept
+bool image_read_metadata_tiff(const stdromano::StringD& path,
+                              Image& img) noexcept
 {
-    try
+    TIFF* tif = tiff_open(path);
+
+    if(tif == nullptr)
     {
-        Imf::InputFile file(path.c_str());
-        const Imf::Header& header = file.header();
-        const Imf::ChannelList& channels = header.channels();
+        stdromano::log_error("Error while loading image: \"{}\"", path);
+        return false;
+    }
 
-        EXRLayerNames layers = image_get_layer_names_exr(channels);
+    std::uint32_t width = 0, height = 0;
 
-        auto layer_it = layers.find(layer_name);
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
 
-        if(layer_it == layers.end())
-        {
-            return false;
-        }
+    /* libtiff opens files whose directory is damaged, reporting it through the handlers only */
+    if(CodecContext::get().has_error() || width == 0 || height == 0)
+    {
+        stdromano::log_error("Error while loading image: \"{}\" ({})",
+                             path,
+                             CodecContext::get().has_error() ? CodecContext::get().error() : "empty image");
+        TIFFClose(tif);
+        return false;
+    }
 
-        const stdromano::Vector<stdromano::StringD>& layer_channels = layer_it.value();
+    img.data_window() = Imath::Box2i(Imath::V2i(0, 0), Imath::V2i(width - 1, height - 1));
+    img.display_window() = Imath::Box2i(Imath::V2i(0, 0), Imath::V2i(width - 1, height - 1));
+    img.aspect_ratio() = static_cast<float>(width) / static_cast<float>(height);
 
-        if(layer_channels.empty())
-        {
-            return false;
-        }
+    std::uint16_t n_channels = 1;
+    TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLESPERPIXEL, &n_channels);
 
-        const std::size_t channel_size = layer.channel_size();
-        const Imf::PixelType channel_type = channels.find(layer_channels[0].c_str()).channel().type;
+    std::uint8_t depth = tiff_native_depth(tif);
 
-        Imf::FrameBuffer frame_buffer;
-        std::size_t offset = 0;
+    if(depth == LayerDepth_NONE)
+    {
+        char error[1024];
 
-        for(const auto& channel : layer_channels)
+        if(!TIFFRGBAImageOK(tif, error))
         {
-            frame_buffer.insert(channel.c_str(),
-                                Imf::Slice(channel_type,
-                                           layer.data<char>() + offset,
-                                           channel_size * layer_channels.size(),
-                                           channel_size * layer_channels.size() * layer.parent()->get_data_width()));
-
-            offset += channel_size;
+            stdromano::log_error("Unsupported tiff image: \"{}\" ({})", path, error);
+            TIFFClose(tif);
+            return false;
         }
 
-        file.setFrameBuffer(frame_buffer);
-        file.readPixels(layer.parent()->data_window().min.y,
-                        layer.parent()->data_window().max.y);
+        /* Decoded to 8 bits RGBA by libtiff */
+        depth = LayerDepth_U8;
+        n_channels = 4;
     }
-    catch(const std::exception& e)
-    {
-        stdromano::log_error("Error while loading layer \"{}\" from image: \"{}\" ({})",
-                             layer_name,
-                             path,
-                             e.what());
 
-        return false;
-    }
+    img.get_layers().emplace(std::make_pair(Image::MAIN_LAYER_NAME,
+                                            Layer(std::addressof(img),
+                                                  depth,
+                                                  static_cast<std::uint8_t>(n_channels))));
+
+    TIFFClose(tif);
 
     return true;
 }
 
-/* Registry */
+/*
+ * Decodes the strips or tiles intersecting the window of the layer with their native sample type.
+ * Strips and tiles are compressed independently, so they are decoded in parallel, each worker
+ * having its own handle as a TIFF handle cannot be shared between threads
+ */
+bool tiff_read_native(const stdromano::StringD& path, TIFF* tif, Layer& layer) noexcept
+{
+    std::uint32_t width, height;
+    std::uint16_t n_samples = 1;
+    std::uint16_t planar_config = PLANARCONFIG_CONTIG;
 
-using ImageMetadataReadFunc = bool(*)(const stdromano::StringD&, Image&) noexcept;
-using LayerPixelsReadFunc = bool(*)(const stdromano::StringD&,
-                                    const stdromano::StringD&,
-                                    Layer&) noexcept;
-
-static stdromano::HashMap<stdromano::StringD, ImageMetadataReadFunc> g_read_funcs_table = {
-    { "jpg", image_read_metadata_jpeg },
-    { "jpeg", image_read_metadata_jpeg },
-    { "png", image_read_metadata_png },
-    { "hdr", image_read_metadata_hdr },
-    { "exr", image_read_metadata_exr },
-    { "tiff", image_read_metadata_tiff },
-    { "tif", image_read_metadata_tiff },
-};
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLESPERPIXEL, &n_samples);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_PLANARCONFIG, &planar_config);
 
-static stdromano::HashMap<stdromano::StringD, LayerPixelsReadFunc> g_pix_read_funcs_table = {
-    { "jpg", layer_pixel_read_jpeg },
-    { "jpeg", layer_pixel_read_jpeg },
-    { "png", layer_pixel_read_png },
-    { "hdr", layer_pixel_read_hdr },
-    { "exr", layer_pixel_read_exr },
-    { "tiff", layer_pixel_read_tiff },
-    { "tif", layer_pixel_read_tiff },
-};
+    const bool tiled = TIFFIsTiled(tif) != 0;
+    const bool separate = planar_config == PLANARCONFIG_SEPARATE && n_samples > 1;
 
-/* Returns nullptr if the read function can't be found */
-ImageMetadataReadFunc get_image_read_metadata(const stdromano::StringD& ext) noexcept
-{
-    auto it = g_read_funcs_table.find(ext);
+    std::uint32_t chunk_width = width;
+    std::uint32_t chunk_height = height;
 
-    return it == g_read_funcs_table.end() ? nullptr : it->second;
-}
+    if(tiled)
+    {
+        TIFFGetField(tif, TIFFTAG_TILEWIDTH, &chunk_width);
+        TIFFGetField(tif, TIFFTAG_TILELENGTH, &chunk_height);
+    }
+    else
+    {
+        TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &chunk_height);
+        chunk_height = std::min(chunk_height, height);
+    }
 
-LayerPixelsReadFunc get_layer_pixels_read(const stdromano::StringD& ext) noexcept
-{
-    auto it = g_pix_read_funcs_table.find(ext);
+    const Imath::Box2i& window = layer.window();
 
-    return it == g_pix_read_funcs_table.end() ? nullptr : it->second;
-}
+    const std::size_t sample_size = layer.channel_size();
+    const std::size_t pixel_size = layer.pixel_size();
+    const std::size_t layer_stride = static_cast<std::size_t>(layer.width()) * pixel_size;
 
-/* Generic image read static function */
+    /* With separate planes, every strip or tile holds a single sample */
+    const std::size_t chunk_pixel_size = separate ? sample_size : pixel_size;
+    const std::size_t chunk_stride = static_cast<std::size_t>(chunk_width) * chunk_pixel_size;
+    const tmsize_t chunk_size = tiled ? TIFFTileSize(tif) : TIFFStripSize(tif);
 
-bool Image::read_image_metadata(const stdromano::StringD& path,
-                                Image& image) noexcept
-{
-    const stdromano::StringD ext = path.rsplit(".");
+    const std::uint32_t chunks_x = (width + chunk_width - 1) / chunk_width;
+    const std::uint32_t chunks_y = (height + chunk_height - 1) / chunk_height;
+    const std::uint32_t num_planes = separate ? n_samples : 1;
 
-    ImageMetadataReadFunc func = get_image_read_metadata(ext);
+    /* Chunks are indexed plane by plane, then row by row in the file */
+    stdromano::Vector<std::uint32_t> chunks;
 
-    if(func == nullptr)
+    for(std::uint32_t plane = 0; plane < num_planes; plane++)
     {
-        stdromano::log_error("No function available to load file: {} (type is: {})", path, ext);
-        return false;
+        for(std::uint32_t cy = 0; cy < chunks_y; cy++)
+        {
+            for(std::uint32_t cx = 0; cx < chunks_x; cx++)
+            {
+                const Imath::Box2i chunk_box(Imath::V2i(cx * chunk_width, cy * chunk_height),
+                                             Imath::V2i((cx + 1) * chunk_width - 1, (cy + 1) * chunk_height - 1));
+
+                if(!box_intersection(chunk_box, window).isEmpty())
+                {
+                    chunks.push_back(plane * chunks_x * chunks_y + cy * chunks_x + cx);
+                }
+            }
+        }
     }
 
-    return func(path, image);
-}
+    std::atomic<std::size_t> next_chunk(0);
+    std::atomic<bool> failed(false);
 
-bool Image::read_layer_pixels(const stdromano::StringD& path,
-                              const stdromano::StringD& layer_name,
-                              Layer& layer) noexcept
+    auto decode_chunks = [&](TIFF* worker_tif) {
+        void* scratch = nullptr;
+
+        std::size_t i;
+
+        while((i = next_chunk.fetch_add(1)) < chunks.size() && !failed.load())
+        {
+            const std::uint32_t chunk = chunks[i];
+            const std::uint32_t plane = chunk / (chunks_x * chunks_y);
+            const std::uint32_t cy = (chunk / chunks_x) % chunks_y;
+            const std::uint32_t cx = chunk % chunks_x;
+
+            const Imath::Box2i chunk_box(Imath::V2i(cx * chunk_width, cy * chunk_height),
+                                         Imath::V2i(std::min((cx + 1) * chunk_width, width) - 1,
+                                                    std::min((cy + 1) * chunk_height, height) - 1));
+
+            const Imath::Box2i isect = box_intersection(chunk_box, window);
+
+            char* dst = layer.data<char>() +
+                        (isect.min.y - window.min.y) * layer_stride +
+                        (isect.min.x - window.min.x) * pixel_size;
+
+            /* Full strips inside the window are decoded in place */
+            if(!tiled && !separate && isect == chunk_box && layer.width() == static_cast<std::int32_t>(width))
+            {
+                const tmsize_t strip_size = static_cast<tmsize_t>(chunk_box.max.y - chunk_box.min.y + 1) *
+                                            static_cast<tmsize_t>(layer_stride);
+
+                if(TIFFReadEncodedStrip(worker_tif, chunk, dst, strip_size) < 0 || CodecContext::get().has_error())
+                {
+                    failed.store(true);
+                }
+
+                continue;
+            }
+
+            if(scratch == nullptr)
+            {
+                scratch = stdromano::mem_aligned_alloc(static_cast<std::size_t>(chunk_size), 32);
+            }
+
+            const tmsize_t read = tiled ? TIFFReadEncodedTile(worker_tif, chunk, scratch, chunk_size) :
+                                          TIFFReadEncodedStrip(worker_tif, chunk, scratch, chunk_size);
+
+            /* Some codecs report corrupted data through the handlers and still return the chunk */
+            if(read < 0 || CodecContext::get().has_error())
+            {
+                failed.store(true);
+                continue;
+            }
+
+            const std::size_t isect_width = static_cast<std::size_t>(isect.max.x - isect.min.x + 1);
+
+            for(std::int32_t y = isect.min.y; y <= isect.max.y; y++)
+            {
+                const char* src = static_cast<const char*>(scratch) +
+                                  (y - chunk_box.min.y) * chunk_stride +
+                                  (isect.min.x - chunk_box.min.x) * chunk_pixel_size;
+
+                char* dst_row = dst + (y - isect.min.y) * layer_stride;
+
+                if(!separate)
+                {
+                    std::memcpy(dst_row, src, isect_width * pixel_size);
+                    continue;
+                }
+
+                /* Scatter the plane into its channel */
+                for(std::size_t x = 0; x < isect_width; x++)
+                {
+                    std::memcpy(dst_row + x * pixel_size + plane * sample_size,
+                                src + x * sample_size,
+                                sample_size);
+                }
+            }
+        }
+
+        if(scratch != nullptr)
+        {
+            stdromano::mem_aligned_free(scratch);
+        }
+    };
+
+    ThreadPool& pool = ThreadPool::get_global_threadpool();
+
+    const std::size_t num_workers = std::min(chunks.size(),
+                                             static_cast<std::size_t>(pool.num_threads() + 1));
+
+    pool.parallel_for(num_workers, [&](std::size_t worker) {
+        /* Workers run on other threads, their libtiff messages go to their own context */
+        CodecContextScope codec_scope(path);
+
+        if(worker == 0)
+        {
+            decode_chunks(tif);
+            return;
+        }
+
+        TIFF* worker_tif = tiff_open(path);
+
+        if(worker_tif == nullptr)
+        {
+            failed.store(true);
+            return;
+        }
+
+        decode_chunks(worker_tif);
+
+        TIFFClose(worker_tif);
+    });
+
+    return !failed.load();
+}
+
+/* Decodes the image to 8 bits RGBA through libtiff, for the photometric interpretations we don't handle */
+bool tiff_read_rgba(TIFF* tif, Layer& layer) noexcept
+{
+    std::uint32_t width, height;
+
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
+
+    /* Without stopping on errors libtiff fills what it can and succeeds, the handlers tell */
+    if(layer.is_full_window())
+    {
+        return TIFFReadRGBAImageOriented(tif,
+                                         width,
+                                         height,
+                                         layer.data<std::uint32_t>(),
+                                         ORIENTATION_TOPLEFT,
+                                         0) != 0 && !CodecContext::get().has_error();
+    }
+
+    std::uint32_t* raster = static_cast<std::uint32_t*>(
+        stdromano::mem_aligned_alloc(static_cast<std::size_t>(width) * height * sizeof(std::uint32_t), 32));
+
+    if(!TIFFReadRGBAImageOriented(tif, width, height, raster, ORIENTATION_TOPLEFT, 0) ||
+       CodecContext::get().has_error())
+    {
+        stdromano::mem_aligned_free(raster);
+        return false;
+    }
+
+    const Imath::Box2i& window = layer.window();
+
+    for(std::int32_t y = window.min.y; y <= window.max.y; y++)
+    {
+        std::memcpy(layer.data<std::uint32_t>() + static_cast<std::size_t>(y - window.min.y) * layer.width(),
+                    raster + static_cast<std::size_t>(y) * width + window.min.x,
+                    static_cast<std::size_t>(layer.width()) * sizeof(std::uint32_t));
+    }
+
+    stdromano::mem_aligned_free(raster);
+
+    return true;
+}
+
+/*
+ * Mapping of a tiff file, kept in the file handle cache. A TIFF handle keeps decoding state, so
+ * each read opens its own over the shared mapping
+ */
+class TIFFFileHandle : public FileHandle
+{
+public:
+    std::shared_ptr<MappedFile> mapping;
+};
+
+std::shared_ptr<FileHandle> tiff_open_file_handle(const stdromano::StringD& path) noexcept
+{
+    std::shared_ptr<TIFFFileHandle> handle = std::make_shared<TIFFFileHandle>();
+
+    handle->mapping = std::make_shared<MappedFile>(path, MappedFileHint_Random);
+
+    return handle->mapping->is_open() ? handle : nullptr;
+}
+
+bool layer_pixel_read_tiff(const stdromano::StringD& path,
+                           const stdromano::StringD& layer_name,
+                           Layer& layer) noexcept
+{
+    const std::shared_ptr<FileHandle> file_handle = FileHandleCache::get_instance().acquire(path,
+                                                                                           tiff_open_file_handle);
+
+    TIFF* tif = nullptr;
+
+    if(file_handle != nullptr)
+    {
+        MappedFileScope mapping_scope(path, static_cast<const TIFFFileHandle&>(*file_handle).mapping);
+
+        tif = tiff_open(path);
+    }
+
+    /* A damaged directory is only reported through the handlers */
+    if(tif != nullptr && CodecContext::get().has_error())
+    {
+        TIFFClose(tif);
+        tif = nullptr;
+    }
+
+    if(tif == nullptr)
+    {
+        stdromano::log_error("Error while loading layer \"{}\" from image: \"{}\"",
+                             layer_name,
+                             path);
+
+        return false;
+    }
+
+    layer.allocate(layer.nbytes());
+
+    const bool success = tiff_native_depth(tif) != LayerDepth_NONE ? tiff_read_native(path, tif, layer) :
+                                                                     tiff_read_rgba(tif, layer);
+
+    TIFFClose(tif);
+
+    if(!success)
+    {
+        stdromano::log_error("Error while loading layer \"{}\" from image: \"{}\"",
+                             layer_name,
+                             path);
+
+        return false;
+    }
+
+    return true;
+}
+
+/* EXR */
+
+/*
+ * OpenEXR input stream reading from memory (usually a mapped file). Being memory mapped, the
+ * decoder reads the chunks in place instead of copying them through an intermediate buffer
+ */
+class EXRMemoryIStream : public Imf::IStream
+{
+private:
+    const char* _data;
+    std::uint64_t _size;
+    std::uint64_t _position;
+
+public:
+    EXRMemoryIStream(const std::uint8_t* data,
+                     const std::size_t size,
+                     const char* name) : Imf::IStream(name),
+                                         _data(reinterpret_cast<const char*>(data)),
+                                         _size(static_cast<std::uint64_t>(size)),
+                                         _position(0) {}
+
+    EXRMemoryIStream(const MappedFile& file, const char* name) : EXRMemoryIStream(file.data(),
+                                                                                  file.size(),
+                                                                                  name) {}
+
+    bool isMemoryMapped() const override { return true; }
+
+    bool read(char c[], int n) override
+    {
+        if(this->_position + static_cast<std::uint64_t>(n) > this->_size)
+        {
+            throw Iex::InputExc("Unexpected end of file");
+        }
+
+        std::memcpy(c, this->_data + this->_position, static_cast<std::size_t>(n));
+        this->_position += static_cast<std::uint64_t>(n);
+
+        return this->_position < this->_size;
+    }
+
+    char* readMemoryMapped(int n) override
+    {
+        if(this->_position + static_cast<std::uint64_t>(n) > this->_size)
+        {
+            throw Iex::InputExc("Unexpected end of file");
+        }
+
+        const char* data = this->_data + this->_position;
+        this->_position += static_cast<std::uint64_t>(n);
+
+        return const_cast<char*>(data);
+    }
+
+    std::uint64_t tellg() override { return this->_position; }
+
+    void seekg(std::uint64_t position) override { this->_position = position; }
+
+    void clear() override {}
+};
+
+/*
+ * OpenEXR input stream reading a file at the positions of the stream, for the files that can be
+ * truncated while being read. The bytes of a range of the file can be given in place of the ones
+ * on disk, to supply the offset table of a file that is still being written
+ */
+class EXRFileIStream : public Imf::IStream
+{
+private:
+    const FileReader& _file;
+    std::uint64_t _size;
+    std::uint64_t _position;
+
+    const std::uint8_t* _overlay;
+    std::uint64_t _overlay_offset;
+    std::uint64_t _overlay_size;
+
+public:
+    EXRFileIStream(const FileReader& file,
+                   const std::uint64_t size,
+                   const char* name,
+                   const std::uint8_t* overlay = nullptr,
+                   const std::uint64_t overlay_offset = 0,
+                   const std::uint64_t overlay_size = 0) : Imf::IStream(name),
+                                                           _file(file),
+                                                           _size(size),
+                                                           _position(0),
+                                                           _overlay(overlay),
+                                                           _overlay_offset(overlay_offset),
+                                                           _overlay_size(overlay_size) {}
+
+    bool isMemoryMapped() const override { return false; }
+
+    bool read(char c[], int n) override
+    {
+        const std::uint64_t end = this->_position + static_cast<std::uint64_t>(n);
+
+        if(end > this->_size)
+        {
+            throw Iex::InputExc("Unexpected end of file");
+        }
+
+        const std::uint64_t overlay_end = this->_overlay_offset + this->_overlay_size;
+
+        while(this->_position < end)
+        {
+            std::uint64_t next;
+
+            if(this->_position >= this->_overlay_offset && this->_position < overlay_end)
+            {
+                next = std::min(end, overlay_end);
+
+                std::memcpy(c,
+                            this->_overlay + (this->_position - this->_overlay_offset),
+                            static_cast<std::size_t>(next - this->_position));
+            }
+            else
+            {
+                next = this->_position < this->_overlay_offset ? std::min(end, this->_overlay_offset) : end;
+
+                const std::size_t size = static_cast<std::size_t>(next - this->_position);
+
+                /* The file has been truncated since its size was queried */
+                if(this->_file.read(this->_position, c, size) != size)
+                {
+                    throw Iex::InputExc("Unexpected end of file");
+                }
+            }
+
+            c += next - this->_position;
+            this->_position = next;
+        }
+
+        return this->_position < this->_size;
+    }
+
+    std::uint64_t tellg() override { return this->_position; }
+
+    void seekg(std::uint64_t position) override { this->_position = position; }
+
+    void clear() override {}
+};
+
+/* Layer of an exr file, with the part holding it and the full names of its channels */
+struct EXRLayer
+{
+    std::int32_t part;
+    stdromano::Vector<stdromano::StringD> channels;
+};
+
+using EXRLayers = stdromano::HashMap<stdromano::StringD, EXRLayer>;
+
+/* R, G, B and A come first in this order, then the other channels in file order */
+std::uint32_t exr_channel_rank(const stdromano::StringD& channel) noexcept
+{
+    const char* name = std::strrchr(channel.c_str(), '.');
+    name = name != nullptr ? name + 1 : channel.c_str();
+
+    if(name[0] == '\0' || name[1] != '\0')
+    {
+        return 4;
+    }
+
+    switch(std::toupper(static_cast<unsigned char>(name[0])))
+    {
+        case 'R':
+            return 0;
+        case 'G':
+            return 1;
+        case 'B':
+            return 2;
+        case 'A':
+            return 3;
+        default:
+            return 4;
+    }
+}
+
+bool exr_is_deep(const Imf::Header& header) noexcept
+{
+    return header.hasType() && (header.type() == Imf::DEEPSCANLINE || header.type() == Imf::DEEPTILE);
+}
+
+/* Channels driving the compositing of the deep samples, they are not part of any layer */
+bool exr_is_deep_depth_channel(const char* name) noexcept
+{
+    return std::strcmp(name, "Z") == 0 || std::strcmp(name, "ZBack") == 0;
+}
+
+/*
+ * Maps the channels of the parts to layers. Channels named layer.channel belong to the layer,
+ * whatever part holds them. Channels without a layer form the main layer for the first part
+ * holding such channels, and a layer named after their part for the other parts
+ */
+EXRLayers exr_get_layers(const std::vector<const Imf::Header*>& headers) noexcept
+{
+    EXRLayers layers;
+
+    for(std::size_t part = 0; part < headers.size(); part++)
+    {
+        const Imf::Header& header = *headers[part];
+
+        const bool is_deep = exr_is_deep(header);
+
+        const Imf::ChannelList& channels = header.channels();
+
+        for(Imf::ChannelList::ConstIterator it = channels.begin(); it != channels.end(); ++it)
+        {
+            if(is_deep && exr_is_deep_depth_channel(it.name()))
+            {
+                continue;
+            }
+
+            const char* separator = std::strrchr(it.name(), '.');
+
+            stdromano::StringD layer_name;
+
+            if(separator != nullptr)
+            {
+                layer_name = stdromano::StringD(std::string(it.name(), separator).c_str());
+            }
+            else if(!layers.contains(Image::MAIN_LAYER_NAME) ||
+                    layers.find(Image::MAIN_LAYER_NAME)->second.part == static_cast<std::int32_t>(part))
+            {
+                layer_name = Image::MAIN_LAYER_NAME;
+            }
+            else if(header.hasName())
+            {
+                layer_name = stdromano::StringD(header.name().c_str());
+            }
+            else
+            {
+                layer_name = stdromano::StringD("part{}", part);
+            }
+
+            auto layer_it = layers.find(layer_name);
+
+            /* The same layer found in another part is named after its part */
+            if(layer_it != layers.end() && layer_it->second.part != static_cast<std::int32_t>(part))
+            {
+                layer_name = stdromano::StringD("{}.{}",
+                                                header.hasName() ? header.name().c_str() : "part",
+                                                layer_name);
+
+                layer_it = layers.find(layer_name);
+            }
+
+            if(layer_it == layers.end())
+            {
+                layer_it = layers.emplace(layer_name, EXRLayer{ static_cast<std::int32_t>(part), {} }).first;
+            }
+
+            layer_it->second.channels.push_back(stdromano::StringD(it.name()));
+        }
+    }
+
+    for(auto& [name, layer] : layers)
+    {
+        std::stable_sort(layer.channels.begin(),
+                         layer.channels.end(),
+                         [](const auto& lhs, const auto& rhs) -> bool {
+                             return exr_channel_rank(lhs) < exr_channel_rank(rhs);
+                         });
+    }
+
+    if(!layers.contains(Image::MAIN_LAYER_NAME))
+    {
+        stdromano::log_error("No default layer has been found in exr file");
+    }
+
+    return layers;
+}
+
+EXRLayers exr_get_layers(const Imf::MultiPartInputFile& file) noexcept
+{
+    std::vector<const Imf::Header*> headers;
+
+    for(int part = 0; part < file.parts(); part++)
+    {
+        headers.push_back(std::addressof(file.header(part)));
+    }
+
+    return exr_get_layers(headers);
+}
+
+/*
+ * Mapping of an exr file with its layers, kept in the file handle cache. The handle is never
+ * modified once opened, each read builds its own decoder over the mapping so reads of different
+ * layers of the file run concurrently
+ */
+class EXRFileHandle : public FileHandle
+{
+public:
+    MappedFile mapped_file;
+
+    EXRLayers layers;
+};
+
+std::shared_ptr<FileHandle> exr_open_file_handle(const stdromano::StringD& path) noexcept
+{
+    std::shared_ptr<EXRFileHandle> handle = std::make_shared<EXRFileHandle>();
+
+    if(!handle->mapped_file.open(path))
+    {
+        return nullptr;
+    }
+
+    try
+    {
+        EXRMemoryIStream stream(handle->mapped_file, path.c_str());
+        Imf::MultiPartInputFile file(stream);
+
+        handle->layers = exr_get_layers(file);
+    }
+    catch(const std::exception& e)
+    {
+        stdromano::log_error("Error while opening image \"{}\" ({})", path, e.what());
+        return nullptr;
+    }
+
+    return handle;
+}
+
+/* Size of a mip level, following the rounding mode of the file */
+std::int32_t exr_level_size(const std::int32_t size,
+                            const std::uint32_t level,
+                            const bool round_up) noexcept
+{
+    std::int32_t level_size = size >> level;
+
+    if(round_up && (level_size << level) < size)
+    {
+        level_size++;
+    }
+
+    return std::max(level_size, 1);
+}
+
+std::uint32_t exr_num_levels(std::int32_t size, const bool round_up) noexcept
+{
+    std::uint32_t num_levels = 1;
+
+    while(size > 1)
+    {
+        size = round_up ? (size + 1) / 2 : size / 2;
+        num_levels++;
+    }
+
+    return num_levels;
+}
+
+/* Ripmapped files are only read along their diagonal levels, like mipmapped files */
+void exr_fill_level_data_windows(const Imf::Header& header, Image& img) noexcept
+{
+    const Imf::TileDescription& tiles = header.tileDescription();
+    const bool round_up = tiles.roundingMode == Imf::ROUND_UP;
+
+    const std::int32_t width = img.get_data_width();
+    const std::int32_t height = img.get_data_height();
+
+    const std::uint32_t num_levels = tiles.mode == Imf::MIPMAP_LEVELS ?
+                                         exr_num_levels(std::max(width, height), round_up) :
+                                         exr_num_levels(std::min(width, height), round_up);
+
+    img.level_data_windows().clear();
+
+    for(std::uint32_t level = 0; level < num_levels; level++)
+    {
+        const Imath::V2i size(exr_level_size(width, level, round_up),
+                              exr_level_size(height, level, round_up));
+
+        img.level_data_windows().push_back(Imath::Box2i(img.data_window().min,
+                                                        img.data_window().min +
+                                                        size - Imath::V2i(1, 1)));
+    }
+}
+
+/* Data window of a mip level of a part, parts without levels only have the level 0 */
+Imath::Box2i exr_level_data_window(const Imf::Header& header, const std::uint32_t level) noexcept
+{
+    const Imath::Box2i& data_window = header.dataWindow();
+
+    if(level == 0 || !header.hasTileDescription() || header.tileDescription().mode == Imf::ONE_LEVEL)
+    {
+        return level == 0 ? data_window : Imath::Box2i();
+    }
+
+    const bool round_up = header.tileDescription().roundingMode == Imf::ROUND_UP;
+
+    const Imath::V2i size(exr_level_size(data_window.max.x - data_window.min.x + 1, level, round_up),
+                          exr_level_size(data_window.max.y - data_window.min.y + 1, level, round_up));
+
+    return Imath::Box2i(data_window.min, data_window.min + size - Imath::V2i(1, 1));
+}
+
+/*
+ * Reads the headers of all the parts, without the offset tables of the chunks which are not
+ * needed until the pixels are read
+ */
+bool exr_read_headers(Imf::IStream& stream, std::vector<Imf::Header>& headers)
+{
+    int magic, version;
+    Imf::Xdr::read<Imf::StreamIO>(stream, magic);
+    Imf::Xdr::read<Imf::StreamIO>(stream, version);
+
+    if(magic != Imf::MAGIC)
+    {
+        return false;
+    }
+
+    if(!Imf::isMultiPart(version))
+    {
+        headers.emplace_back();
+        headers.back().readFrom(stream, version);
+
+        return true;
+    }
+
+    /* The headers of a multi-part file are followed by an empty header (a single null byte) */
+    while(true)
+    {
+        char c;
+        stream.read(&c, 1);
+
+        if(c == '\0')
+        {
+            break;
+        }
+
+        stream.seekg(stream.tellg() - 1);
+
+        headers.emplace_back();
+        headers.back().readFrom(stream, version);
+    }
+
+    return !headers.empty();
+}
+
+bool image_probe_exr(const std::uint8_t* header, std::size_t size) noexcept
+{
+    return size >= 4 && header[0] == 0x76 && header[1] == 0x2F && header[2] == 0x31 && header[3] == 0x01;
+}
+
+/* Fills the windows and the (empty) layers of the image from the headers of the parts of the file */
+void exr_fill_image(const std::vector<Imf::Header>& headers, Image& img)
+{
+    std::vector<const Imf::Header*> header_ptrs;
+
+    for(const Imf::Header& header : headers)
+    {
+        header_ptrs.push_back(std::addressof(header));
+    }
+
+    EXRLayers layers = exr_get_layers(header_ptrs);
+
+    auto main_it = layers.find(Image::MAIN_LAYER_NAME);
+
+    const Imf::Header& main_header = headers[main_it != layers.end() ? main_it->second.part : 0];
+
+    /* Parts can have different data windows, the image covers all of them */
+    img.data_window() = main_header.dataWindow();
+
+    for(const Imf::Header& header : headers)
+    {
+        img.data_window().extendBy(header.dataWindow());
+    }
+
+    img.display_window() = main_header.displayWindow();
+    img.aspect_ratio() = main_header.pixelAspectRatio();
+
+    if(main_header.hasTileDescription() && main_header.tileDescription().mode != Imf::ONE_LEVEL)
+    {
+        exr_fill_level_data_windows(main_header, img);
+    }
+
+    for(const auto& [layer_name, exr_layer] : layers)
+    {
+        const Imf::ChannelList& channels = headers[exr_layer.part].channels();
+
+        const Imf::PixelType channel_type = channels.find(exr_layer.channels[0].c_str()).channel().type;
+
+        /* Deep layers are flattened in float */
+        const std::uint8_t depth = (channel_type == Imf::HALF && !exr_is_deep(headers[exr_layer.part])) ?
+                                       LayerDepth_F16 :
+                                       LayerDepth_F32;
+
+        Layer layer(std::addressof(img),
+                    depth,
+                    static_cast<std::uint8_t>(exr_layer.channels.size()));
+
+        img.get_layers().emplace(std::make_pair(layer_name.copy(), std::move(layer)));
+    }
+}
+
+bool image_read_metadata_exr(const stdromano::StringD& path,
+                             Image& img) noexcept
+{
+    MappedFile mapped_file(path);
+
+    if(!mapped_file.is_open())
+    {
+        return false;
+    }
+
+    try
+    {
+        EXRMemoryIStream stream(mapped_file, path.c_str());
+
+        std::vector<Imf::Header> headers;
+
+        if(!exr_read_headers(stream, headers))
+        {
+            stdromano::log_error("Image \"{}\" is not an exr file", path);
+            return false;
+        }
+
+        exr_fill_image(headers, img);
+
+        stdromano::log_debug("Loaded exr file {} (w: {}, h:{}, l:{}, p:{})",
+                             stdromano::fs_filename(path),
+                             img.get_data_width(),
+                             img.get_data_height(),
+                             img.get_layers().size(),
+                             headers.size());
+    }
+    catch(const std::exception& e)
+    {
+        stdromano::log_error("Error while loading image \"{}\": {}", path, e.what());
+        return false;
+    }
+
+    return true;
+}
+
+/* Number of scanlines stored in a single chunk of the file for the given compression */
+std::int32_t exr_lines_per_block(const Imf::Compression compression) noexcept
+{
+    switch(compression)
+    {
+        case Imf::NO_COMPRESSION:
+        case Imf::RLE_COMPRESSION:
+        case Imf::ZIPS_COMPRESSION:
+            return 1;
+        case Imf::ZIP_COMPRESSION:
+        case Imf::PXR24_COMPRESSION:
+            return 16;
+        case Imf::PIZ_COMPRESSION:
+        case Imf::B44_COMPRESSION:
+        case Imf::B44A_COMPRESSION:
+        case Imf::DWAA_COMPRESSION:
+            return 32;
+        case Imf::DWAB_COMPRESSION:
+            return 256;
+        default:
+            return 32;
+    }
+}
+
+/* Channel of the file read in a channel of a layer, or the value filling it if name is nullptr */
+struct EXRSliceChannel
+{
+    const char* name;
+    float fill;
+};
+
+/*
+ * Resolves the channels of a layer read with a shuffle mask. Like Layer::shuffle, R, G, B and A
+ * are the channels of the layer by position, missing ones being filled with 0 (1 for alpha)
+ */
+void exr_layer_slice_channels(const stdromano::Vector<stdromano::StringD>& layer_channels,
+                              const stdromano::StringD& mask,
+                              stdromano::Vector<EXRSliceChannel>& slice_channels) noexcept
+{
+    slice_channels.clear();
+
+    if(mask.empty())
+    {
+        for(const auto& channel : layer_channels)
+        {
+            slice_channels.push_back({ channel.c_str(), 0.0f });
+        }
+
+        return;
+    }
+
+    for(const auto& c : mask)
+    {
+        std::size_t position;
+
+        switch(std::toupper(static_cast<unsigned char>(c)))
+        {
+            case 'R':
+                position = 0;
+                break;
+            case 'G':
+                position = 1;
+                break;
+            case 'B':
+                position = 2;
+                break;
+            case 'A':
+                position = 3;
+                break;
+            default:
+                slice_channels.push_back({ nullptr, c == '1' ? 1.0f : 0.0f });
+                continue;
+        }
+
+        if(position < layer_channels.size())
+        {
+            slice_channels.push_back({ layer_channels[position].c_str(), 0.0f });
+        }
+        else
+        {
+            slice_channels.push_back({ nullptr, position == 3 ? 1.0f : 0.0f });
+        }
+    }
+}
+
+/*
+ * Inserts the slices of the channels of a layer in the frame buffer, data holding the pixels of
+ * the given window. OpenEXR converts the channels to the pixel type of the slices while decoding,
+ * and fills the slices of channels missing from the file with their fill value
+ */
+void exr_insert_layer_slices(Imf::FrameBuffer& frame_buffer,
+                             const stdromano::Vector<stdromano::StringD>& layer_channels,
+                             const stdromano::StringD& mask,
+                             const std::uint8_t depth,
+                             char* data,
+                             const Imath::Box2i& window,
+                             const bool tile_coords = false) noexcept
+{
+    stdromano::Vector<EXRSliceChannel> slice_channels;
+    exr_layer_slice_channels(layer_channels, mask, slice_channels);
+
+    const std::size_t channel_size = layer_depth_as_byte_size(depth);
+    const std::size_t x_stride = channel_size * slice_channels.size();
+    const std::size_t y_stride = x_stride * static_cast<std::size_t>(window.max.x - window.min.x + 1);
+
+    const Imf::PixelType pixel_type = depth == LayerDepth_F16 ? Imf::HALF : Imf::FLOAT;
+
+    /*
+     * OpenEXR addresses pixels with absolute coordinates, so offset the base by the window origin.
+     * With tile coordinates pixels are addressed relative to the origin of the tile being read
+     */
+    char* base = tile_coords ? data :
+                               data -
+                               static_cast<std::ptrdiff_t>(window.min.x) * static_cast<std::ptrdiff_t>(x_stride) -
+                               static_cast<std::ptrdiff_t>(window.min.y) * static_cast<std::ptrdiff_t>(y_stride);
+
+    std::size_t offset = 0;
+
+    for(std::size_t i = 0; i < slice_channels.size(); i++)
+    {
+        /* Filled slices need a name that is not in the file */
+        const stdromano::StringD name = slice_channels[i].name != nullptr ?
+                                            stdromano::StringD(slice_channels[i].name) :
+                                            stdromano::StringD("__fill{}", i);
+
+        frame_buffer.insert(name.c_str(),
+                            Imf::Slice(pixel_type,
+                                       base + offset,
+                                       x_stride,
+                                       y_stride,
+                                       1,
+                                       1,
+                                       static_cast<double>(slice_channels[i].fill),
+                                       tile_coords,
+                                       tile_coords));
+
+        offset += channel_size;
+    }
+}
+
+void exr_insert_layer_slices(Imf::FrameBuffer& frame_buffer,
+                             const stdromano::Vector<stdromano::StringD>& layer_channels,
+                             Layer& layer) noexcept
+{
+    exr_insert_layer_slices(frame_buffer,
+                            layer_channels,
+                            layer.mask(),
+                            layer.depth(),
+                            layer.data<char>(),
+                            layer.window());
+}
+
+/* Layer to fill during a read, along with the names of its channels in the file */
+struct EXRReadTarget
+{
+    const stdromano::Vector<stdromano::StringD>* channels;
+    Layer* layer;
+};
+
+/*
+ * Reads the tiles of the given level of a part intersecting the window in parallel on the library
+ * thread pool. Each worker opens its own file over the shared mapping, as a tiled part can only
+ * decode one tile at a time
+ */
+bool exr_read_tiles(const stdromano::StringD& path,
+                    MappedFile& mapped_file,
+                    const Imf::Header& header,
+                    const std::int32_t part,
+                    const stdromano::Vector<EXRReadTarget>& targets,
+                    const Imath::Box2i& window,
+                    const std::uint32_t level) noexcept
+{
+    const Imf::TileDescription& tiles = header.tileDescription();
+    const std::int32_t tile_width = static_cast<std::int32_t>(tiles.xSize);
+    const std::int32_t tile_height = static_cast<std::int32_t>(tiles.ySize);
+
+    const Imath::Box2i level_window = exr_level_data_window(header, level);
+
+    const std::int32_t first_tile_x = (window.min.x - level_window.min.x) / tile_width;
+    const std::int32_t first_tile_y = (window.min.y - level_window.min.y) / tile_height;
+    const std::int32_t num_tiles_x = (window.max.x - level_window.min.x) / tile_width - first_tile_x + 1;
+    const std::int32_t num_tiles_y = (window.max.y - level_window.min.y) / tile_height - first_tile_y + 1;
+    const std::size_t num_tiles = static_cast<std::size_t>(num_tiles_x) * num_tiles_y;
+
+    /* Keep a few tiles per worker so opening the file stays negligible */
+    constexpr std::size_t min_tiles_per_worker = 4;
+
+    ThreadPool& pool = ThreadPool::get_global_threadpool();
+
+    mapped_file.advise(MappedFileHint_Random);
+
+    const std::size_t num_workers = std::max(static_cast<std::size_t>(1),
+                                             std::min(static_cast<std::size_t>(pool.num_threads() + 1),
+                                                      num_tiles / min_tiles_per_worker));
+
+    std::atomic<std::size_t> next_tile(0);
+    std::atomic<bool> success(true);
+
+    pool.parallel_for(num_workers, [&](std::size_t) {
+        try
+        {
+            EXRMemoryIStream stream(mapped_file, path.c_str());
+            Imf::MultiPartInputFile file(stream);
+            Imf::TiledInputPart input(file, part);
+
+            const Imath::Box2i tile_box(Imath::V2i(0, 0), Imath::V2i(tile_width - 1, tile_height - 1));
+
+            Imf::FrameBuffer direct_frame_buffer;
+            Imf::FrameBuffer scratch_frame_buffer;
+
+            stdromano::Vector<stdromano::Vector<char>> scratches;
+            scratches.resize(targets.size());
+
+            for(std::size_t i = 0; i < targets.size(); i++)
+            {
+                Layer* layer = targets[i].layer;
+
+                exr_insert_layer_slices(direct_frame_buffer, *targets[i].channels, *layer);
+
+                scratches[i].resize(layer->pixel_size() * tile_width * tile_height);
+
+                exr_insert_layer_slices(scratch_frame_buffer,
+                                        *targets[i].channels,
+                                        layer->mask(),
+                                        layer->depth(),
+                                        scratches[i].data(),
+                                        tile_box,
+                                        true);
+            }
+
+            bool is_direct = true;
+            input.setFrameBuffer(direct_frame_buffer);
+
+            std::size_t tile;
+
+            while((tile = next_tile.fetch_add(1, std::memory_order_relaxed)) < num_tiles)
+            {
+                const std::int32_t tile_x = first_tile_x + static_cast<std::int32_t>(tile % num_tiles_x);
+                const std::int32_t tile_y = first_tile_y + static_cast<std::int32_t>(tile / num_tiles_x);
+
+                const Imath::Box2i tile_window = input.dataWindowForTile(tile_x, tile_y, level, level);
+
+                /* Tiles inside the window are decoded in place, the others through the scratch */
+                if(box_contains(window, tile_window))
+                {
+                    if(!is_direct)
+                    {
+                        input.setFrameBuffer(direct_frame_buffer);
+                        is_direct = true;
+                    }
+
+                    input.readTile(tile_x, tile_y, level, level);
+
+                    continue;
+                }
+
+                if(is_direct)
+                {
+                    input.setFrameBuffer(scratch_frame_buffer);
+                    is_direct = false;
+                }
+
+                input.readTile(tile_x, tile_y, level, level);
+
+                const Imath::Box2i copy_window = box_intersection(window, tile_window);
+
+                for(std::size_t i = 0; i < targets.size(); i++)
+                {
+                    Layer* layer = targets[i].layer;
+
+                    const Imath::Box2i& layer_window = layer->window();
+
+                    const std::size_t pixel_size = layer->pixel_size();
+                    const std::size_t copy_size = pixel_size * (copy_window.max.x - copy_window.min.x + 1);
+
+                    for(std::int32_t y = copy_window.min.y; y <= copy_window.max.y; y++)
+                    {
+                        std::memcpy(layer->data<char>() +
+                                        pixel_size * ((y - layer_window.min.y) * layer->width() +
+                                                      (copy_window.min.x - layer_window.min.x)),
+                                    scratches[i].data() +
+                                        pixel_size * ((y - tile_window.min.y) * tile_width +
+                                                      (copy_window.min.x - tile_window.min.x)),
+                                    copy_size);
+                    }
+                }
+            }
+        }
+        catch(const std::exception& e)
+        {
+            stdromano::log_error("Error while reading tiles from image: \"{}\" ({})", path, e.what());
+            success.store(false);
+        }
+    });
+
+    return success.load();
+}
+
+/* Deep */
+
+/*
+ * Deep samples of a block of pixels (scanlines or a tile). The samples of each channel are stored
+ * contiguously as floats, the samples of a pixel starting at its offset. OpenEXR writes the
+ * samples through an array of pointers per channel, pointing in the sample storage
+ */
+struct EXRDeepArena
+{
+    Imath::Box2i box;
+
+    stdromano::Vector<std::uint32_t> sample_counts;
+    stdromano::Vector<std::size_t> offsets;
+
+    stdromano::Vector<stdromano::Vector<float>> samples;
+    stdromano::Vector<float*> pointers;
+
+    LOV_FORCE_INLINE std::size_t width() const noexcept
+    {
+        return static_cast<std::size_t>(this->box.max.x - this->box.min.x + 1);
+    }
+
+    LOV_FORCE_INLINE std::size_t npixels() const noexcept
+    {
+        return this->width() * static_cast<std::size_t>(this->box.max.y - this->box.min.y + 1);
+    }
+
+    /* Offset of the pointers, for the slices to be indexed with the file coordinates */
+    LOV_FORCE_INLINE std::ptrdiff_t origin() const noexcept
+    {
+        return static_cast<std::ptrdiff_t>(this->box.min.y) * static_cast<std::ptrdiff_t>(this->width()) +
+               static_cast<std::ptrdiff_t>(this->box.min.x);
+    }
+};
+
+/* Layer flattened from the deep samples, with the indices of its channels in the arena */
+struct EXRDeepTarget
+{
+    Layer* layer;
+
+    /* -1 for the channels filled with a constant */
+    stdromano::Vector<std::int32_t> channels;
+    stdromano::Vector<float> fills;
+
+    /* Index of the alpha channel in the arena, -1 if the samples are opaque */
+    std::int32_t alpha;
+
+    /* Index of the sample weights of its alpha channel among the ones computed for each pixel */
+    std::uint32_t weights;
+};
+
+/* Prepares the arena and the frame buffer for a block, sample counts have to be read after */
+void exr_deep_arena_setup(EXRDeepArena& arena,
+                          Imf::DeepFrameBuffer& frame_buffer,
+                          const stdromano::Vector<stdromano::StringD>& channels,
+                          const Imath::Box2i& box) noexcept
+{
+    arena.box = box;
+
+    const std::size_t npixels = arena.npixels();
+    const std::size_t width = arena.width();
+
+    arena.sample_counts.resize(npixels);
+    arena.offsets.resize(npixels + 1);
+    arena.pointers.resize(npixels * channels.size());
+    arena.samples.resize(channels.size());
+
+    frame_buffer.insertSampleCountSlice(Imf::Slice(Imf::UINT,
+                                                   reinterpret_cast<char*>(arena.sample_counts.data() - arena.origin()),
+                                                   sizeof(std::uint32_t),
+                                                   sizeof(std::uint32_t) * width));
+
+    for(std::size_t c = 0; c < channels.size(); c++)
+    {
+        frame_buffer.insert(channels[c].c_str(),
+                            Imf::DeepSlice(Imf::FLOAT,
+                                           reinterpret_cast<char*>(arena.pointers.data() + c * npixels - arena.origin()),
+                                           sizeof(float*),
+                                           sizeof(float*) * width,
+                                           sizeof(float)));
+    }
+}
+
+/* Allocates the samples once their counts are known */
+void exr_deep_arena_allocate(EXRDeepArena& arena) noexcept
+{
+    const std::size_t npixels = arena.npixels();
+
+    arena.offsets[0] = 0;
+
+    for(std::size_t i = 0; i < npixels; i++)
+    {
+        arena.offsets[i + 1] = arena.offsets[i] + arena.sample_counts[i];
+    }
+
+    const std::size_t total_samples = arena.offsets[npixels];
+
+    for(std::size_t c = 0; c < arena.samples.size(); c++)
+    {
+        arena.samples[c].resize(std::max(total_samples, static_cast<std::size_t>(1)));
+
+        float* samples = arena.samples[c].data();
+        float** pointers = arena.pointers.data() + c * npixels;
+
+        for(std::size_t i = 0; i < npixels; i++)
+        {
+            pointers[i] = samples + arena.offsets[i];
+        }
+    }
+}
+
+/*
+ * Weights of the samples of a pixel in a front to back over composite, the transmittance in front
+ * of each sample, stored at the index of the sample. Samples hidden behind opaque ones get a null
+ * weight. Volumetric samples (with a ZBack) are treated as points at their front depth
+ */
+void exr_deep_pixel_weights(const float* alphas,
+                            const std::uint32_t* order,
+                            const std::uint32_t num_samples,
+                            float* __restrict weights) noexcept
+{
+    std::fill(weights, weights + num_samples, 0.0f);
+
+    float transmittance = 1.0f;
+
+    for(std::uint32_t s = 0; s < num_samples && transmittance > 0.0f; s++)
+    {
+        const std::uint32_t sample = order[s];
+
+        weights[sample] = transmittance;
+
+        transmittance *= alphas != nullptr ? 1.0f - std::clamp(alphas[sample], 0.0f, 1.0f) : 0.0f;
+    }
+}
+
+/* Sum of the samples of a channel scaled by their weights, four samples at a time */
+LOV_FORCE_INLINE float exr_deep_weighted_sum(const float* __restrict samples,
+                                             const float* __restrict weights,
+                                             const std::uint32_t num_samples) noexcept
+{
+    __m128 sum = _mm_setzero_ps();
+
+    std::uint32_t s = 0;
+
+    for(; (s + 4) <= num_samples; s += 4)
+    {
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(samples + s), _mm_loadu_ps(weights + s)));
+    }
+
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x55));
+
+    float result = _mm_cvtss_f32(sum);
+
+    for(; s < num_samples; s++)
+    {
+        result += samples[s] * weights[s];
+    }
+
+    return result;
+}
+
+/*
+ * Composites the samples of a pixel with the over operator, the samples being premultiplied. The
+ * samples of each channel are contiguous in the arena, so each channel is a weighted sum of them
+ */
+void exr_deep_flatten_pixel(const EXRDeepArena& arena,
+                            const std::size_t pixel,
+                            const std::uint32_t num_samples,
+                            const EXRDeepTarget& target,
+                            const float* __restrict weights,
+                            float* __restrict out) noexcept
+{
+    const std::size_t offset = arena.offsets[pixel];
+    const std::size_t nchannels = target.channels.size();
+
+    for(std::size_t c = 0; c < nchannels; c++)
+    {
+        out[c] = target.channels[c] >= 0 ?
+                     exr_deep_weighted_sum(arena.samples[target.channels[c]].data() + offset, weights, num_samples) :
+                     target.fills[c];
+    }
+}
+
+/*
+ * Flattens the rows of the arena inside the window in the layers. The weights of the samples are
+ * computed once per pixel for each alpha channel the targets are composited with
+ */
+void exr_deep_flatten(const EXRDeepArena& arena,
+                      const stdromano::Vector<EXRDeepTarget>& targets,
+                      const stdromano::Vector<std::int32_t>& alphas,
+                      const std::int32_t z_channel,
+                      const Imath::Box2i& window,
+                      stdromano::Vector<std::uint32_t>& order,
+                      stdromano::Vector<float>& weights) noexcept
+{
+    const Imath::Box2i flatten_window = box_intersection(window, arena.box);
+
+    if(flatten_window.isEmpty())
+    {
+        return;
+    }
+
+    const float* depths = z_channel >= 0 ? arena.samples[z_channel].data() : nullptr;
+
+    for(std::int32_t y = flatten_window.min.y; y <= flatten_window.max.y; y++)
+    {
+        for(std::int32_t x = flatten_window.min.x; x <= flatten_window.max.x; x++)
+        {
+            const std::size_t pixel = (y - arena.box.min.y) * arena.width() + (x - arena.box.min.x);
+            const std::size_t offset = arena.offsets[pixel];
+            const std::uint32_t num_samples = arena.sample_counts[pixel];
+
+            order.resize(num_samples);
+
+            for(std::uint32_t s = 0; s < num_samples; s++)
+            {
+                order[s] = s;
+            }
+
+            /* Samples are usually written sorted already, which insertion sort handles in one pass */
+            if(depths != nullptr)
+            {
+                const float* pixel_depths = depths + offset;
+
+                for(std::uint32_t s = 1; s < num_samples; s++)
+                {
+                    const std::uint32_t sample = order[s];
+                    std::uint32_t i = s;
+
+                    while(i > 0 && pixel_depths[order[i - 1]] > pixel_depths[sample])
+                    {
+                        order[i] = order[i - 1];
+                        i--;
+                    }
+
+                    order[i] = sample;
+                }
+            }
+
+            weights.resize(std::max(alphas.size() * num_samples, static_cast<std::size_t>(1)));
+
+            for(std::size_t a = 0; a < alphas.size(); a++)
+            {
+                exr_deep_pixel_weights(alphas[a] >= 0 ? arena.samples[alphas[a]].data() + offset : nullptr,
+                                       order.data(),
+                                       num_samples,
+                                       weights.data() + a * num_samples);
+            }
+
+            for(const EXRDeepTarget& target : targets)
+            {
+                Layer& layer = *target.layer;
+                const Imath::Box2i& layer_window = layer.window();
+
+                const std::size_t index = ((y - layer_window.min.y) * layer.width() + (x - layer_window.min.x)) *
+                                          layer.nchannels();
+
+                const float* target_weights = weights.data() + target.weights * num_samples;
+
+                if(layer.depth() == LayerDepth_F32)
+                {
+                    exr_deep_flatten_pixel(arena, pixel, num_samples, target, target_weights, layer.data<float>() + index);
+                    continue;
+                }
+
+                float values[256];
+                exr_deep_flatten_pixel(arena, pixel, num_samples, target, target_weights, values);
+
+                for(std::uint32_t c = 0; c < layer.nchannels(); c++)
+                {
+                    layer.data<half>()[index + c] = half(values[c]);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Reads the samples of a deep part block by block (bands of scanlines or tiles) and flattens them
+ * in float layers. Blocks are spread over the library thread pool, each worker decoding with its
+ * own file over the shared mapping and flattening in its own arena, so only a few blocks of
+ * samples live in memory at once
+ */
+bool exr_read_deep(const stdromano::StringD& path,
+                   MappedFile& mapped_file,
+                   const Imf::Header& header,
+                   const std::int32_t part,
+                   const stdromano::Vector<EXRReadTarget>& targets,
+                   const Imath::Box2i& window,
+                   const std::uint32_t level) noexcept
+{
+    const Imf::ChannelList& header_channels = header.channels();
+
+    /* Channels to decode: the ones of the layers, their alpha and the depth */
+    stdromano::Vector<stdromano::StringD> channels;
+
+    const auto channel_index = [&](const stdromano::StringD& name) -> std::int32_t {
+        for(std::size_t i = 0; i < channels.size(); i++)
+        {
+            if(std::strcmp(channels[i].c_str(), name.c_str()) == 0)
+            {
+                return static_cast<std::int32_t>(i);
+            }
+        }
+
+        if(header_channels.find(name.c_str()) == header_channels.end())
+        {
+            return -1;
+        }
+
+        channels.push_back(name.copy());
+
+        return static_cast<std::int32_t>(channels.size() - 1);
+    };
+
+    stdromano::Vector<EXRDeepTarget> deep_targets;
+
+    for(const EXRReadTarget& target : targets)
+    {
+        if(target.layer->depth() != LayerDepth_F32 && target.layer->depth() != LayerDepth_F16)
+        {
+            stdromano::log_error("Deep layers of image \"{}\" can only be flattened to float depths", path);
+            return false;
+        }
+
+        EXRDeepTarget deep_target;
+        deep_target.layer = target.layer;
+        deep_target.alpha = -1;
+
+        stdromano::Vector<EXRSliceChannel> slice_channels;
+        exr_layer_slice_channels(*target.channels, target.layer->mask(), slice_channels);
+
+        for(const EXRSliceChannel& slice_channel : slice_channels)
+        {
+            deep_target.channels.push_back(slice_channel.name != nullptr ?
+                                               channel_index(stdromano::StringD(slice_channel.name)) :
+                                               -1);
+            deep_target.fills.push_back(slice_channel.fill);
+        }
+
+        for(const stdromano::StringD& channel : *target.channels)
+        {
+            if(exr_channel_rank(channel) == 3)
+            {
+                deep_target.alpha = channel_index(channel);
+            }
+        }
+
+        /* Layers without alpha are composited with the alpha of the samples */
+        if(deep_target.alpha < 0)
+        {
+            deep_target.alpha = channel_index("A");
+        }
+
+        deep_targets.push_back(std::move(deep_target));
+    }
+
+    /* Alpha channels the targets are composited with, the sample weights being shared by their targets */
+    stdromano::Vector<std::int32_t> alphas;
+
+    for(EXRDeepTarget& deep_target : deep_targets)
+    {
+        std::size_t a = 0;
+
+        while(a < alphas.size() && alphas[a] != deep_target.alpha)
+        {
+            a++;
+        }
+
+        if(a == alphas.size())
+        {
+            alphas.push_back(deep_target.alpha);
+        }
+
+        deep_target.weights = static_cast<std::uint32_t>(a);
+    }
+
+    const std::int32_t z_channel = channel_index("Z");
+
+    const bool is_tiled = header.hasTileDescription();
+
+    /* Blocks intersecting the window */
+    stdromano::Vector<Imath::Box2i> blocks;
+    stdromano::Vector<Imath::V2i> tiles;
+
+    const Imath::Box2i level_window = exr_level_data_window(header, level);
+
+    if(is_tiled)
+    {
+        const Imf::TileDescription& tile_description = header.tileDescription();
+        const std::int32_t tile_width = static_cast<std::int32_t>(tile_description.xSize);
+        const std::int32_t tile_height = static_cast<std::int32_t>(tile_description.ySize);
+
+        for(std::int32_t tile_y = (window.min.y - level_window.min.y) / tile_height;
+            tile_y <= (window.max.y - level_window.min.y) / tile_height;
+            tile_y++)
+        {
+            for(std::int32_t tile_x = (window.min.x - level_window.min.x) / tile_width;
+                tile_x <= (window.max.x - level_window.min.x) / tile_width;
+                tile_x++)
+            {
+                const Imath::V2i tile_min(level_window.min.x + tile_x * tile_width,
+                                          level_window.min.y + tile_y * tile_height);
+
+                const Imath::V2i tile_max(std::min(tile_min.x + tile_width - 1, level_window.max.x),
+                                          std::min(tile_min.y + tile_height - 1, level_window.max.y));
+
+                blocks.push_back(Imath::Box2i(tile_min, tile_max));
+                tiles.push_back(Imath::V2i(tile_x, tile_y));
+            }
+        }
+    }
+    else
+    {
+        /*
+         * Deep scanline chunks hold 1 or 16 scanlines, keep bands of at least 16. Bands are aligned
+         * on the chunks of the file, a chunk shared by two bands would be decompressed by both
+         */
+        const std::int32_t lines_per_block = exr_lines_per_block(header.compression());
+        const std::int32_t band_height = ((16 + lines_per_block - 1) / lines_per_block) * lines_per_block;
+
+        const std::int32_t first_band = level_window.min.y +
+                                        ((window.min.y - level_window.min.y) / band_height) * band_height;
+
+        for(std::int32_t y = first_band; y <= window.max.y; y += band_height)
+        {
+            blocks.push_back(Imath::Box2i(Imath::V2i(level_window.min.x, std::max(y, window.min.y)),
+                                          Imath::V2i(level_window.max.x,
+                                                     std::min(y + band_height - 1, window.max.y))));
+        }
+    }
+
+    ThreadPool& pool = ThreadPool::get_global_threadpool();
+
+    const std::size_t num_workers = std::min(static_cast<std::size_t>(pool.num_threads() + 1),
+                                             blocks.size());
+
+    std::atomic<std::size_t> next_block(0);
+    std::atomic<bool> success(true);
+
+    pool.parallel_for(num_workers, [&](std::size_t) {
+        try
+        {
+            EXRMemoryIStream stream(mapped_file, path.c_str());
+            Imf::MultiPartInputFile file(stream);
+
+            std::unique_ptr<Imf::DeepScanLineInputPart> scanline_input;
+            std::unique_ptr<Imf::DeepTiledInputPart> tiled_input;
+
+            if(is_tiled)
+            {
+                tiled_input = std::make_unique<Imf::DeepTiledInputPart>(file, part);
+            }
+            else
+            {
+                scanline_input = std::make_unique<Imf::DeepScanLineInputPart>(file, part);
+            }
+
+            EXRDeepArena arena;
+            stdromano::Vector<std::uint32_t> order;
+            stdromano::Vector<float> weights;
+
+            std::size_t block;
+
+            while((block = next_block.fetch_add(1, std::memory_order_relaxed)) < blocks.size())
+            {
+                Imf::DeepFrameBuffer frame_buffer;
+
+                exr_deep_arena_setup(arena, frame_buffer, channels, blocks[block]);
+
+                if(is_tiled)
+                {
+                    tiled_input->setFrameBuffer(frame_buffer);
+                    tiled_input->readPixelSampleCount(tiles[block].x, tiles[block].y, level, level);
+
+                    exr_deep_arena_allocate(arena);
+
+                    tiled_input->readTile(tiles[block].x, tiles[block].y, level, level);
+                }
+                else
+                {
+                    scanline_input->setFrameBuffer(frame_buffer);
+                    scanline_input->readPixelSampleCounts(blocks[block].min.y, blocks[block].max.y);
+
+                    exr_deep_arena_allocate(arena);
+
+                    scanline_input->readPixels(blocks[block].min.y, blocks[block].max.y);
+                }
+
+                exr_deep_flatten(arena, deep_targets, alphas, z_channel, window, order, weights);
+            }
+        }
+        catch(const std::exception& e)
+        {
+            stdromano::log_error("Error while reading deep samples from image: \"{}\" ({})", path, e.what());
+            success.store(false);
+        }
+    });
+
+    return success.load();
+}
+
+/*
+ * Reads layers held by the same part, sharing the same window and level. Only the chunks of the
+ * part intersecting the window are decoded, the other parts of the file are not touched.
+ * Throws on decoding errors
+ */
+bool exr_read_part(const stdromano::StringD& path,
+                   MappedFile& mapped_file,
+                   Imf::MultiPartInputFile& file,
+                   const std::int32_t part,
+                   const stdromano::Vector<EXRReadTarget>& targets)
+{
+    const Layer& first_layer = *targets[0].layer;
+    const Imath::Box2i& window = first_layer.window();
+    const std::uint32_t level = first_layer.level();
+
+    const Imf::Header& header = file.header(part);
+
+    const Imath::Box2i part_window = exr_level_data_window(header, level);
+
+    if(part_window.isEmpty())
+    {
+        stdromano::log_error("Part {} of image \"{}\" has no mip level {}", part, path, level);
+        return false;
+    }
+
+    const Imath::Box2i read_window = box_intersection(window, part_window);
+
+    /* Parts can be smaller than the image, the pixels they don't cover are black */
+    if(read_window != window)
+    {
+        for(const EXRReadTarget& target : targets)
+        {
+            std::memset(target.layer->data<void>(), 0, target.layer->nbytes());
+        }
+    }
+
+    if(read_window.isEmpty())
+    {
+        return true;
+    }
+
+    if(exr_is_deep(header))
+    {
+        return exr_read_deep(path, mapped_file, header, part, targets, read_window, level);
+    }
+
+    if(header.hasTileDescription())
+    {
+        return exr_read_tiles(path, mapped_file, header, part, targets, read_window, level);
+    }
+
+    Imf::InputPart input(file, part);
+
+    if(window.min.x <= part_window.min.x && window.max.x >= part_window.max.x)
+    {
+        /* Full width rows, only the scanline blocks intersecting the window are decoded */
+        Imf::FrameBuffer frame_buffer;
+
+        for(const EXRReadTarget& target : targets)
+        {
+            exr_insert_layer_slices(frame_buffer, *target.channels, *target.layer);
+        }
+
+        input.setFrameBuffer(frame_buffer);
+        input.readPixels(read_window.min.y, read_window.max.y);
+
+        return true;
+    }
+
+    /*
+     * OpenEXR always writes full scanlines, so decode one block of scanlines at a time in a
+     * scratch buffer and copy the columns of the window in the layers
+     */
+    const std::int32_t lines_per_block = exr_lines_per_block(header.compression());
+    const std::int32_t part_width = part_window.max.x - part_window.min.x + 1;
+
+    stdromano::Vector<stdromano::Vector<char>> scratches;
+    scratches.resize(targets.size());
+
+    for(std::size_t i = 0; i < targets.size(); i++)
+    {
+        scratches[i].resize(targets[i].layer->pixel_size() * part_width * lines_per_block);
+    }
+
+    std::int32_t block_start = part_window.min.y +
+                               ((read_window.min.y - part_window.min.y) / lines_per_block) *
+                               lines_per_block;
+
+    for(; block_start <= read_window.max.y; block_start += lines_per_block)
+    {
+        const std::int32_t block_end = std::min(block_start + lines_per_block - 1,
+                                                part_window.max.y);
+
+        const Imath::Box2i block_window(Imath::V2i(part_window.min.x, block_start),
+                                        Imath::V2i(part_window.max.x, block_end));
+
+        Imf::FrameBuffer frame_buffer;
+
+        for(std::size_t i = 0; i < targets.size(); i++)
+        {
+            exr_insert_layer_slices(frame_buffer,
+                                    *targets[i].channels,
+                                    targets[i].layer->mask(),
+                                    targets[i].layer->depth(),
+                                    scratches[i].data(),
+                                    block_window);
+        }
+
+        const std::int32_t read_start = std::max(block_start, read_window.min.y);
+        const std::int32_t read_end = std::min(block_end, read_window.max.y);
+
+        input.setFrameBuffer(frame_buffer);
+        input.readPixels(read_start, read_end);
+
+        for(std::size_t i = 0; i < targets.size(); i++)
+        {
+            Layer& layer = *targets[i].layer;
+
+            const std::size_t pixel_size = layer.pixel_size();
+            const std::size_t scratch_stride = pixel_size * part_width;
+            const std::size_t window_stride = pixel_size * layer.width();
+            const std::size_t copy_size = pixel_size * (read_window.max.x - read_window.min.x + 1);
+            const std::size_t scratch_offset = pixel_size * (read_window.min.x - part_window.min.x);
+            const std::size_t window_offset = pixel_size * (read_window.min.x - window.min.x);
+
+            for(std::int32_t y = read_start; y <= read_end; y++)
+            {
+                std::memcpy(layer.data<char>() + (y - window.min.y) * window_stride + window_offset,
+                            scratches[i].data() + (y - block_start) * scratch_stride + scratch_offset,
+                            copy_size);
+            }
+        }
+    }
+
+    return true;
+}
+
+bool layer_pixel_read_exr(const stdromano::StringD& path,
+                          const stdromano::StringD& layer_name,
+                          Layer& layer) noexcept
+{
+    const std::shared_ptr<FileHandle> file_handle = FileHandleCache::get_instance().acquire(path,
+                                                                                           exr_open_file_handle);
+
+    if(file_handle == nullptr)
+    {
+        return false;
+    }
+
+    EXRFileHandle& handle = static_cast<EXRFileHandle&>(*file_handle);
+
+    auto layer_it = handle.layers.find(layer_name);
+
+    if(layer_it == handle.layers.end())
+    {
+        return false;
+    }
+
+    try
+    {
+        EXRMemoryIStream stream(handle.mapped_file, path.c_str());
+        Imf::MultiPartInputFile file(stream);
+
+        layer.allocate(layer.nbytes());
+
+        stdromano::Vector<EXRReadTarget> targets;
+        targets.push_back({ std::addressof(layer_it->second.channels), std::addressof(layer) });
+
+        return exr_read_part(path, handle.mapped_file, file, layer_it->second.part, targets);
+    }
+    catch(const std::exception& e)
+    {
+        stdromano::log_error("Error while loading layer \"{}\" from image: \"{}\" ({})",
+                             layer_name,
+                             path,
+                             e.what());
+
+        return false;
+    }
+}
+
+/*
+ * Reads all the given layers in a single pass over each part holding them: one frame buffer holds
+ * the slices of every requested layer of a part, so each chunk is read and decompressed only
+ * once. Independent parts are decoded in parallel
+ */
+bool layers_pixels_read_exr(const stdromano::StringD& path,
+                            const stdromano::Vector<stdromano::StringD>& layer_names,
+                            Image& img) noexcept
+{
+    const std::shared_ptr<FileHandle> file_handle = FileHandleCache::get_instance().acquire(path,
+                                                                                           exr_open_file_handle);
+
+    if(file_handle == nullptr)
+    {
+        return false;
+    }
+
+    EXRFileHandle& handle = static_cast<EXRFileHandle&>(*file_handle);
+
+    MappedFile& mapped_file = handle.mapped_file;
+    const EXRLayers& layers = handle.layers;
+
+    try
+    {
+        EXRMemoryIStream stream(mapped_file, path.c_str());
+        Imf::MultiPartInputFile file(stream);
+
+        std::vector<stdromano::Vector<EXRReadTarget>> part_targets(static_cast<std::size_t>(file.parts()));
+
+        for(const auto& layer_name : layer_names)
+        {
+            auto layer_it = layers.find(layer_name);
+
+            if(layer_it == layers.end())
+            {
+                stdromano::log_error("Cannot find layer \"{}\" in image: \"{}\"",
+                                     layer_name,
+                                     path);
+                return false;
+            }
+
+            Layer& layer = img.get_layers().find(layer_name)->second;
+
+            layer.allocate(layer.nbytes());
+
+            part_targets[layer_it->second.part].push_back({ std::addressof(layer_it->second.channels),
+                                                            std::addressof(layer) });
+        }
+
+        stdromano::Vector<std::int32_t> parts;
+
+        for(std::size_t part = 0; part < part_targets.size(); part++)
+        {
+            if(!part_targets[part].empty())
+            {
+                parts.push_back(static_cast<std::int32_t>(part));
+            }
+        }
+
+        if(parts.size() == 1)
+        {
+            return exr_read_part(path, mapped_file, file, parts[0], part_targets[parts[0]]);
+        }
+
+        std::atomic<bool> success(true);
+
+        /* A file can only decode one chunk at a time, each part gets its own */
+        ThreadPool::get_global_threadpool().parallel_for(parts.size(), [&](std::size_t i) {
+            try
+            {
+                EXRMemoryIStream part_stream(mapped_file, path.c_str());
+                Imf::MultiPartInputFile part_file(part_stream);
+
+                if(!exr_read_part(path, mapped_file, part_file, parts[i], part_targets[parts[i]]))
+                {
+                    success.store(false);
+                }
+            }
+            catch(const std::exception& e)
+            {
+                stdromano::log_error("Error while loading part {} from image: \"{}\" ({})",
+                                     parts[i],
+                                     path,
+                                     e.what());
+
+                success.store(false);
+            }
+        });
+
+        return success.load();
+    }
+    catch(const std::exception& e)
+    {
+        stdromano::log_error("Error while loading {} layers from image: \"{}\" ({})",
+                             layer_names.size(),
+                             path,
+                             e.what());
+
+        return false;
+    }
+}
+
+/* Progressive */
+
+std::int32_t exr_read_le_int32(const std::uint8_t* data) noexcept
+{
+    return static_cast<std::int32_t>(static_cast<std::uint32_t>(data[0]) |
+                                     static_cast<std::uint32_t>(data[1]) << 8 |
+                                     static_cast<std::uint32_t>(data[2]) << 16 |
+                                     static_cast<std::uint32_t>(data[3]) << 24);
+}
+
+ProgressiveReader::ProgressiveReader() : _lines_per_block(1),
+                                         _tiled(false),
+                                         _level_mode(Imf::ONE_LEVEL),
+                                         _tile_width(0),
+                                         _tile_height(0),
+                                         _num_levels_x(0),
+                                         _num_levels_y(0),
+                                         _num_read_chunks(0),
+                                         _num_failed_chunks(0),
+                                         _table_offset(0),
+                                         _file_identity(0),
+                                         _scan_offset(0),
+                                         _file_size(0),
+                                         _file_mtime(0)
+{
+}
+
+std::int64_t ProgressiveReader::tile_chunk_index(std::int32_t dx,
+                                                 std::int32_t dy,
+                                                 std::int32_t lx,
+                                                 std::int32_t ly) const noexcept
+{
+    if(lx < 0 ||
+       ly < 0 ||
+       static_cast<std::uint32_t>(lx) >= this->_num_levels_x ||
+       static_cast<std::uint32_t>(ly) >= this->_num_levels_y)
+    {
+        return -1;
+    }
+
+    std::size_t level;
+
+    switch(this->_level_mode)
+    {
+        case Imf::ONE_LEVEL:
+            level = 0;
+            break;
+        case Imf::MIPMAP_LEVELS:
+            if(lx != ly)
+            {
+                return -1;
+            }
+
+            level = static_cast<std::size_t>(lx);
+            break;
+        default:
+            level = static_cast<std::size_t>(ly) * this->_num_levels_x + static_cast<std::size_t>(lx);
+            break;
+    }
+
+    if(dx < 0 ||
+       dy < 0 ||
+       dx >= this->_level_num_tiles_x[level] ||
+       dy >= this->_level_num_tiles_y[level])
+    {
+        return -1;
+    }
+
+    return static_cast<std::int64_t>(this->_level_first_chunk[level]) +
+           static_cast<std::int64_t>(dy) * this->_level_num_tiles_x[level] +
+           dx;
+}
+
+void ProgressiveReader::reset_chunks() noexcept
+{
+    std::memset(this->_read_chunks.data(), 0, this->_read_chunks.size());
+    std::memset(this->_chunk_offsets.data(), 0, this->_chunk_offsets.size() * sizeof(std::uint64_t));
+
+    this->_num_read_chunks = 0;
+    this->_num_failed_chunks = 0;
+    this->_scan_offset = this->_table_offset + this->_chunk_offsets.size() * sizeof(std::uint64_t);
+
+    if(this->_image == nullptr)
+    {
+        return;
+    }
+
+    /* The pixels of the previous write must not show through the chunks not written yet */
+    for(const auto& name : this->_layer_names)
+    {
+        Layer& layer = this->_image->get_layers().find(name)->second;
+
+        std::memset(layer.data<void>(), 0, layer.nbytes());
+    }
+}
+
+bool ProgressiveReader::is_rewritten(const FileReader& file, std::uint64_t file_size, bool& header_changed) noexcept
+{
+    header_changed = false;
+
+    /* Truncated, or replaced by another file (renderers writing to a temporary file renamed after) */
+    if(file_size < this->_file_size || file.identity() != this->_file_identity)
+    {
+        header_changed = true;
+        return true;
+    }
+
+    stdromano::Vector<std::uint8_t> bytes;
+    bytes.resize(this->_header.size() + this->_offset_table.size());
+
+    if(file.read(0, bytes.data(), bytes.size()) != bytes.size())
+    {
+        header_changed = true;
+        return true;
+    }
+
+    if(std::memcmp(bytes.data(), this->_header.data(), this->_header.size()) != 0)
+    {
+        header_changed = true;
+        return true;
+    }
+
+    const std::uint8_t* offset_table = bytes.data() + this->_header.size();
+
+    if(std::memcmp(offset_table, this->_offset_table.data(), this->_offset_table.size()) == 0)
+    {
+        return false;
+    }
+
+    /*
+     * The table is written with zeros until the file is closed, filling entries means the write is
+     * finishing. A filled entry changing is a new write with the same header
+     */
+    bool rewritten = false;
+
+    for(std::size_t i = 0; i < this->_offset_table.size(); i += sizeof(std::uint64_t))
+    {
+        std::uint64_t previous_entry;
+        std::uint64_t entry;
+
+        std::memcpy(&previous_entry, this->_offset_table.data() + i, sizeof(std::uint64_t));
+        std::memcpy(&entry, offset_table + i, sizeof(std::uint64_t));
+
+        rewritten |= previous_entry != 0 && entry != previous_entry;
+    }
+
+    std::memcpy(this->_offset_table.data(), offset_table, this->_offset_table.size());
+
+    return rewritten;
+}
+
+bool ProgressiveReader::open(const stdromano::StringD& path,
+                             const stdromano::Vector<stdromano::StringD>& layer_names) noexcept
+{
+    this->close();
+
+    FileReader file;
+
+    if(!file.open(path))
+    {
+        return false;
+    }
+
+    try
+    {
+        EXRFileIStream stream(file, file.size(), path.c_str());
+
+        std::vector<Imf::Header> headers;
+
+        if(!exr_read_headers(stream, headers))
+        {
+            stdromano::log_error("Image \"{}\" is not an exr file", path);
+            return false;
+        }
+
+        if(headers.size() != 1 || exr_is_deep(headers[0]))
+        {
+            stdromano::log_error("Cannot read image \"{}\" progressively, only single part files "
+                                 "without deep data are supported",
+                                 path);
+            return false;
+        }
+
+        const Imf::Header& header = headers[0];
+
+        /* The offset table follows the header */
+        const std::uint64_t table_offset = stream.tellg();
+
+        const Imath::Box2i data_window = header.dataWindow();
+        const std::int32_t width = data_window.max.x - data_window.min.x + 1;
+        const std::int32_t height = data_window.max.y - data_window.min.y + 1;
+
+        std::uint64_t num_chunks = 0;
+
+        this->_data_window = data_window;
+        this->_tiled = header.hasTileDescription();
+
+        if(this->_tiled)
+        {
+            const Imf::TileDescription& tiles = header.tileDescription();
+            const bool round_up = tiles.roundingMode == Imf::ROUND_UP;
+
+            this->_level_mode = static_cast<std::uint8_t>(tiles.mode);
+            this->_tile_width = static_cast<std::int32_t>(tiles.xSize);
+            this->_tile_height = static_cast<std::int32_t>(tiles.ySize);
+
+            switch(tiles.mode)
+            {
+                case Imf::ONE_LEVEL:
+                    this->_num_levels_x = 1;
+                    this->_num_levels_y = 1;
+                    break;
+                case Imf::MIPMAP_LEVELS:
+                    this->_num_levels_x = exr_num_levels(std::max(width, height), round_up);
+                    this->_num_levels_y = this->_num_levels_x;
+                    break;
+                default:
+                    this->_num_levels_x = exr_num_levels(width, round_up);
+                    this->_num_levels_y = exr_num_levels(height, round_up);
+                    break;
+            }
+
+            for(std::uint32_t ly = 0; ly < this->_num_levels_y; ly++)
+            {
+                for(std::uint32_t lx = 0; lx < this->_num_levels_x; lx++)
+                {
+                    if(tiles.mode == Imf::MIPMAP_LEVELS && lx != ly)
+                    {
+                        continue;
+                    }
+
+                    const std::int32_t level_width = exr_level_size(width, lx, round_up);
+                    const std::int32_t level_height = exr_level_size(height, ly, round_up);
+
+                    const std::int32_t num_tiles_x = (level_width + this->_tile_width - 1) / this->_tile_width;
+                    const std::int32_t num_tiles_y = (level_height + this->_tile_height - 1) / this->_tile_height;
+
+                    this->_level_first_chunk.push_back(num_chunks);
+                    this->_level_num_tiles_x.push_back(num_tiles_x);
+                    this->_level_num_tiles_y.push_back(num_tiles_y);
+
+                    num_chunks += static_cast<std::uint64_t>(num_tiles_x) * num_tiles_y;
+                }
+            }
+        }
+        else
+        {
+            this->_lines_per_block = exr_lines_per_block(header.compression());
+
+            num_chunks = static_cast<std::uint64_t>((height + this->_lines_per_block - 1) / this->_lines_per_block);
+        }
+
+        this->_read_chunks.resize(static_cast<std::size_t>(num_chunks));
+        this->_chunk_offsets.resize(static_cast<std::size_t>(num_chunks));
+        this->_table_offset = table_offset;
+        this->reset_chunks();
+
+        this->_header.resize(static_cast<std::size_t>(table_offset));
+        this->_offset_table.resize(static_cast<std::size_t>(num_chunks) * sizeof(std::uint64_t));
+
+        /* The table may not be written yet, it then reads as zeros like a table not filled */
+        std::memset(this->_offset_table.data(), 0, this->_offset_table.size());
+
+        if(file.read(0, this->_header.data(), this->_header.size()) != this->_header.size())
+        {
+            this->close();
+            return false;
+        }
+
+        file.read(table_offset, this->_offset_table.data(), this->_offset_table.size());
+
+        this->_file_identity = file.identity();
+
+        /* Built from the header already read, mapping the file being written could fault */
+        std::shared_ptr<Image> image = std::make_shared<Image>();
+        image->_path = path.copy();
+        image->_format = "exr";
+
+        exr_fill_image(headers, *image);
+
+        if(!image->is_valid())
+        {
+            this->close();
+            return false;
+        }
+
+        std::vector<const Imf::Header*> header_ptrs = { std::addressof(header) };
+
+        const EXRLayers layers = exr_get_layers(header_ptrs);
+
+        for(const auto& [layer_name, exr_layer] : layers)
+        {
+            bool selected = layer_names.empty();
+
+            for(const auto& name : layer_names)
+            {
+                selected |= name == layer_name;
+            }
+
+            if(!selected)
+            {
+                continue;
+            }
+
+            Layer& layer = image->get_layers().find(layer_name)->second;
+
+            layer.allocate(layer.nbytes());
+            std::memset(layer.data<void>(), 0, layer.nbytes());
+
+            stdromano::Vector<stdromano::StringD> channels;
+
+            for(const auto& channel : exr_layer.channels)
+            {
+                channels.push_back(channel.copy());
+            }
+
+            this->_layer_names.push_back(layer_name.copy());
+            this->_layer_channels.push_back(std::move(channels));
+        }
+
+        if(this->_layer_names.empty())
+        {
+            stdromano::log_error("None of the requested layers is in image \"{}\"", path);
+            this->close();
+            return false;
+        }
+
+        this->_path = path.copy();
+        this->_image = std::move(image);
+    }
+    catch(const std::exception& e)
+    {
+        stdromano::log_error("Error while opening image \"{}\" for progressive reading: {}", path, e.what());
+        this->close();
+        return false;
+    }
+
+    return true;
+}
+
+void ProgressiveReader::close() noexcept
+{
+    this->_path = stdromano::StringD();
+    this->_image.reset();
+    this->_layer_names.clear();
+    this->_layer_channels.clear();
+    this->_level_first_chunk.clear();
+    this->_level_num_tiles_x.clear();
+    this->_level_num_tiles_y.clear();
+    this->_read_chunks.clear();
+    this->_num_read_chunks = 0;
+    this->_chunk_offsets.clear();
+    this->_num_failed_chunks = 0;
+    this->_table_offset = 0;
+    this->_header.clear();
+    this->_offset_table.clear();
+    this->_file_identity = 0;
+    this->_scan_offset = 0;
+    this->_file_size = 0;
+    this->_file_mtime = 0;
+}
+
+std::size_t ProgressiveReader::poll() noexcept
+{
+    if(!this->is_open())
+    {
+        return 0;
+    }
+
+    std::error_code ec;
+    const std::uint64_t file_size = static_cast<std::uint64_t>(std::filesystem::file_size(this->_path.c_str(), ec));
+
+    if(ec)
+    {
+        return 0;
+    }
+
+    const std::filesystem::file_time_type mtime = std::filesystem::last_write_time(this->_path.c_str(), ec);
+    const std::int64_t file_mtime = ec ? 0 : static_cast<std::int64_t>(mtime.time_since_epoch().count());
+
+    /* Nothing has been written since the last poll, and no chunk is left to retry */
+    if(file_size == this->_file_size && file_mtime == this->_file_mtime && this->_num_failed_chunks == 0)
+    {
+        return 0;
+    }
+
+    /* The file is read at positions, a mapping would fault if it was truncated meanwhile */
+    FileReader file;
+
+    if(!file.open(this->_path))
+    {
+        return 0;
+    }
+
+    bool header_changed = false;
+
+    if(this->is_rewritten(file, file_size, header_changed))
+    {
+        stdromano::log_debug("Image \"{}\" is written again, reading it from its start", this->_path);
+
+        /* Truncated before its header is written again, the header is compared by the next polls */
+        if(header_changed && file_size < this->_header.size() + this->_offset_table.size())
+        {
+            this->reset_chunks();
+            this->_file_size = file_size;
+            this->_file_mtime = file_mtime;
+
+            return 0;
+        }
+
+        if(header_changed)
+        {
+            /* Layers, windows or chunks may differ, the image is set up again */
+            const stdromano::StringD path = this->_path.copy();
+
+            stdromano::Vector<stdromano::StringD> layer_names;
+
+            for(const auto& name : this->_layer_names)
+            {
+                layer_names.push_back(name.copy());
+            }
+
+            if(!this->open(path, layer_names))
+            {
+                return 0;
+            }
+
+            if(!file.open(this->_path))
+            {
+                return 0;
+            }
+        }
+        else
+        {
+            this->reset_chunks();
+        }
+    }
+
+    this->_file_size = file_size;
+    this->_file_mtime = file_mtime;
+
+    if(this->is_complete())
+    {
+        return 0;
+    }
+
+    /* Scanline chunks start with y and the size of the data, tiles with dx, dy, lx, ly and the size */
+    const std::uint64_t chunk_header_size = this->_tiled ? 20 : 8;
+
+    std::size_t num_new_chunks = 0;
+
+    while(this->_scan_offset + chunk_header_size <= file_size)
+    {
+        std::uint8_t chunk[20];
+
+        if(file.read(this->_scan_offset, chunk, static_cast<std::size_t>(chunk_header_size)) != chunk_header_size)
+        {
+            break;
+        }
+
+        const std::int32_t c0 = exr_read_le_int32(chunk);
+        const std::int32_t data_size = exr_read_le_int32(chunk + chunk_header_size - 4);
+
+        std::int64_t index = -1;
+
+        if(this->_tiled)
+        {
+            index = this->tile_chunk_index(c0,
+                                           exr_read_le_int32(chunk + 4),
+                                           exr_read_le_int32(chunk + 8),
+                                           exr_read_le_int32(chunk + 12));
+        }
+        else if(c0 >= this->_data_window.min.y &&
+                c0 <= this->_data_window.max.y &&
+                (c0 - this->_data_window.min.y) % this->_lines_per_block == 0)
+        {
+            index = (c0 - this->_data_window.min.y) / this->_lines_per_block;
+        }
+
+        if(index < 0 || data_size <= 0)
+        {
+            stdromano::log_error("Invalid chunk at offset {} of image \"{}\"", this->_scan_offset, this->_path);
+            break;
+        }
+
+        /* The chunk is still being written */
+        if(this->_scan_offset + chunk_header_size + static_cast<std::uint64_t>(data_size) > file_size)
+        {
+            break;
+        }
+
+        const std::uint64_t chunk_offset = this->_scan_offset;
+
+        this->_scan_offset += chunk_header_size + static_cast<std::uint64_t>(data_size);
+
+        if(this->_chunk_offsets[static_cast<std::size_t>(index)] != 0)
+        {
+            continue;
+        }
+
+        this->_chunk_offsets[static_cast<std::size_t>(index)] = chunk_offset;
+
+        /* Only the full resolution level is decoded, the tiles of the others are read once found */
+        if(this->_tiled && (exr_read_le_int32(chunk + 8) != 0 || exr_read_le_int32(chunk + 12) != 0))
+        {
+            this->_read_chunks[static_cast<std::size_t>(index)] = 1;
+            this->_num_read_chunks++;
+            num_new_chunks++;
+        }
+    }
+
+    /* Chunks found by this scan or by the previous ones whose decoding failed */
+    stdromano::Vector<std::size_t> new_chunks;
+
+    for(std::size_t i = 0; i < this->_chunk_offsets.size(); i++)
+    {
+        if(this->_chunk_offsets[i] != 0 && this->_read_chunks[i] == 0)
+        {
+            new_chunks.push_back(i);
+        }
+    }
+
+    if(new_chunks.empty())
+    {
+        return num_new_chunks;
+    }
+
+    /*
+     * The offset table is served from the offsets found by the scans so OpenEXR reads the chunks
+     * there, instead of rebuilding the table by walking the headers of all the chunks written. The
+     * chunks not found yet point to the first one to look valid, they are not read
+     */
+    const std::uint64_t first_chunk_offset = this->_table_offset + this->_chunk_offsets.size() * sizeof(std::uint64_t);
+
+    stdromano::Vector<std::uint8_t> offset_table;
+    offset_table.resize(this->_chunk_offsets.size() * sizeof(std::uint64_t));
+
+    for(std::size_t i = 0; i < this->_chunk_offsets.size(); i++)
+    {
+        const std::uint64_t offset = this->_chunk_offsets[i] != 0 ? this->_chunk_offsets[i] : first_chunk_offset;
+
+        for(std::size_t b = 0; b < sizeof(std::uint64_t); b++)
+        {
+            offset_table[i * sizeof(std::uint64_t) + b] = static_cast<std::uint8_t>(offset >> (b * 8));
+        }
+    }
+
+    /* Set by the workers once a chunk is decoded, the others are retried by the next poll */
+    stdromano::Vector<std::uint8_t> decoded_chunks;
+    decoded_chunks.resize(new_chunks.size());
+    std::memset(decoded_chunks.data(), 0, decoded_chunks.size());
+
+    /* Keep a few chunks per worker so opening the file stays negligible */
+    constexpr std::size_t min_chunks_per_worker = 4;
+
+    ThreadPool& pool = ThreadPool::get_global_threadpool();
+
+    const std::size_t num_workers = std::max(static_cast<std::size_t>(1),
+                                             std::min(static_cast<std::size_t>(pool.num_threads() + 1),
+                                                      new_chunks.size() / min_chunks_per_worker));
+
+    std::atomic<std::size_t> next_chunk(0);
+
+    pool.parallel_for(num_workers, [&](std::size_t) {
+        CodecContextScope codec_scope(this->_path);
+
+        try
+        {
+            EXRFileIStream stream(file,
+                                  file_size,
+                                  this->_path.c_str(),
+                                  offset_table.data(),
+                                  this->_table_offset,
+                                  offset_table.size());
+
+            Imf::MultiPartInputFile input_file(stream);
+
+            Imf::FrameBuffer frame_buffer;
+
+            for(std::size_t i = 0; i < this->_layer_names.size(); i++)
+            {
+                exr_insert_layer_slices(frame_buffer,
+                                        this->_layer_channels[i],
+                                        this->_image->get_layers().find(this->_layer_names[i])->second);
+            }
+
+            std::unique_ptr<Imf::TiledInputPart> tiled_input;
+            std::unique_ptr<Imf::InputPart> input;
+
+            if(this->_tiled)
+            {
+                tiled_input = std::make_unique<Imf::TiledInputPart>(input_file, 0);
+                tiled_input->setFrameBuffer(frame_buffer);
+            }
+            else
+            {
+                input = std::make_unique<Imf::InputPart>(input_file, 0);
+                input->setFrameBuffer(frame_buffer);
+            }
+
+            std::size_t i;
+
+            while((i = next_chunk.fetch_add(1, std::memory_order_relaxed)) < new_chunks.size())
+            {
+                const std::int32_t index = static_cast<std::int32_t>(new_chunks[i]);
+
+                try
+                {
+                    if(this->_tiled)
+                    {
+                        /* The tiles of the full resolution level come first, row by row */
+                        const std::int32_t num_tiles_x = this->_level_num_tiles_x[0];
+
+                        tiled_input->readTile(index % num_tiles_x, index / num_tiles_x, 0, 0);
+                    }
+                    else
+                    {
+                        const std::int32_t y = this->_data_window.min.y + index * this->_lines_per_block;
+
+                        input->readPixels(y, std::min(y + this->_lines_per_block - 1, this->_data_window.max.y));
+                    }
+
+                    decoded_chunks[i] = 1;
+                }
+                catch(const std::exception& e)
+                {
+                    stdromano::log_error("Error while reading chunk {} of image \"{}\" ({})", index, this->_path, e.what());
+                }
+            }
+        }
+        catch(const std::exception& e)
+        {
+            stdromano::log_error("Error while reading the new chunks of image \"{}\" ({})", this->_path, e.what());
+        }
+    });
+
+    this->_num_failed_chunks = 0;
+
+    for(std::size_t i = 0; i < new_chunks.size(); i++)
+    {
+        if(decoded_chunks[i] == 0)
+        {
+            this->_num_failed_chunks++;
+            continue;
+        }
+
+        this->_read_chunks[new_chunks[i]] = 1;
+        this->_num_read_chunks++;
+        num_new_chunks++;
+    }
+
+    stdromano::log_debug("Read {} new chunks of image \"{}\" ({}/{}, {} to retry)",
+                         num_new_chunks,
+                         this->_path,
+                         this->_num_read_chunks,
+                         this->_read_chunks.size(),
+                         this->_num_failed_chunks);
+
+    return num_new_chunks;
+}
+
+/* Registry */
+
+/* Lowercase extension of the file name of a path, empty if it has none */
+std::string path_extension_lower(const stdromano::StringD& path) noexcept
+{
+    const char* str = path.c_str();
+    const char* ext = nullptr;
+
+    for(const char* c = str; *c != '\0'; c++)
+    {
+        if(*c == '.')
+        {
+            ext = c + 1;
+        }
+        else if(*c == '/' || *c == '\\')
+        {
+            ext = nullptr;
+        }
+    }
+
+    std::string extension = ext != nullptr ? ext : "";
+
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
+
+    return extension;
+}
+
+/* Returns true if the extension is one of the comma separated list */
+bool extension_in_list(const std::string& extension, const stdromano::StringD& list) noexcept
+{
+    if(extension.empty())
+    {
+        return false;
+    }
+
+    const char* token = list.c_str();
+
+    while(*token != '\0')
+    {
+        const char* token_end = std::strchr(token, ',');
+        const std::size_t token_size = token_end != nullptr ? static_cast<std::size_t>(token_end - token) :
+                                                              std::strlen(token);
+
+        if(token_size == extension.size() && std::memcmp(token, extension.data(), token_size) == 0)
+        {
+            return true;
+        }
+
+        token += token_size + (token_end != nullptr ? 1 : 0);
+    }
+
+    return false;
+}
+
+ImageReaderRegistry::ImageReaderRegistry()
+{
+    /* Codec libraries with process-wide state are set up once, before any file is read */
+    TIFFSetErrorHandler(tiff_error_handler);
+    TIFFSetWarningHandler(tiff_warning_handler);
+
+    this->_readers.emplace_back(new ImageReader{ "jpeg",
+                                                 "jpg,jpeg",
+                                                 image_probe_jpeg,
+                                                 image_read_metadata_jpeg,
+                                                 layer_pixel_read_jpeg,
+                                                 nullptr,
+                                                 ImageReaderFlags_None,
+                                                 0 });
+
+    this->_readers.emplace_back(new ImageReader{ "png",
+                                                 "png",
+                                                 image_probe_png,
+                                                 image_read_metadata_png,
+                                                 layer_pixel_read_png,
+                                                 nullptr,
+                                                 ImageReaderFlags_None,
+                                                 0 });
+
+    this->_readers.emplace_back(new ImageReader{ "hdr",
+                                                 "hdr",
+                                                 image_probe_hdr,
+                                                 image_read_metadata_hdr,
+                                                 layer_pixel_read_hdr,
+                                                 nullptr,
+                                                 ImageReaderFlags_None,
+                                                 0 });
+
+    this->_readers.emplace_back(new ImageReader{ "exr",
+                                                 "exr",
+                                                 image_probe_exr,
+                                                 image_read_metadata_exr,
+                                                 layer_pixel_read_exr,
+                                                 layers_pixels_read_exr,
+                                                 ImageReaderFlags_Tiled |
+                                                     ImageReaderFlags_ROI |
+                                                     ImageReaderFlags_MultiLayer |
+                                                     ImageReaderFlags_DepthMask,
+                                                 0 });
+
+    this->_readers.emplace_back(new ImageReader{ "tiff",
+                                                 "tif,tiff,tx",
+                                                 image_probe_tiff,
+                                                 image_read_metadata_tiff,
+                                                 layer_pixel_read_tiff,
+                                                 nullptr,
+                                                 ImageReaderFlags_Tiled | ImageReaderFlags_ROI,
+                                                 0 });
+}
+
+ImageReaderRegistry& ImageReaderRegistry::get_instance() noexcept
+{
+    static ImageReaderRegistry registry;
+
+    return registry;
+}
+
+void ImageReaderRegistry::register_reader(ImageReader&& reader) noexcept
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+
+    this->_readers.emplace_back(new ImageReader(std::move(reader)));
+}
+
+stdromano::StringD ImageReaderRegistry::detect_format(const stdromano::StringD& path) const noexcept
+{
+    std::uint8_t header[ImageReaderRegistry::PROBE_SIZE];
+    std::size_t header_size = 0;
+
+    if(MemoryFiles::is_memory_path(path))
+    {
+        std::size_t size = 0;
+
+        const std::shared_ptr<const void> data = MemoryFiles::get_instance().find(path, size);
+
+        if(data != nullptr)
+        {
+            header_size = std::min(size, sizeof(header));
+            std::memcpy(header, data.get(), header_size);
+        }
+    }
+    else
+    {
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+
+        if(file != nullptr)
+        {
+            header_size = std::fread(header, 1, sizeof(header), file);
+            std::fclose(file);
+        }
+    }
+
+    return this->detect_format(header, header_size, path);
+}
+
+stdromano::StringD ImageReaderRegistry::detect_format(const std::uint8_t* header,
+                                                      std::size_t header_size,
+                                                      const stdromano::StringD& name) const noexcept
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+
+    const ImageReader* found = nullptr;
+
+    for(const auto& reader : this->_readers)
+    {
+        if(reader->probe != nullptr &&
+           reader->probe(header, header_size) &&
+           (found == nullptr || reader->priority > found->priority))
+        {
+            found = reader.get();
+        }
+    }
+
+    if(found == nullptr)
+    {
+        const std::string extension = path_extension_lower(name);
+
+        for(const auto& reader : this->_readers)
+        {
+            if(extension_in_list(extension, reader->extensions) &&
+               (found == nullptr || reader->priority > found->priority))
+            {
+                found = reader.get();
+            }
+        }
+    }
+
+    return found != nullptr ? found->format.copy() : stdromano::StringD();
+}
+
+bool ImageReaderRegistry::has_extension(const stdromano::StringD& path) const noexcept
+{
+    const std::string extension = path_extension_lower(path);
+
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+
+    for(const auto& reader : this->_readers)
+    {
+        if(extension_in_list(extension, reader->extensions))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const ImageReader* ImageReaderRegistry::find_reader(const stdromano::StringD& format,
+                                                    std::uint32_t flags) const noexcept
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+
+    const ImageReader* best = nullptr;
+    const ImageReader* best_capable = nullptr;
+
+    for(const auto& reader : this->_readers)
+    {
+        if(reader->format != format)
+        {
+            continue;
+        }
+
+        if(best == nullptr || reader->priority > best->priority)
+        {
+            best = reader.get();
+        }
+
+        if((reader->flags & flags) == flags &&
+           (best_capable == nullptr || reader->priority > best_capable->priority))
+        {
+            best_capable = reader.get();
+        }
+    }
+
+    return best_capable != nullptr ? best_capable : best;
+}
+
+/* Generic image read static function */
+
+bool Image::is_readable(const stdromano::StringD& path) noexcept
+{
+    return !ImageReaderRegistry::get_instance().detect_format(path).empty();
+}
+
+std::shared_ptr<Image> Image::from_memory(const void* data,
+                                          std::size_t size,
+                                          const stdromano::StringD& format_hint) noexcept
+{
+    if(data == nullptr || size == 0)
+    {
+        stdromano::log_error("Cannot load an image from an empty buffer");
+        return nullptr;
+    }
+
+    void* copy = stdromano::mem_aligned_alloc(size, 32);
+    std::memcpy(copy, data, size);
+
+    return Image::from_memory(std::shared_ptr<const void>(copy,
+                                                          [](const void* ptr) {
+                                                              stdromano::mem_aligned_free(const_cast<void*>(ptr));
+                                                          }),
+                              size,
+                              format_hint);
+}
+
+std::shared_ptr<Image> Image::from_memory(std::shared_ptr<const void> data,
+                                          std::size_t size,
+                                          const stdromano::StringD& format_hint) noexcept
+{
+    if(data == nullptr || size == 0)
+    {
+        stdromano::log_error("Cannot load an image from an empty buffer");
+        return nullptr;
+    }
+
+    const stdromano::StringD path = MemoryFiles::get_instance().add(data, size, format_hint);
+
+    return Image::from_memory_path(path, std::move(data));
+}
+
+std::shared_ptr<Image> Image::from_memory_path(const stdromano::StringD& path,
+                                               std::shared_ptr<const void> owner) noexcept
+{
+    std::shared_ptr<Image> image = std::make_shared<Image>(path);
+
+    /* The buffer stays registered under the path as long as the image references it */
+    image->_memory = std::move(owner);
+
+    return image->is_valid() ? image : nullptr;
+}
+
+bool Image::read_image_metadata(const stdromano::StringD& path,
+                                Image& image) noexcept
+{
+    CodecContextScope codec_scope(path);
+
+    const ImageReaderRegistry& registry = ImageReaderRegistry::get_instance();
+
+    /*
+     * The file is mapped once, to probe its format and for its reader to parse the headers. A
+     * mapping installed by the caller is reused, for archives to read the headers of a member
+     * from its first bytes only
+     */
+    const std::shared_ptr<MappedFile> mapping = std::make_shared<MappedFile>(path);
+
+    if(!mapping->is_open())
+    {
+        return false;
+    }
+
+    image._format = registry.detect_format(mapping->data(),
+                                           std::min(mapping->size(), ImageReaderRegistry::PROBE_SIZE),
+                                           path);
+
+    /* Identifies the version of the file the layers are read from in the frame cache */
+    if(!MemoryFiles::is_memory_path(path))
+    {
+        std::error_code ec;
+
+        const std::filesystem::file_time_type mtime = std::filesystem::last_write_time(path.c_str(), ec);
+        image._file_mtime = ec ? 0 : static_cast<std::int64_t>(mtime.time_since_epoch().count());
+        image._file_size = static_cast<std::uint64_t>(mapping->size());
+    }
+
+    const ImageReader* reader = registry.find_reader(image._format);
+
+    if(reader == nullptr)
+    {
+        stdromano::log_error("No reader available to load file: {}", path);
+        return false;
+    }
+
+    MappedFileScope mapping_scope(path, mapping);
+
+    return reader->read_metadata(path, image);
+}
+
+/* Returns true if the mask only selects channels (each at most once) and constants */
+bool shuffle_mask_is_selection(const stdromano::StringD& mask) noexcept
+{
+    std::uint32_t selected = 0;
+
+    for(const auto& c : mask)
+    {
+        std::uint32_t channel;
+
+        switch(std::toupper(static_cast<unsigned char>(c)))
+        {
+            case 'R':
+                channel = 0x1;
+                break;
+            case 'G':
+                channel = 0x2;
+                break;
+            case 'B':
+                channel = 0x4;
+                break;
+            case 'A':
+                channel = 0x8;
+                break;
+            case '0':
+            case '1':
+                continue;
+            default:
+                return false;
+        }
+
+        if((selected & channel) != 0)
+        {
+            return false;
+        }
+
+        selected |= channel;
+    }
+
+    return true;
+}
+
+bool Image::read_layer_pixels(const stdromano::StringD& path,
+                              const stdromano::StringD& layer_name,
+                              Layer& layer) noexcept
+{
+    CodecContextScope codec_scope(path);
+
+    const bool needs_conversion = layer._depth != layer._file_depth || !layer._mask.empty();
+
+    std::uint32_t flags = needs_conversion ? ImageReaderFlags_DepthMask : ImageReaderFlags_None;
+
+    if(!layer.is_full_window())
+    {
+        flags |= ImageReaderFlags_ROI;
+    }
+
+    if(layer.level() > 0)
+    {
+        flags |= ImageReaderFlags_Tiled;
+    }
+
+    const ImageReader* reader = ImageReaderRegistry::get_instance().find_reader(layer.parent()->format(),
+                                                                                flags);
+
+    if(reader == nullptr)
+    {
+        stdromano::log_error("No reader available to load layer: {} (format is: {})",
+                             path,
+                             layer.parent()->format());
+        return false;
+    }
+
+    if(needs_conversion &&
+       ((reader->flags & ImageReaderFlags_DepthMask) == 0 ||
+        (layer._depth != LayerDepth_F16 && layer._depth != LayerDepth_F32) ||
+        !shuffle_mask_is_selection(layer._mask)))
+    {
+        /* Decode with the depth and channels of the file, then shuffle and convert the layer */
+        const std::uint8_t depth = layer._depth;
+        stdromano::StringD mask = std::move(layer._mask);
+
+        layer._depth = layer._file_depth;
+        layer._nchannels = layer._file_nchannels;
+        layer._mask = stdromano::StringD();
+
+        if(!Image::read_layer_pixels(path, layer_name, layer))
+        {
+            return false;
+        }
+
+        /* Single pass over the pixels, an empty mask keeping the channels */
+        if(!layer.shuffle_convert(mask, depth))
+        {
+            stdromano::log_error("Cannot shuffle layer {} of image {} with mask {}", layer_name, path, mask);
+            return false;
+        }
+
+        layer._mask = std::move(mask);
+
+        return true;
+    }
+
+    if(!layer.is_full_window() && (reader->flags & ImageReaderFlags_ROI) == 0)
+    {
+        /* Decode the whole layer and crop it to the requested window */
+        const Imath::Box2i window = layer._window;
+
+        layer._window = Imath::Box2i();
+
+        if(!reader->read_layer_pixels(path, layer_name, layer))
+        {
+            return false;
+        }
+
+        layer.crop(window);
+
+        return true;
+    }
+
+    return reader->read_layer_pixels(path, layer_name, layer);
+}
+
+bool Image::read_layers_pixels(const stdromano::StringD& path,
+                               const stdromano::Vector<stdromano::StringD>& layer_names,
+                               Image& image) noexcept
 {
-    const stdromano::StringD ext = path.rsplit(".");
+    CodecContextScope codec_scope(path);
 
-    LayerPixelsReadFunc func = get_layer_pixels_read(ext);
+    const ImageReader* reader = ImageReaderRegistry::get_instance().find_reader(image._format,
+                                                                                ImageReaderFlags_MultiLayer);
 
-    if(func == nullptr)
+    if(reader == nullptr)
     {
-        stdromano::log_error("No function available to load layer: {} (type is: {})", path, ext);
+        stdromano::log_error("No reader available to load layers: {} (format is: {})",
+                             path,
+                             image._format);
         return false;
     }
 
-    return func(path, layer_name, layer);
+    if((reader->flags & ImageReaderFlags_MultiLayer) != 0 && reader->read_layers_pixels != nullptr)
+    {
+        return reader->read_layers_pixels(path, layer_names, image);
+    }
+
+    /* Formats without multi-layer support are read layer by layer */
+    bool success = true;
+
+    for(const auto& layer_name : layer_names)
+    {
+        success &= Image::read_layer_pixels(path, layer_name, image.get_layers().find(layer_name)->second);
+    }
+
+    return success;
 }
 
 LOV_NAMESPACE_END
@@ -0,0 +1,350 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+#include "OpenViewer/image_sequence.hpp"
+#include "OpenViewer/thread_pool.hpp"
+
+#include "stdromano/logger.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+LOV_NAMESPACE_BEGIN
+
+/* Index of the file name in the path */
+std::size_t path_filename_offset(const std::string& path) noexcept
+{
+    const std::size_t separator = path.find_last_of("/\\");
+
+    return separator == std::string::npos ? 0 : separator + 1;
+}
+
+ImageSequence::ImageSequence() : _padding(1),
+                                 _first_frame(0),
+                                 _last_frame(-1)
+{
+}
+
+bool ImageSequence::parse_pattern(const stdromano::StringD& pattern) noexcept
+{
+    const std::string path = pattern.c_str();
+    const std::size_t filename_offset = path_filename_offset(path);
+
+    std::size_t token_start = std::string::npos;
+    std::size_t token_size = 0;
+    std::uint32_t padding = 0;
+
+    /* The last token of the file name is the frame number */
+    for(std::size_t i = filename_offset; i < path.size(); i++)
+    {
+        if(path[i] == '#' || path[i] == '@')
+        {
+            std::size_t end = i;
+
+            while(end < path.size() && path[end] == path[i])
+            {
+                end++;
+            }
+
+            token_start = i;
+            token_size = end - i;
+            padding = static_cast<std::uint32_t>(token_size);
+
+            i = end - 1;
+        }
+        else if(path[i] == '%')
+        {
+            std::size_t end = i + 1;
+            std::uint32_t width = 0;
+
+            while(end < path.size() && std::isdigit(static_cast<unsigned char>(path[end])))
+            {
+                width = width * 10 + static_cast<std::uint32_t>(path[end] - '0');
+                end++;
+            }
+
+            if(end < path.size() && path[end] == 'd')
+            {
+                token_start = i;
+                token_size = end + 1 - i;
+                padding = std::max(width, 1u);
+
+                i = end;
+            }
+        }
+    }
+
+    if(token_start == std::string::npos)
+    {
+        stdromano::log_error("No frame number found in sequence pattern \"{}\"", pattern);
+        return false;
+    }
+
+    this->_head = stdromano::StringD(path.substr(0, token_start).c_str());
+    this->_tail = stdromano::StringD(path.substr(token_start + token_size).c_str());
+    this->_padding = padding;
+
+    return true;
+}
+
+void ImageSequence::find_missing_frames() noexcept
+{
+    this->_missing_frames.clear();
+
+    for(std::int32_t frame = this->_first_frame; frame <= this->_last_frame; frame++)
+    {
+        std::error_code ec;
+
+        if(!std::filesystem::is_regular_file(this->frame_path(frame).c_str(), ec))
+        {
+            this->_missing_frames.push_back(frame);
+        }
+    }
+}
+
+bool ImageSequence::open(const stdromano::StringD& pattern) noexcept
+{
+    this->_first_frame = 0;
+    this->_last_frame = -1;
+    this->_missing_frames.clear();
+
+    if(!this->parse_pattern(pattern))
+    {
+        return false;
+    }
+
+    const std::string head = this->_head.c_str();
+    const std::string tail = this->_tail.c_str();
+    const std::size_t filename_offset = path_filename_offset(head);
+
+    const std::string directory = filename_offset == 0 ? "." : head.substr(0, filename_offset);
+    const std::string prefix = head.substr(filename_offset);
+
+    stdromano::Vector<std::int32_t> frames;
+
+    std::error_code ec;
+    std::filesystem::directory_iterator it(directory, ec);
+
+    for(; !ec && it != std::filesystem::directory_iterator(); it.increment(ec))
+    {
+        const std::string filename = it->path().filename().string();
+
+        if(filename.size() <= prefix.size() + tail.size() ||
+           filename.compare(0, prefix.size(), prefix) != 0 ||
+           filename.compare(filename.size() - tail.size(), tail.size(), tail) != 0)
+        {
+            continue;
+        }
+
+        const std::string number = filename.substr(prefix.size(),
+                                                   filename.size() - prefix.size() - tail.size());
+
+        const bool negative = number[0] == '-';
+        const std::size_t num_digits = number.size() - (negative ? 1 : 0);
+
+        if(num_digits == 0 ||
+           num_digits > 9 ||
+           !std::all_of(number.begin() + (negative ? 1 : 0), number.end(), [](unsigned char c) {
+               return std::isdigit(c) != 0;
+           }))
+        {
+            continue;
+        }
+
+        /* Numbers longer than the padding are written without leading zeros */
+        if(num_digits < this->_padding ||
+           (num_digits > this->_padding && number[negative ? 1 : 0] == '0'))
+        {
+            continue;
+        }
+
+        frames.push_back(std::stoi(number));
+    }
+
+    if(ec)
+    {
+        stdromano::log_error("Cannot list the directory of sequence \"{}\" ({})",
+                             pattern,
+                             ec.message().c_str());
+        return false;
+    }
+
+    if(frames.empty())
+    {
+        stdromano::log_error("No frame found for sequence \"{}\"", pattern);
+        return false;
+    }
+
+    std::sort(frames.begin(), frames.end());
+
+    this->_first_frame = frames[0];
+    this->_last_frame = frames[frames.size() - 1];
+
+    std::size_t found = 0;
+
+    for(std::int32_t frame = this->_first_frame; frame <= this->_last_frame; frame++)
+    {
+        if(found < frames.size() && frames[found] == frame)
+        {
+            while(found < frames.size() && frames[found] == frame)
+            {
+                found++;
+            }
+
+            continue;
+        }
+
+        this->_missing_frames.push_back(frame);
+    }
+
+    if(!this->_missing_frames.empty())
+    {
+        stdromano::log_warn("Sequence \"{}\" is missing {} frames",
+                            pattern,
+                            this->_missing_frames.size());
+    }
+
+    return true;
+}
+
+bool ImageSequence::open(const stdromano::StringD& pattern,
+                         std::int32_t first_frame,
+                         std::int32_t last_frame) noexcept
+{
+    this->_first_frame = 0;
+    this->_last_frame = -1;
+    this->_missing_frames.clear();
+
+    if(first_frame > last_frame || !this->parse_pattern(pattern))
+    {
+        return false;
+    }
+
+    this->_first_frame = first_frame;
+    this->_last_frame = last_frame;
+
+    this->find_missing_frames();
+
+    return true;
+}
+
+bool ImageSequence::open_from_frame(const stdromano::StringD& frame_path) noexcept
+{
+    const std::string path = frame_path.c_str();
+    const std::size_t filename_offset = path_filename_offset(path);
+
+    std::size_t number_end = std::string::npos;
+
+    for(std::size_t i = path.size(); i > filename_offset; i--)
+    {
+        if(std::isdigit(static_cast<unsigned char>(path[i - 1])))
+        {
+            number_end = i;
+            break;
+        }
+    }
+
+    if(number_end == std::string::npos)
+    {
+        stdromano::log_error("No frame number found in file name \"{}\"", frame_path);
+        return false;
+    }
+
+    std::size_t number_start = number_end;
+
+    while(number_start > filename_offset && std::isdigit(static_cast<unsigned char>(path[number_start - 1])))
+    {
+        number_start--;
+    }
+
+    const std::string pattern = path.substr(0, number_start) +
+                                std::string(number_end - number_start, '#') +
+                                path.substr(number_end);
+
+    return this->open(stdromano::StringD(pattern.c_str()));
+}
+
+stdromano::StringD ImageSequence::pattern() const noexcept
+{
+    char token[16];
+    const std::size_t token_size = std::min(static_cast<std::size_t>(this->_padding), sizeof(token) - 1);
+
+    std::memset(token, '#', token_size);
+    token[token_size] = '\0';
+
+    return stdromano::StringD("{}{}{}", this->_head, token, this->_tail);
+}
+
+bool ImageSequence::has_frame(std::int32_t frame) const noexcept
+{
+    return frame >= this->_first_frame &&
+           frame <= this->_last_frame &&
+           !std::binary_search(this->_missing_frames.begin(), this->_missing_frames.end(), frame);
+}
+
+stdromano::StringD ImageSequence::frame_path(std::int32_t frame) const noexcept
+{
+    /* The padding only counts the digits, "%0*d" would count the sign of negative frames in it */
+    const std::int64_t magnitude = std::abs(static_cast<std::int64_t>(frame));
+
+    char number[24];
+    std::snprintf(number,
+                  sizeof(number),
+                  "%s%0*lld",
+                  frame < 0 ? "-" : "",
+                  static_cast<int>(this->_padding),
+                  static_cast<long long>(magnitude));
+
+    return stdromano::StringD("{}{}{}", this->_head, number, this->_tail);
+}
+
+stdromano::Vector<stdromano::StringD> ImageSequence::frame_paths() const noexcept
+{
+    stdromano::Vector<stdromano::StringD> paths;
+
+    for(std::int32_t frame = this->_first_frame; frame <= this->_last_frame; frame++)
+    {
+        paths.push_back(this->has_frame(frame) ? this->frame_path(frame) : stdromano::StringD());
+    }
+
+    return paths;
+}
+
+std::shared_ptr<Image> ImageSequence::frame(std::int32_t frame) const noexcept
+{
+    if(!this->has_frame(frame))
+    {
+        return nullptr;
+    }
+
+    std::shared_ptr<Image> image = std::make_shared<Image>(this->frame_path(frame));
+
+    return image->is_valid() ? image : nullptr;
+}
+
+void ImageSequence::for_each_frame(const std::function<void(std::int32_t, Image&)>& func) const noexcept
+{
+    ThreadPool::get_global_threadpool().parallel_for(this->num_frames(), [&](std::size_t i) {
+        const std::int32_t frame = this->_first_frame + static_cast<std::int32_t>(i);
+
+        if(!this->has_frame(frame))
+        {
+            return;
+        }
+
+        Image image(this->frame_path(frame));
+
+        if(image.is_valid())
+        {
+            func(frame, image);
+        }
+    });
+}
+
+LOV_NAMESPACE_END
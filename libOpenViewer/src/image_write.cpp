@@ -3,6 +3,7 @@
 // All rights reserved.
 
 #include "OpenViewer/image.hpp"
+#include "OpenViewer/codec_context.hpp"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #define STBI_MALLOC stdromano::mem_alloc
@@ -27,25 +28,33 @@ bool image_write_jpg_from_rgba(const stdromano::StringD& path, Image& img) noexc
 
     if(rgba_layer == nullptr)
     {
-        stdromano::log_error("Error during write of image {}, no main layer has been found");
+        stdromano::log_error("Error during write of image {}, no main layer has been found", path);
         return false;
     }
 
-    Layer rgb_layer = *rgba_layer;
+    /*
+     * Shuffled and converted in a single pass, without copying the layer. The buffer and the
+     * written image both have the size of the data window of the layer
+     */
+    void* rgb_data = stdromano::mem_aligned_alloc(rgba_layer->npixels() * 3, 32);
 
-    rgb_layer.shuffle("RGB");
-
-    if(rgb_layer.depth() != LayerDepth_U8)
+    if(!rgba_layer->shuffle_convert("RGB", LayerDepth_U8, rgb_data))
     {
-        rgb_layer.convert(LayerDepth_U8);
+        stdromano::mem_aligned_free(rgb_data);
+        stdromano::log_error("Error during write of image {}, cannot shuffle the main layer", path);
+        return false;
     }
 
-    if(stbi_write_jpg(path.c_str(),
-                      img.get_display_width(),
-                      img.get_display_height(),
-                      rgb_layer.nchannels(),
-                      rgb_layer.data<void>(),
-                      100) == 0)
+    const bool written = stbi_write_jpg(path.c_str(),
+                                        rgba_layer->width(),
+                                        rgba_layer->height(),
+                                        3,
+                                        rgb_data,
+                                        100) != 0;
+
+    stdromano::mem_aligned_free(rgb_data);
+
+    if(!written)
     {
         stdromano::log_error("Error during write of image {}", path);
         return false;
@@ -58,6 +67,12 @@ bool image_write_jpg(const stdromano::StringD& path, Image& img) noexcept
 {
     Layer* layer = img.main();
 
+    if(layer == nullptr)
+    {
+        stdromano::log_error("Error during write of image {}, the main layer cannot be read", path);
+        return false;
+    }
+
     if(layer->nchannels() == 4)
     {
         return image_write_jpg_from_rgba(path, img);
@@ -76,8 +91,8 @@ bool image_write_jpg(const stdromano::StringD& path, Image& img) noexcept
         new_layer.convert(LayerDepth_U8);
 
         if(stbi_write_jpg(path.c_str(),
-                          img.get_display_width(),
-                          img.get_display_height(),
+                          new_layer.width(),
+                          new_layer.height(),
                           new_layer.nchannels(),
                           new_layer.data<void>(),
                           100) == 0)
@@ -89,8 +104,8 @@ bool image_write_jpg(const stdromano::StringD& path, Image& img) noexcept
     else
     {
         if(stbi_write_jpg(path.c_str(),
-                          img.get_display_width(),
-                          img.get_display_height(),
+                          layer->width(),
+                          layer->height(),
                           layer->nchannels(),
                           layer->data<void>(),
                           100) == 0)
@@ -111,6 +126,12 @@ bool image_write_png(const stdromano::StringD& path, Image& img) noexcept
 {
     const Layer* layer = img.main();
 
+    if(layer == nullptr)
+    {
+        stdromano::log_error("Error during write of image {}, the main layer cannot be read", path);
+        return false;
+    }
+
     if(layer->nchannels() < 3)
     {
         stdromano::log_error("Cannot write a png image \"{}\" with less than 3 channels", path);
@@ -125,11 +146,11 @@ bool image_write_png(const stdromano::StringD& path, Image& img) noexcept
         new_layer.convert(LayerDepth_U8);
 
         if(stbi_write_png(path.c_str(),
-                          img.get_display_width(),
-                          img.get_display_height(),
+                          new_layer.width(),
+                          new_layer.height(),
                           new_layer.nchannels(),
                           new_layer.data<void>(),
-                          img.get_display_width() * new_layer.channel_stride()) == 0)
+                          new_layer.width() * new_layer.channel_stride()) == 0)
         {
             stdromano::log_error("Error during write of image {}", path);
             return false;
@@ -138,11 +159,11 @@ bool image_write_png(const stdromano::StringD& path, Image& img) noexcept
     else
     {
         if(stbi_write_png(path.c_str(),
-                          img.get_display_width(),
-                          img.get_display_height(),
+                          layer->width(),
+                          layer->height(),
                           layer->nchannels(),
                           layer->data<void>(),
-                          img.get_display_width() * layer->channel_stride()) == 0)
+                          layer->width() * layer->channel_stride()) == 0)
         {
             stdromano::log_error("Error during write of image {}", path);
             return false;
@@ -158,6 +179,12 @@ bool image_write_hdr(const stdromano::StringD& path, Image& img) noexcept
 {
     const Layer* layer = img.main();
 
+    if(layer == nullptr)
+    {
+        stdromano::log_error("Error during write of image {}, the main layer cannot be read", path);
+        return false;
+    }
+
     if(layer->nchannels() < 3)
     {
         stdromano::log_error("Cannot write an hdr image \"{}\" with less than 3 channels",
@@ -171,8 +198,8 @@ bool image_write_hdr(const stdromano::StringD& path, Image& img) noexcept
         new_layer.convert(LayerDepth_F32);
 
         if(stbi_write_hdr(path.c_str(),
-                          img.get_display_width(),
-                          img.get_display_height(),
+                          new_layer.width(),
+                          new_layer.height(),
                           new_layer.nchannels(),
                           new_layer.data<float>()) == 0)
         {
@@ -183,8 +210,8 @@ bool image_write_hdr(const stdromano::StringD& path, Image& img) noexcept
     else
     {
         if(stbi_write_hdr(path.c_str(),
-                          img.get_display_width(),
-                          img.get_display_height(),
+                          layer->width(),
+                          layer->height(),
                           layer->nchannels(),
                           layer->data<float>()) == 0)
         {
@@ -254,6 +281,14 @@ bool image_write_exr(const stdromano::StringD& path, Image& img) noexcept
                                                                             Imf::HALF;
 
         const std::size_t pixel_size = layer_depth_as_byte_size(layer.depth());
+        const std::size_t x_stride = pixel_size * layer.nchannels();
+        const std::size_t y_stride = x_stride * static_cast<std::size_t>(layer.width());
+
+        /* OpenEXR addresses the slices with the coordinates of the data window */
+        const Imath::Box2i& window = layer.window();
+        const std::ptrdiff_t origin = static_cast<std::ptrdiff_t>(window.min.x) * static_cast<std::ptrdiff_t>(x_stride) +
+                                      static_cast<std::ptrdiff_t>(window.min.y) * static_cast<std::ptrdiff_t>(y_stride);
+
         std::size_t offset = 0;
 
         if(layer_name == Image::MAIN_LAYER_NAME)
@@ -262,9 +297,9 @@ bool image_write_exr(const stdromano::StringD& path, Image& img) noexcept
             {
                 frame_buffer.insert(std::string(1, exr_channels[i]),
                                     Imf::Slice(pixel_type,
-                                               const_cast<char*>(layer.data<char>()) + offset,
-                                               pixel_size * layer.nchannels(),
-                                               pixel_size * layer.nchannels() * img.get_data_width()));
+                                               const_cast<char*>(layer.data<char>()) + offset - origin,
+                                               x_stride,
+                                               y_stride));
 
                 offset += pixel_size;
             }
@@ -277,16 +312,16 @@ bool image_write_exr(const stdromano::StringD& path, Image& img) noexcept
 
                 frame_buffer.insert(channel_name.c_str(),
                                     Imf::Slice(pixel_type,
-                                               const_cast<char*>(layer.data<char>()) + offset,
-                                               pixel_size * layer.nchannels(),
-                                               pixel_size * layer.nchannels() * img.get_data_width()));
+                                               const_cast<char*>(layer.data<char>()) + offset - origin,
+                                               x_stride,
+                                               y_stride));
 
                 offset += pixel_size;
             }
         }
 
         file.setFrameBuffer(frame_buffer);
-        file.writePixels(img.get_data_height());
+        file.writePixels(layer.height());
     }
 
     return true;
@@ -306,6 +341,8 @@ stdromano::HashMap<stdromano::StringD, ImageWriteFunc> g_write_funcs_table = {
 
 bool Image::write(const stdromano::StringD& path) noexcept
 {
+    CodecContextScope codec_scope(path);
+
     const stdromano::StringD ext = path.rsplit(".");
 
     auto it = g_write_funcs_table.find(ext);
@@ -8,6 +8,8 @@
 
 #include <intrin.h>
 
+#include <algorithm>
+#include <limits>
 #include <type_traits>
 
 LOV_NAMESPACE_BEGIN
@@ -65,6 +67,24 @@ inline constexpr bool is_integral_to_float_v = is_integral_to_float<From, To>::v
 template<typename From, typename To>
 inline constexpr bool is_integral_to_half_v = is_integral_to_half<From, To>::value;
 
+/*
+ * Converts a float already scaled to the range of the integral type. The max of U32 rounds up to
+ * 2^32 as a float, which overflows the cast, so U32 is rounded to nearest and saturated in double
+ * like the AVX512 conversion does
+ */
+template<typename To>
+LOV_FORCE_INLINE To float_to_integral(const float value) noexcept
+{
+    if constexpr (std::is_same_v<To, std::uint32_t>)
+    {
+        return static_cast<std::uint32_t>(std::min(static_cast<double>(value) + 0.5, 4294967295.0));
+    }
+    else
+    {
+        return static_cast<To>(value);
+    }
+}
+
 /******************************************/
 /* Scalar */
 /******************************************/
@@ -90,7 +110,7 @@ layer_convert_scalar_kernel(const From* __restrict from,
 
     for(std::size_t i = 0; i < size; ++i)
     {
-        to[i] = static_cast<To>(std::clamp(from[i], 0.0f, 1.0f) * m);
+        to[i] = float_to_integral<To>(std::clamp(from[i], 0.0f, 1.0f) * m);
     }
 }
 
@@ -116,7 +136,7 @@ layer_convert_scalar_kernel(const From* __restrict from,
 
     for(std::size_t i = 0; i < size; ++i)
     {
-        to[i] = static_cast<To>(std::clamp(static_cast<float>(from[i]), 0.0f, 1.0f) * m);
+        to[i] = float_to_integral<To>(std::clamp(static_cast<float>(from[i]), 0.0f, 1.0f) * m);
     }
 }
 
@@ -143,7 +163,7 @@ layer_convert_scalar_kernel(const From* __restrict from,
 
     for(std::size_t i = 0; i < size; ++i)
     {
-        to[i] = static_cast<To>(static_cast<float>(from[i]) * inv_m_f * m_t);
+        to[i] = float_to_integral<To>(static_cast<float>(from[i]) * inv_m_f * m_t);
     }
 }
 
@@ -272,6 +292,8 @@ layer_convert_sse_kernel(const From* __restrict from,
 {
     constexpr std::size_t width = 4;
 
+    const std::size_t simd_size = size - (size % width);
+
     constexpr float m = static_cast<float>(std::numeric_limits<To>::max());
 
     const __m128 m_128 = _mm_set1_ps(m);
@@ -280,7 +302,7 @@ layer_convert_sse_kernel(const From* __restrict from,
 
     std::size_t i = 0;
 
-    for(; i < size; i += width)
+    for(; i < simd_size; i += width)
     {
         __m128 f = _mm_load_ps(std::addressof(from[i]));
 
@@ -305,9 +327,9 @@ layer_convert_sse_kernel(const From* __restrict from,
         }
         else if constexpr (std::is_same_v<To, std::uint32_t>)
         {
-            for(; i < size; ++i)
+            for(std::size_t j = 0; j < width; j++)
             {
-                to[i] = static_cast<To>(std::clamp(from[i], 0.0f, 1.0f) * m);
+                to[i + j] = float_to_integral<To>(std::clamp(from[i + j], 0.0f, 1.0f) * m);
             }
         }
         else
@@ -318,7 +340,7 @@ layer_convert_sse_kernel(const From* __restrict from,
 
     for(; i < size; ++i)
     {
-        to[i] = static_cast<To>(std::clamp(from[i], 0.0f, 1.0f) * m);
+        to[i] = float_to_integral<To>(std::clamp(from[i], 0.0f, 1.0f) * m);
     }
 }
 
@@ -332,9 +354,11 @@ layer_convert_sse_kernel(const From* __restrict from,
     {
         constexpr std::size_t width = 4;
 
+        const std::size_t simd_size = size - (size % width);
+
         std::size_t i = 0;
 
-        for(; i < size; i += width)
+        for(; i < simd_size; i += width)
         {
             const __m128 f = _mm_load_ps(std::addressof(from[i]));
             const __m128i h = _mm_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
@@ -368,13 +392,15 @@ layer_convert_sse_kernel(const From* __restrict from,
     {
         constexpr std::size_t width = 4;
 
+        const std::size_t simd_size = size - (size % width);
+
         const __m128 m_128 = _mm_set1_ps(m);
         const __m128 zeros = _mm_set1_ps(0.0f);
         const __m128 ones = _mm_set1_ps(1.0f);
 
         std::size_t i = 0;
 
-        for(; i < size; i += width)
+        for(; i < simd_size; i += width)
         {
             const __m128i h = _mm_loadu_si64(std::addressof(from[i]));
             __m128 f = _mm_cvtph_ps(h);
@@ -400,9 +426,9 @@ layer_convert_sse_kernel(const From* __restrict from,
             }
             else if constexpr (std::is_same_v<To, std::uint32_t>)
             {
-                for(; i < size; ++i)
+                for(std::size_t j = 0; j < width; j++)
                 {
-                    to[i] = static_cast<To>(std::clamp(static_cast<float>(from[i]), 0.0f, 1.0f) * m);
+                    to[i + j] = float_to_integral<To>(std::clamp(static_cast<float>(from[i + j]), 0.0f, 1.0f) * m);
                 }
             }
             else
@@ -413,14 +439,14 @@ layer_convert_sse_kernel(const From* __restrict from,
 
         for(; i < size; ++i)
         {
-            to[i] = static_cast<To>(std::clamp(static_cast<float>(from[i]), 0.0f, 1.0f) * m);
+            to[i] = float_to_integral<To>(std::clamp(static_cast<float>(from[i]), 0.0f, 1.0f) * m);
         }
     }
     else
     {
         for(std::size_t i = 0; i < size; ++i)
         {
-            to[i] = static_cast<To>(std::clamp(static_cast<float>(from[i]), 0.0f, 1.0f) * m);
+            to[i] = float_to_integral<To>(std::clamp(static_cast<float>(from[i]), 0.0f, 1.0f) * m);
         }
     }
 }
@@ -435,9 +461,11 @@ layer_convert_sse_kernel(const From* __restrict from,
     {
         constexpr std::size_t width = 4;
 
+        const std::size_t simd_size = size - (size % width);
+
         std::size_t i = 0;
 
-        for(; i < size; i += width)
+        for(; i < simd_size; i += width)
         {
             const __m128i h = _mm_loadu_si64(std::addressof(from[i]));
             const __m128 f = _mm_cvtph_ps(h);
@@ -473,7 +501,7 @@ layer_convert_sse_kernel(const From* __restrict from,
 
     for(std::size_t i = 0; i < size; ++i)
     {
-        to[i] = static_cast<To>(static_cast<float>(from[i]) * inv_m_f * m_t);
+        to[i] = float_to_integral<To>(static_cast<float>(from[i]) * inv_m_f * m_t);
     }
 }
 
@@ -648,7 +676,7 @@ layer_convert_avx_kernel(const From* __restrict from,
             /* No support for unsigned int 32 with avx2 */
             for(std::size_t j = 0; j < width; j++)
             {
-                to[i + j] = static_cast<To>(std::clamp(from[i + j], 0.0f, 1.0f) * m);
+                to[i + j] = float_to_integral<To>(std::clamp(from[i + j], 0.0f, 1.0f) * m);
             }
         }
         else
@@ -659,7 +687,7 @@ layer_convert_avx_kernel(const From* __restrict from,
 
     for(; i < size; ++i)
     {
-        to[i] = static_cast<To>(std::clamp(from[i], 0.0f, 1.0f) * m);
+        to[i] = float_to_integral<To>(std::clamp(from[i], 0.0f, 1.0f) * m);
     }
 }
 
@@ -738,9 +766,9 @@ layer_convert_avx_kernel(const From* __restrict from,
             /* No support for unsigned int 32 with avx2 */
             for(std::size_t j = 0; j < width; j++)
             {
-                to[i + j] = static_cast<To>(std::clamp(static_cast<float>(from[i + j]),
-                                                       0.0f,
-                                                       1.0f) * m);
+                to[i + j] = float_to_integral<To>(std::clamp(static_cast<float>(from[i + j]),
+                                                             0.0f,
+                                                             1.0f) * m);
             }
         }
         else
@@ -751,9 +779,9 @@ layer_convert_avx_kernel(const From* __restrict from,
 
     for(; i < size; ++i)
     {
-        to[i] = static_cast<To>(std::clamp(static_cast<float>(from[i]),
-                                           0.0f,
-                                           1.0f) * m);
+        to[i] = float_to_integral<To>(std::clamp(static_cast<float>(from[i]),
+                                                 0.0f,
+                                                 1.0f) * m);
     }
 }
 
@@ -852,7 +880,7 @@ layer_convert_avx_kernel(const From* __restrict from,
             /* No support for unsigned int 32 with avx */
             for(std::size_t j = 0; j < width; j++)
             {
-                to[i + j] = static_cast<To>(static_cast<float>(from[i + j]) * inv_m * m);
+                to[i + j] = float_to_integral<To>(static_cast<float>(from[i + j]) * inv_m * m);
             }
         }
         else
@@ -863,7 +891,7 @@ layer_convert_avx_kernel(const From* __restrict from,
 
     for(; i < size; ++i)
     {
-        to[i] = static_cast<To>(static_cast<float>(from[i]) * inv_m * m);
+        to[i] = float_to_integral<To>(static_cast<float>(from[i]) * inv_m * m);
     }
 }
 
@@ -1201,44 +1229,422 @@ void layer_convert_avx2(const void* __restrict from,
 }
 
 /******************************************/
-/* Dispatcher */
+/* AVX512 */
 /******************************************/
 
-void Layer::convert(const std::uint8_t new_depth) noexcept
+/*
+ * The rest of the library is built for AVX2, these kernels are compiled for AVX512 on their own and
+ * only called when the cpu and the os support it
+ */
+#if defined(LOV_MSVC)
+#define LOV_AVX512_TARGET
+#else
+#define LOV_AVX512_TARGET __attribute__((target("avx512f,avx512bw,avx512vl")))
+#endif /* defined(LOV_MSVC) */
+
+bool cpu_has_avx512() noexcept
 {
-    if(new_depth == this->_depth)
+    static const bool has_avx512 = []() -> bool {
+#if defined(LOV_MSVC)
+        int info[4];
+
+        __cpuidex(info, 0, 0);
+
+        if(info[0] < 7)
+        {
+            return false;
+        }
+
+        /* The os must save the opmask and zmm registers (and xmm, ymm) */
+        __cpuidex(info, 1, 0);
+
+        if((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 0xE6) != 0xE6)
+        {
+            return false;
+        }
+
+        /* AVX512F, AVX512BW, AVX512VL */
+        constexpr std::uint32_t features = (1u << 16) | (1u << 30) | (1u << 31);
+
+        __cpuidex(info, 7, 0);
+
+        return (static_cast<std::uint32_t>(info[1]) & features) == features;
+#else
+        return __builtin_cpu_supports("avx512f") &&
+               __builtin_cpu_supports("avx512bw") &&
+               __builtin_cpu_supports("avx512vl");
+#endif /* defined(LOV_MSVC) */
+    }();
+
+    return has_avx512;
+}
+
+/* Selects the first count lanes, count being at most 16 */
+LOV_AVX512_TARGET LOV_FORCE_INLINE __mmask16 avx512_lanes_mask(const std::size_t count) noexcept
+{
+    return static_cast<__mmask16>((1u << count) - 1u);
+}
+
+/* Loads the selected lanes as floats, integers are not normalized */
+template<typename From>
+LOV_AVX512_TARGET LOV_FORCE_INLINE __m512 avx512_load_ps(const From* __restrict from,
+                                                         const __mmask16 mask) noexcept
+{
+    if constexpr (std::is_same_v<From, float>)
     {
-        return;
+        return _mm512_maskz_loadu_ps(mask, from);
+    }
+    else if constexpr (std::is_same_v<From, half>)
+    {
+        return _mm512_cvtph_ps(_mm256_maskz_loadu_epi16(mask, from));
+    }
+    else if constexpr (std::is_same_v<From, std::uint8_t>)
+    {
+        return _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_maskz_loadu_epi8(mask, from)));
+    }
+    else if constexpr (std::is_same_v<From, std::uint16_t>)
+    {
+        return _mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(_mm256_maskz_loadu_epi16(mask, from)));
+    }
+    else if constexpr (std::is_same_v<From, std::uint32_t>)
+    {
+        return _mm512_cvtepu32_ps(_mm512_maskz_loadu_epi32(mask, from));
+    }
+    else
+    {
+        static_assert(0, "From type not supported");
     }
+}
 
-    LOV_ASSERT(this->_data != nullptr, "Layer has not data loaded (data is nullptr)");
+/* Stores the selected lanes, floats are rounded and saturated for integers */
+template<typename To>
+LOV_AVX512_TARGET LOV_FORCE_INLINE void avx512_store_ps(To* __restrict to,
+                                                        const __m512 f,
+                                                        const __mmask16 mask) noexcept
+{
+    if constexpr (std::is_same_v<To, float>)
+    {
+        _mm512_mask_storeu_ps(to, mask, f);
+    }
+    else if constexpr (std::is_same_v<To, half>)
+    {
+        _mm256_mask_storeu_epi16(to, mask, _mm512_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    }
+    else if constexpr (std::is_same_v<To, std::uint8_t>)
+    {
+        _mm512_mask_cvtusepi32_storeu_epi8(to, mask, _mm512_cvtps_epu32(f));
+    }
+    else if constexpr (std::is_same_v<To, std::uint16_t>)
+    {
+        _mm512_mask_cvtusepi32_storeu_epi16(to, mask, _mm512_cvtps_epu32(f));
+    }
+    else if constexpr (std::is_same_v<To, std::uint32_t>)
+    {
+        _mm512_mask_storeu_epi32(to, mask, _mm512_cvtps_epu32(f));
+    }
+    else
+    {
+        static_assert(0, "To type not supported");
+    }
+}
 
-    void* new_data = stdromano::mem_aligned_alloc(this->nelements() * layer_depth_as_byte_size(new_depth),
-                                                  Layer::ALIGNMENT);
+template<typename From, typename To>
+std::enable_if_t<std::is_same_v<From, To>>
+layer_convert_avx512_kernel(const From* __restrict from,
+                            To* __restrict to,
+                            const std::size_t size) noexcept
+{
+    LOV_UNUSED(from);
+    LOV_UNUSED(to);
+    LOV_UNUSED(size);
+}
+
+/* Float and half to integral */
+template<typename From, typename To>
+LOV_AVX512_TARGET std::enable_if_t<is_float_to_integral_v<From, To> || is_half_to_integral_v<From, To>>
+layer_convert_avx512_kernel(const From* __restrict from,
+                            To* __restrict to,
+                            const std::size_t size) noexcept
+{
+    constexpr std::size_t width = 16;
+
+    const std::size_t simd_size = size - (size % width);
+
+    constexpr float m = static_cast<float>(std::numeric_limits<To>::max());
+
+    const __m512 m_512 = _mm512_set1_ps(m);
+    const __m512 zeros = _mm512_setzero_ps();
+    const __m512 ones = _mm512_set1_ps(1.0f);
+
+    std::size_t i = 0;
+
+    for(; i < size; i += width)
+    {
+        const __mmask16 mask = i < simd_size ? static_cast<__mmask16>(0xFFFF) : avx512_lanes_mask(size - i);
+
+        __m512 f = avx512_load_ps(std::addressof(from[i]), mask);
+
+        f = _mm512_max_ps(f, zeros);
+        f = _mm512_min_ps(f, ones);
+        f = _mm512_mul_ps(f, m_512);
+
+        avx512_store_ps(std::addressof(to[i]), f, mask);
+    }
+}
+
+/* Float to half and half to float */
+template<typename From, typename To>
+LOV_AVX512_TARGET std::enable_if_t<is_float_to_half_v<From, To> || is_half_to_float_v<From, To>>
+layer_convert_avx512_kernel(const From* __restrict from,
+                            To* __restrict to,
+                            const std::size_t size) noexcept
+{
+    constexpr std::size_t width = 16;
+
+    const std::size_t simd_size = size - (size % width);
+
+    std::size_t i = 0;
+
+    for(; i < size; i += width)
+    {
+        const __mmask16 mask = i < simd_size ? static_cast<__mmask16>(0xFFFF) : avx512_lanes_mask(size - i);
 
+        avx512_store_ps(std::addressof(to[i]), avx512_load_ps(std::addressof(from[i]), mask), mask);
+    }
+}
+
+/* Integral to integral, float and half */
+template<typename From, typename To>
+LOV_AVX512_TARGET std::enable_if_t<is_integral_to_integral_v<From, To> ||
+                                   is_integral_to_float_v<From, To> ||
+                                   is_integral_to_half_v<From, To>>
+layer_convert_avx512_kernel(const From* __restrict from,
+                            To* __restrict to,
+                            const std::size_t size) noexcept
+{
+    constexpr std::size_t width = 16;
+
+    const std::size_t simd_size = size - (size % width);
+
+    constexpr float inv_m = 1.0f / static_cast<float>(std::numeric_limits<From>::max());
+
+    const __m512 inv_m_512 = _mm512_set1_ps(inv_m);
+
+    std::size_t i = 0;
+
+    for(; i < size; i += width)
+    {
+        const __mmask16 mask = i < simd_size ? static_cast<__mmask16>(0xFFFF) : avx512_lanes_mask(size - i);
+
+        __m512 f = avx512_load_ps(std::addressof(from[i]), mask);
+
+        f = _mm512_mul_ps(f, inv_m_512);
+
+        if constexpr (std::is_integral_v<To>)
+        {
+            f = _mm512_mul_ps(f, _mm512_set1_ps(static_cast<float>(std::numeric_limits<To>::max())));
+        }
+
+        avx512_store_ps(std::addressof(to[i]), f, mask);
+    }
+}
+
+template<std::uint8_t from_depth>
+struct AVX512Dispatcher
+{
+    template<std::uint8_t to_depth>
+    static void dispatch_to(const void* __restrict from,
+                            void* __restrict to, const std::size_t size) noexcept
+    {
+        using FromType = depth_to_type_t<from_depth>;
+        using ToType = depth_to_type_t<to_depth>;
+
+        if constexpr (std::is_same_v<FromType, ToType>)
+        {
+            return;
+        }
+        else
+        {
+            layer_convert_avx512_kernel(static_cast<const FromType*>(from),
+                                        static_cast<ToType*>(to),
+                                        size);
+        }
+    }
+
+    static void dispatch(const void* __restrict from,
+                         void* __restrict to,
+                         std::uint8_t to_depth,
+                         std::size_t size) noexcept
+    {
+        switch(to_depth)
+        {
+            case LayerDepth_U8:
+                AVX512Dispatcher::dispatch_to<LayerDepth_U8>(from, to, size);
+                break;
+            case LayerDepth_U16:
+                AVX512Dispatcher::dispatch_to<LayerDepth_U16>(from, to, size);
+                break;
+            case LayerDepth_U32:
+                AVX512Dispatcher::dispatch_to<LayerDepth_U32>(from, to, size);
+                break;
+            case LayerDepth_F16:
+                AVX512Dispatcher::dispatch_to<LayerDepth_F16>(from, to, size);
+                break;
+            case LayerDepth_F32:
+                AVX512Dispatcher::dispatch_to<LayerDepth_F32>(from, to, size);
+                break;
+        }
+    }
+};
+
+void layer_convert_avx512(const void* __restrict from,
+                          void* __restrict to,
+                          std::uint8_t from_depth,
+                          std::uint8_t to_depth,
+                          const std::size_t size) noexcept
+{
+    switch(from_depth)
+    {
+        case LayerDepth_U8:
+            AVX512Dispatcher<LayerDepth_U8>::dispatch(from, to, to_depth, size);
+            break;
+        case LayerDepth_U16:
+            AVX512Dispatcher<LayerDepth_U16>::dispatch(from, to, to_depth, size);
+            break;
+        case LayerDepth_U32:
+            AVX512Dispatcher<LayerDepth_U32>::dispatch(from, to, to_depth, size);
+            break;
+        case LayerDepth_F16:
+            AVX512Dispatcher<LayerDepth_F16>::dispatch(from, to, to_depth, size);
+            break;
+        case LayerDepth_F32:
+            AVX512Dispatcher<LayerDepth_F32>::dispatch(from, to, to_depth, size);
+            break;
+    }
+}
+
+/******************************************/
+/* Dispatcher */
+/******************************************/
+
+void detail::layer_convert(const void* __restrict from,
+                           void* __restrict to,
+                           std::uint8_t from_depth,
+                           std::uint8_t to_depth,
+                           std::size_t size) noexcept
+{
     switch(stdromano::simd_get_vectorization_mode())
     {
         case stdromano::VectorizationMode_Scalar:
-            layer_convert_scalar(this->_data, new_data, this->_depth, new_depth, this->nelements());
+            layer_convert_scalar(from, to, from_depth, to_depth, size);
             break;
         case stdromano::VectorizationMode_SSE:
-            layer_convert_sse(this->_data, new_data, this->_depth, new_depth, this->nelements());
+            layer_convert_sse(from, to, from_depth, to_depth, size);
             break;
         case stdromano::VectorizationMode_AVX:
-            layer_convert_avx(this->_data, new_data, this->_depth, new_depth, this->nelements());
+            layer_convert_avx(from, to, from_depth, to_depth, size);
             break;
         case stdromano::VectorizationMode_AVX2:
-            layer_convert_avx2(this->_data, new_data, this->_depth, new_depth, this->nelements());
+            /* AVX512 is not a vectorization mode, it is used in place of AVX2 when available */
+            if(cpu_has_avx512())
+            {
+                layer_convert_avx512(from, to, from_depth, to_depth, size);
+            }
+            else
+            {
+                layer_convert_avx2(from, to, from_depth, to_depth, size);
+            }
             break;
         default:
-            layer_convert_scalar(this->_data, new_data, this->_depth, new_depth, this->nelements());
+            layer_convert_scalar(from, to, from_depth, to_depth, size);
             break;
     }
+}
+
+bool detail::layer_convert_tier(const void* __restrict from,
+                                void* __restrict to,
+                                std::uint8_t from_depth,
+                                std::uint8_t to_depth,
+                                std::size_t size,
+                                std::uint8_t tier) noexcept
+{
+    const int mode = stdromano::simd_get_vectorization_mode();
+
+    switch(tier)
+    {
+        case detail::LayerConvertTier_Scalar:
+            layer_convert_scalar(from, to, from_depth, to_depth, size);
+            return true;
+        case detail::LayerConvertTier_SSE:
+            if(mode < stdromano::VectorizationMode_SSE)
+            {
+                return false;
+            }
+
+            layer_convert_sse(from, to, from_depth, to_depth, size);
+            return true;
+        case detail::LayerConvertTier_AVX:
+            if(mode < stdromano::VectorizationMode_AVX)
+            {
+                return false;
+            }
+
+            layer_convert_avx(from, to, from_depth, to_depth, size);
+            return true;
+        case detail::LayerConvertTier_AVX2:
+            if(mode < stdromano::VectorizationMode_AVX2)
+            {
+                return false;
+            }
+
+            layer_convert_avx2(from, to, from_depth, to_depth, size);
+            return true;
+        case detail::LayerConvertTier_AVX512:
+            if(!cpu_has_avx512())
+            {
+                return false;
+            }
+
+            layer_convert_avx512(from, to, from_depth, to_depth, size);
+            return true;
+        default:
+            return false;
+    }
+}
+
+void Layer::convert(const std::uint8_t new_depth) noexcept
+{
+    if(new_depth == this->_depth)
+    {
+        return;
+    }
+
+    LOV_ASSERT(this->_data != nullptr, "Layer has not data loaded (data is nullptr)");
+
+    void* new_data = stdromano::mem_aligned_alloc(this->nelements() * layer_depth_as_byte_size(new_depth),
+                                                  Layer::ALIGNMENT);
+
+    const std::size_t from_size = layer_depth_as_byte_size(this->_depth);
+    const std::size_t to_size = layer_depth_as_byte_size(new_depth);
+
+    const std::uint8_t* from = this->data<std::uint8_t>();
+    std::uint8_t* to = static_cast<std::uint8_t*>(new_data);
+
+    detail::layer_parallel_for(this->nelements(),
+                               std::max(from_size, to_size),
+                               [&](std::size_t start, std::size_t count) {
+        detail::layer_convert(from + start * from_size,
+                              to + start * to_size,
+                              this->_depth,
+                              new_depth,
+                              count);
+    });
 
     stdromano::mem_aligned_free(this->_data);
 
     this->_data = new_data;
     this->_depth = new_depth;
+    this->_unmodified = false;
 }
 
 LOV_NAMESPACE_END
@@ -8,10 +8,20 @@
 #include "stdromano/simd.hpp"
 #include "stdromano/bits.hpp"
 
+#include <intrin.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <utility>
+
 LOV_NAMESPACE_BEGIN
 
 /*
- * TODO: do a mini jit-compiler for shuffle operations instead of this, will be much much more efficient
+ * Masks are resolved once per shuffle: the common ones have kernels generated at compile time, the
+ * others are turned into byte shuffle controls for the vector kernels
  */
 
 /* Layer shuffle */
@@ -225,13 +235,13 @@ void shuffle_scalar_kernel(const T* __restrict from,
 
                 case ShuffleChannel_AvgLum:
                 {
-                    dst_pixel[out_ch] = compute_avg_luminance(src_pixel);
+                    dst_pixel[out_ch] = nchannels >= 3 ? compute_avg_luminance(src_pixel) : src_pixel[0];
                     break;
                 }
 
                 case ShuffleChannel_WeightedLum:
                 {
-                    dst_pixel[out_ch] = compute_weighted_luminance(src_pixel);
+                    dst_pixel[out_ch] = nchannels >= 3 ? compute_weighted_luminance(src_pixel) : src_pixel[0];
                     break;
                 }
 
@@ -284,59 +294,656 @@ void shuffle_scalar(const void* __restrict from,
     }
 }
 
-/* SSE Shuffle */
+/* Specialized shuffle */
+
+/*
+ * Scalar kernels generated at compile time for the common masks, for every depth and number of
+ * input channels. The channels are resolved when compiling, the loop only moves the values and
+ * computes the luminance once per pixel
+ */
 
-void shuffle_sse(const void* __restrict from,
-                 void* __restrict to,
-                 std::uint32_t mask,
-                 std::int32_t width,
-                 std::int32_t height,
-                 std::uint8_t nchannels,
-                 std::uint8_t depth,
-                 std::uint8_t output_channels = 4) noexcept
+using ShuffleKernelFunc = void(*)(const void* __restrict, void* __restrict, std::size_t) noexcept;
+
+/* Same as build_shuffle_mask, evaluated when compiling */
+constexpr std::uint32_t shuffle_mask_constant(const char* mask, std::uint32_t nchannels_input) noexcept
 {
-    const char* _from = static_cast<const char*>(from);
-    char* _to = static_cast<char*>(to);
+    std::uint32_t bit_mask = 0;
+
+    for(std::uint32_t position = 0; mask[position] != '\0'; position++)
+    {
+        std::uint32_t channel_val = 0;
+
+        switch(mask[position])
+        {
+            case 'R':
+                channel_val = ShuffleChannel_R;
+                break;
+            case 'G':
+                channel_val = nchannels_input < 2 ? ShuffleChannel_0 : ShuffleChannel_G;
+                break;
+            case 'B':
+                channel_val = nchannels_input < 3 ? ShuffleChannel_0 : ShuffleChannel_B;
+                break;
+            case 'A':
+                channel_val = nchannels_input < 4 ? ShuffleChannel_1 : ShuffleChannel_A;
+                break;
+            case '0':
+                channel_val = ShuffleChannel_0;
+                break;
+            case '1':
+                channel_val = ShuffleChannel_1;
+                break;
+            case 'l':
+                channel_val = ShuffleChannel_WeightedLum;
+                break;
+            case 'L':
+                channel_val = ShuffleChannel_AvgLum;
+                break;
+            default:
+                break;
+        }
 
+        bit_mask |= channel_val << (8 * position);
+    }
 
+    return bit_mask;
 }
 
-/* AVX Shuffle */
+constexpr std::uint8_t shuffle_mask_length(const char* mask) noexcept
+{
+    std::uint8_t length = 0;
+
+    while(mask[length] != '\0')
+    {
+        length++;
+    }
+
+    return length;
+}
+
+constexpr bool shuffle_mask_has_channel(std::uint32_t mask, std::uint8_t channel) noexcept
+{
+    return ((mask & 0xFF) == channel) ||
+           (((mask >> 8) & 0xFF) == channel) ||
+           (((mask >> 16) & 0xFF) == channel) ||
+           (((mask >> 24) & 0xFF) == channel);
+}
+
+/* Display and export masks, in the case build_shuffle_mask accepts them */
+constexpr const char* SPECIALIZED_SHUFFLE_MASKS[] = {
+    "R", "G", "B", "A", "l", "L",
+    "RGB", "BGR", "RRR", "GGG", "BBB", "AAA", "lll", "LLL",
+    "RGBA", "BGRA", "RGB1", "BGR1", "RRR1", "GGG1", "BBB1", "AAA1", "lll1", "LLL1",
+};
+
+constexpr std::size_t NUM_SPECIALIZED_SHUFFLE_MASKS = sizeof(SPECIALIZED_SHUFFLE_MASKS) / sizeof(SPECIALIZED_SHUFFLE_MASKS[0]);
+
+constexpr std::uint8_t SPECIALIZED_SHUFFLE_DEPTHS[] = {
+    LayerDepth_U8,
+    LayerDepth_U16,
+    LayerDepth_U32,
+    LayerDepth_F16,
+    LayerDepth_F32,
+};
+
+constexpr std::size_t NUM_SPECIALIZED_SHUFFLE_DEPTHS = sizeof(SPECIALIZED_SHUFFLE_DEPTHS);
+
+template<typename T, std::uint8_t NChannels, std::uint8_t ChannelOp>
+LOV_FORCE_INLINE T shuffle_specialized_channel(const T* src, const T avg_lum, const T weighted_lum) noexcept
+{
+    if constexpr (ChannelOp == ShuffleChannel_R ||
+                  ChannelOp == ShuffleChannel_G ||
+                  ChannelOp == ShuffleChannel_B ||
+                  ChannelOp == ShuffleChannel_A)
+    {
+        constexpr std::uint8_t src_ch = ChannelOp == ShuffleChannel_R ? 0 :
+                                        ChannelOp == ShuffleChannel_G ? 1 :
+                                        ChannelOp == ShuffleChannel_B ? 2 :
+                                                                        3;
+
+        if constexpr (src_ch < NChannels)
+        {
+            return src[src_ch];
+        }
+        else
+        {
+            return get_zero_value<T>();
+        }
+    }
+    else if constexpr (ChannelOp == ShuffleChannel_1)
+    {
+        return get_one_value<T>();
+    }
+    else if constexpr (ChannelOp == ShuffleChannel_AvgLum)
+    {
+        return avg_lum;
+    }
+    else if constexpr (ChannelOp == ShuffleChannel_WeightedLum)
+    {
+        return weighted_lum;
+    }
+    else
+    {
+        return get_zero_value<T>();
+    }
+}
+
+template<typename T, std::uint8_t NChannels, std::uint32_t Mask, std::uint8_t OutputChannels>
+void shuffle_specialized_kernel(const void* __restrict from, void* __restrict to, std::size_t npixels) noexcept
+{
+    constexpr bool has_avg_lum = shuffle_mask_has_channel(Mask, ShuffleChannel_AvgLum);
+    constexpr bool has_weighted_lum = shuffle_mask_has_channel(Mask, ShuffleChannel_WeightedLum);
+
+    const T* src = static_cast<const T*>(from);
+    T* dst = static_cast<T*>(to);
+
+    for(std::size_t pixel = 0; pixel < npixels; ++pixel, src += NChannels, dst += OutputChannels)
+    {
+        /* The luminance of layers with less than 3 channels is their first channel */
+        T avg_lum = src[0];
+        T weighted_lum = src[0];
+
+        if constexpr (has_avg_lum && NChannels >= 3)
+        {
+            avg_lum = compute_avg_luminance(src);
+        }
+
+        if constexpr (has_weighted_lum && NChannels >= 3)
+        {
+            weighted_lum = compute_weighted_luminance(src);
+        }
+
+        dst[0] = shuffle_specialized_channel<T, NChannels, Mask & 0xFF>(src, avg_lum, weighted_lum);
+
+        if constexpr (OutputChannels > 1)
+        {
+            dst[1] = shuffle_specialized_channel<T, NChannels, (Mask >> 8) & 0xFF>(src, avg_lum, weighted_lum);
+        }
+
+        if constexpr (OutputChannels > 2)
+        {
+            dst[2] = shuffle_specialized_channel<T, NChannels, (Mask >> 16) & 0xFF>(src, avg_lum, weighted_lum);
+        }
+
+        if constexpr (OutputChannels > 3)
+        {
+            dst[3] = shuffle_specialized_channel<T, NChannels, (Mask >> 24) & 0xFF>(src, avg_lum, weighted_lum);
+        }
+    }
+}
+
+struct ShuffleKernelEntry
+{
+    std::uint32_t mask;
+    std::uint8_t depth;
+    std::uint8_t nchannels;
+    ShuffleKernelFunc func;
+};
+
+/* Entries are laid out by mask, then number of input channels, then depth */
+template<std::size_t I>
+constexpr ShuffleKernelEntry make_shuffle_kernel_entry() noexcept
+{
+    constexpr std::size_t mask_index = I / (4 * NUM_SPECIALIZED_SHUFFLE_DEPTHS);
+    constexpr std::uint8_t nchannels = static_cast<std::uint8_t>(1 + (I / NUM_SPECIALIZED_SHUFFLE_DEPTHS) % 4);
+    constexpr std::uint8_t depth = SPECIALIZED_SHUFFLE_DEPTHS[I % NUM_SPECIALIZED_SHUFFLE_DEPTHS];
+
+    constexpr std::uint32_t mask = shuffle_mask_constant(SPECIALIZED_SHUFFLE_MASKS[mask_index], nchannels);
+    constexpr std::uint8_t output_channels = shuffle_mask_length(SPECIALIZED_SHUFFLE_MASKS[mask_index]);
+
+    return { mask,
+             depth,
+             nchannels,
+             &shuffle_specialized_kernel<depth_to_type_t<depth>, nchannels, mask, output_channels> };
+}
+
+template<std::size_t... I>
+constexpr std::array<ShuffleKernelEntry, sizeof...(I)> make_shuffle_kernel_table(std::index_sequence<I...>) noexcept
+{
+    return {{ make_shuffle_kernel_entry<I>()... }};
+}
+
+static constexpr auto SHUFFLE_KERNELS = make_shuffle_kernel_table(std::make_index_sequence<NUM_SPECIALIZED_SHUFFLE_MASKS *
+                                                                                          4 *
+                                                                                          NUM_SPECIALIZED_SHUFFLE_DEPTHS>());
+
+constexpr std::size_t shuffle_kernel_index(std::size_t mask_index, std::uint8_t nchannels, std::size_t depth_index) noexcept
+{
+    return (mask_index * 4 + (nchannels - 1)) * NUM_SPECIALIZED_SHUFFLE_DEPTHS + depth_index;
+}
+
+/* Returns nullptr if no kernel has been generated for the mask */
+ShuffleKernelFunc find_shuffle_kernel(std::uint32_t mask, std::uint8_t nchannels, std::uint8_t depth) noexcept
+{
+    if(nchannels < 1 || nchannels > 4)
+    {
+        return nullptr;
+    }
+
+    std::size_t depth_index = 0;
+
+    while(depth_index < NUM_SPECIALIZED_SHUFFLE_DEPTHS && SPECIALIZED_SHUFFLE_DEPTHS[depth_index] != depth)
+    {
+        depth_index++;
+    }
+
+    if(depth_index == NUM_SPECIALIZED_SHUFFLE_DEPTHS)
+    {
+        return nullptr;
+    }
+
+    /* Only the masks of the number of channels and depth are compared, their kernel being indexed */
+    for(std::size_t mask_index = 0; mask_index < NUM_SPECIALIZED_SHUFFLE_MASKS; mask_index++)
+    {
+        const ShuffleKernelEntry& entry = SHUFFLE_KERNELS[shuffle_kernel_index(mask_index, nchannels, depth_index)];
+
+        if(entry.mask == mask)
+        {
+            return entry.func;
+        }
+    }
+
+    return nullptr;
+}
+
+/* SIMD shuffle */
+
+/*
+ * Shuffle of a group of pixels fitting in a vector, as a byte shuffle control: every byte of the
+ * output group is taken from the input group, or zeroed (0x80) for the constant channels whose
+ * bytes are ORed afterwards. The bytes of the vector past the group are zeroed
+ */
+struct ShuffleControl
+{
+    alignas(32) std::uint8_t bytes[32];
+    alignas(32) std::uint8_t constants[32];
+
+    std::size_t group_pixels;
+    std::size_t input_pixel_size;
+    std::size_t output_pixel_size;
+};
+
+/* Returns false if the mask computes a luminance, which is left to the scalar kernel */
+bool build_shuffle_control(std::uint32_t mask,
+                           std::uint8_t nchannels,
+                           std::uint8_t depth,
+                           std::uint8_t output_channels,
+                           std::size_t vector_size,
+                           ShuffleControl& control) noexcept
+{
+    const std::size_t channel_size = layer_depth_as_byte_size(depth);
+
+    if(channel_size == 0 || nchannels == 0 || output_channels == 0)
+    {
+        return false;
+    }
+
+    const std::uint32_t one = depth == LayerDepth_F16 ? 0x3C00u :
+                              depth == LayerDepth_F32 ? 0x3F800000u :
+                                                        0xFFFFFFFFu;
+
+    control.group_pixels = vector_size / (channel_size * std::max(nchannels, output_channels));
+    control.input_pixel_size = channel_size * nchannels;
+    control.output_pixel_size = channel_size * output_channels;
+
+    std::memset(control.bytes, 0x80, sizeof(control.bytes));
+    std::memset(control.constants, 0, sizeof(control.constants));
+
+    for(std::size_t i = 0; i < control.group_pixels * control.output_pixel_size; i++)
+    {
+        const std::size_t pixel = i / control.output_pixel_size;
+        const std::size_t channel = (i / channel_size) % output_channels;
+        const std::size_t byte = i % channel_size;
+
+        const std::uint8_t channel_op = static_cast<std::uint8_t>((mask >> (channel * 8)) & 0xFF);
+
+        switch(channel_op)
+        {
+            case ShuffleChannel_R:
+            case ShuffleChannel_G:
+            case ShuffleChannel_B:
+            case ShuffleChannel_A:
+            {
+                const std::size_t src_ch = static_cast<std::size_t>(stdromano::ctz_u64(static_cast<std::uint64_t>(channel_op)));
+
+                if(src_ch < nchannels)
+                {
+                    control.bytes[i] = static_cast<std::uint8_t>(pixel * control.input_pixel_size +
+                                                                 src_ch * channel_size +
+                                                                 byte);
+                }
+
+                break;
+            }
+
+            case ShuffleChannel_1:
+                control.constants[i] = static_cast<std::uint8_t>((one >> (byte * 8)) & 0xFF);
+                break;
+
+            case ShuffleChannel_AvgLum:
+            case ShuffleChannel_WeightedLum:
+                return false;
+
+            default:
+                break;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Kernel and controls of a shuffle, resolved once per layer shuffle and shared by all the ranges
+ * and chunks of pixels it is split into
+ */
+struct ShufflePlan
+{
+    std::uint32_t mask;
+    std::uint8_t nchannels;
+    std::uint8_t depth;
+    std::uint8_t output_channels;
+
+    std::uint32_t vectorization_mode;
+
+    /* Kernel generated for the mask, run instead of the vector ones when set */
+    ShuffleKernelFunc kernel;
+
+    std::size_t input_pixel_size;
+    std::size_t output_pixel_size;
 
-void shuffle_avx(const void* __restrict from,
-                 void* __restrict to,
-                 std::uint32_t mask,
-                 std::int32_t width,
-                 std::int32_t height,
-                 std::uint8_t nchannels,
-                 std::uint8_t depth,
-                 std::uint8_t output_channels = 4)
+    /* 16 bytes control, and the one of the AVX2 kernels (32 bytes for 4 bytes channels) */
+    bool has_sse_control;
+    bool has_avx2_control;
+
+    ShuffleControl sse_control;
+    ShuffleControl avx2_control;
+};
+
+void build_shuffle_plan(std::uint32_t mask,
+                        std::uint8_t nchannels,
+                        std::uint8_t depth,
+                        std::uint8_t output_channels,
+                        ShufflePlan& plan) noexcept
+{
+    plan.mask = mask;
+    plan.nchannels = nchannels;
+    plan.depth = depth;
+    plan.output_channels = output_channels;
+    plan.vectorization_mode = stdromano::simd_get_vectorization_mode();
+
+    plan.input_pixel_size = layer_depth_as_byte_size(depth) * nchannels;
+    plan.output_pixel_size = layer_depth_as_byte_size(depth) * output_channels;
+
+    /* Luminance masks are not vectorized, neither is anything without SIMD */
+    const ShuffleKernelFunc kernel = find_shuffle_kernel(mask, nchannels, depth);
+
+    const bool use_kernel = kernel != nullptr &&
+                            (plan.vectorization_mode == stdromano::VectorizationMode_Scalar ||
+                             shuffle_mask_has_channel(mask, ShuffleChannel_AvgLum) ||
+                             shuffle_mask_has_channel(mask, ShuffleChannel_WeightedLum));
+
+    plan.kernel = use_kernel ? kernel : nullptr;
+
+    plan.has_sse_control = false;
+    plan.has_avx2_control = false;
+
+    if(use_kernel || plan.vectorization_mode == stdromano::VectorizationMode_Scalar)
+    {
+        return;
+    }
+
+    plan.has_sse_control = build_shuffle_control(mask, nchannels, depth, output_channels, 16, plan.sse_control);
+
+    if(plan.vectorization_mode == stdromano::VectorizationMode_AVX2)
+    {
+        const bool is_dword = layer_depth_as_byte_size(depth) == 4;
+
+        plan.has_avx2_control = build_shuffle_control(mask,
+                                                      nchannels,
+                                                      depth,
+                                                      output_channels,
+                                                      is_dword ? 32 : 16,
+                                                      plan.avx2_control);
+    }
+}
+
+/*
+ * The vector kernels load and store whole vectors, which can go past the group. The next group
+ * overwrites the extra bytes written, and the kernels stop early enough to stay in the buffers,
+ * returning the number of pixels shuffled. The remaining ones go through the narrower kernels
+ */
+
+std::size_t shuffle_sse_kernel(const std::uint8_t* __restrict from,
+                               std::uint8_t* __restrict to,
+                               const std::size_t npixels,
+                               const ShuffleControl& control) noexcept
+{
+    const __m128i bytes = _mm_load_si128(reinterpret_cast<const __m128i*>(control.bytes));
+    const __m128i constants = _mm_load_si128(reinterpret_cast<const __m128i*>(control.constants));
+
+    const std::size_t input_size = npixels * control.input_pixel_size;
+    const std::size_t output_size = npixels * control.output_pixel_size;
+
+    std::size_t pixel = 0;
+
+    for(; pixel * control.input_pixel_size + 16 <= input_size &&
+          pixel * control.output_pixel_size + 16 <= output_size;
+        pixel += control.group_pixels)
+    {
+        const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from + pixel * control.input_pixel_size));
+        const __m128i out = _mm_or_si128(_mm_shuffle_epi8(in, bytes), constants);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(to + pixel * control.output_pixel_size), out);
+    }
+
+    return pixel;
+}
+
+/* Byte shuffles only work within 128 bits lanes, so each lane shuffles its own group */
+std::size_t shuffle_avx2_lanes_kernel(const std::uint8_t* __restrict from,
+                                      std::uint8_t* __restrict to,
+                                      const std::size_t npixels,
+                                      const ShuffleControl& control) noexcept
+{
+    const __m256i bytes = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(control.bytes)));
+    const __m256i constants = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(control.constants)));
+
+    const std::size_t input_group_size = control.group_pixels * control.input_pixel_size;
+    const std::size_t output_group_size = control.group_pixels * control.output_pixel_size;
+
+    const std::size_t input_size = npixels * control.input_pixel_size;
+    const std::size_t output_size = npixels * control.output_pixel_size;
+
+    std::size_t pixel = 0;
+
+    for(; pixel * control.input_pixel_size + input_group_size + 16 <= input_size &&
+          pixel * control.output_pixel_size + output_group_size + 16 <= output_size;
+        pixel += 2 * control.group_pixels)
+    {
+        const std::uint8_t* src = from + pixel * control.input_pixel_size;
+        std::uint8_t* dst = to + pixel * control.output_pixel_size;
+
+        const __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src))),
+                                                   _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + input_group_size)),
+                                                   1);
+
+        const __m256i out = _mm256_or_si256(_mm256_shuffle_epi8(in, bytes), constants);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm256_castsi256_si128(out));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + output_group_size), _mm256_extracti128_si256(out, 1));
+    }
+
+    return pixel;
+}
+
+/* 4 bytes channels are permuted across the whole register, control being built for 32 bytes */
+std::size_t shuffle_avx2_permute_kernel(const std::uint8_t* __restrict from,
+                                        std::uint8_t* __restrict to,
+                                        const std::size_t npixels,
+                                        const ShuffleControl& control) noexcept
+{
+    alignas(32) std::int32_t indices[8];
+    alignas(32) std::int32_t keep[8];
+
+    for(std::size_t i = 0; i < 8; i++)
+    {
+        const bool is_zeroed = (control.bytes[i * 4] & 0x80) != 0;
+
+        indices[i] = is_zeroed ? 0 : control.bytes[i * 4] / 4;
+        keep[i] = is_zeroed ? 0 : -1;
+    }
+
+    const __m256i indices_256 = _mm256_load_si256(reinterpret_cast<const __m256i*>(indices));
+    const __m256i keep_256 = _mm256_load_si256(reinterpret_cast<const __m256i*>(keep));
+    const __m256i constants = _mm256_load_si256(reinterpret_cast<const __m256i*>(control.constants));
+
+    const std::size_t input_size = npixels * control.input_pixel_size;
+    const std::size_t output_size = npixels * control.output_pixel_size;
+
+    std::size_t pixel = 0;
+
+    for(; pixel * control.input_pixel_size + 32 <= input_size &&
+          pixel * control.output_pixel_size + 32 <= output_size;
+        pixel += control.group_pixels)
+    {
+        const __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(from + pixel * control.input_pixel_size));
+
+        const __m256i out = _mm256_or_si256(_mm256_and_si256(_mm256_permutevar8x32_epi32(in, indices_256), keep_256),
+                                            constants);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(to + pixel * control.output_pixel_size), out);
+    }
+
+    return pixel;
+}
+
+/* SSE Shuffle */
+
+void shuffle_sse(const std::uint8_t* __restrict from,
+                 std::uint8_t* __restrict to,
+                 const std::size_t npixels,
+                 const ShufflePlan& plan) noexcept
 {
-    const char* _from = static_cast<const char*>(from);
-    char* _to = static_cast<char*>(to);
+    std::size_t pixel = 0;
+
+    if(plan.has_sse_control)
+    {
+        pixel = shuffle_sse_kernel(from, to, npixels, plan.sse_control);
+    }
 
+    if(pixel < npixels)
+    {
+        shuffle_scalar(from + pixel * plan.input_pixel_size,
+                       to + pixel * plan.output_pixel_size,
+                       plan.mask,
+                       static_cast<std::int32_t>(npixels - pixel),
+                       1,
+                       plan.nchannels,
+                       plan.depth,
+                       plan.output_channels);
+    }
+}
 
+/* AVX Shuffle */
+
+/* AVX has no 256 bits integer shuffles, the SSE kernel is used with its VEX encoding */
+void shuffle_avx(const std::uint8_t* __restrict from,
+                 std::uint8_t* __restrict to,
+                 const std::size_t npixels,
+                 const ShufflePlan& plan) noexcept
+{
+    shuffle_sse(from, to, npixels, plan);
 }
 
 /* AVX2 Shuffle */
 
-void shuffle_avx2(const void* __restrict from,
-                  void* __restrict to,
-                  std::uint32_t mask,
-                  std::int32_t width,
-                  std::int32_t height,
-                  std::uint8_t nchannels,
-                  std::uint8_t depth,
-                  std::uint8_t output_channels = 4)
+void shuffle_avx2(const std::uint8_t* __restrict from,
+                  std::uint8_t* __restrict to,
+                  const std::size_t npixels,
+                  const ShufflePlan& plan) noexcept
 {
-    const char* _from = static_cast<const char*>(from);
-    char* _to = static_cast<char*>(to);
+    if(!plan.has_avx2_control)
+    {
+        shuffle_scalar(from,
+                       to,
+                       plan.mask,
+                       static_cast<std::int32_t>(npixels),
+                       1,
+                       plan.nchannels,
+                       plan.depth,
+                       plan.output_channels);
+        return;
+    }
 
+    const bool is_dword = layer_depth_as_byte_size(plan.depth) == 4;
 
+    const std::size_t pixel = is_dword ? shuffle_avx2_permute_kernel(from, to, npixels, plan.avx2_control) :
+                                         shuffle_avx2_lanes_kernel(from, to, npixels, plan.avx2_control);
+
+    if(pixel < npixels)
+    {
+        shuffle_sse(from + pixel * plan.input_pixel_size,
+                    to + pixel * plan.output_pixel_size,
+                    npixels - pixel,
+                    plan);
+    }
 }
 
 /* Dispatcher */
 
+void layer_shuffle_planned(const void* __restrict from,
+                           void* __restrict to,
+                           std::size_t npixels,
+                           const ShufflePlan& plan) noexcept
+{
+    const std::uint8_t* _from = static_cast<const std::uint8_t*>(from);
+    std::uint8_t* _to = static_cast<std::uint8_t*>(to);
+
+    if(plan.kernel != nullptr)
+    {
+        plan.kernel(from, to, npixels);
+        return;
+    }
+
+    switch(plan.vectorization_mode)
+    {
+        case stdromano::VectorizationMode_Scalar:
+        default:
+            shuffle_scalar(from,
+                           to,
+                           plan.mask,
+                           static_cast<std::int32_t>(npixels),
+                           1,
+                           plan.nchannels,
+                           plan.depth,
+                           plan.output_channels);
+            break;
+        case stdromano::VectorizationMode_SSE:
+            shuffle_sse(_from, _to, npixels, plan);
+            break;
+        case stdromano::VectorizationMode_AVX:
+            shuffle_avx(_from, _to, npixels, plan);
+            break;
+        case stdromano::VectorizationMode_AVX2:
+            shuffle_avx2(_from, _to, npixels, plan);
+            break;
+    }
+}
+
+void detail::layer_shuffle(const void* __restrict from,
+                           void* __restrict to,
+                           std::uint32_t bit_mask,
+                           std::size_t npixels,
+                           std::uint8_t nchannels,
+                           std::uint8_t depth,
+                           std::uint8_t output_channels) noexcept
+{
+    ShufflePlan plan;
+    build_shuffle_plan(bit_mask, nchannels, depth, output_channels, plan);
+
+    layer_shuffle_planned(from, to, npixels, plan);
+}
+
 void Layer::shuffle(const stdromano::StringD& mask) noexcept
 {
     auto [bit_mask, mask_size] = build_shuffle_mask(mask, this->_nchannels);
@@ -348,74 +955,188 @@ void Layer::shuffle(const stdromano::StringD& mask) noexcept
 
     LOV_ASSERT(this->_data != nullptr, "Layer has not data loaded (data is nullptr)");
 
-    const std::size_t new_data_size = this->_parent->get_data_width() *
-                                      this->_parent->get_data_height() *
+    const std::size_t new_data_size = this->npixels() *
                                       layer_depth_as_byte_size(this->_depth) *
                                       mask_size;
 
     void* new_data = stdromano::mem_aligned_alloc(new_data_size, Layer::ALIGNMENT);
 
-#if 1
-    shuffle_scalar(this->_data,
-                   new_data,
-                   bit_mask,
-                   this->_parent->get_data_width(),
-                   this->_parent->get_data_height(),
-                   this->_nchannels,
-                   this->_depth,
-                   static_cast<std::uint8_t>(mask_size));
-#else
-    switch(stdromano::simd_get_vectorization_mode())
+    const std::size_t depth_size = layer_depth_as_byte_size(this->_depth);
+    const std::size_t input_pixel_size = depth_size * this->_nchannels;
+    const std::size_t output_pixel_size = depth_size * mask_size;
+
+    const std::uint8_t* from = this->data<std::uint8_t>();
+    std::uint8_t* to = static_cast<std::uint8_t*>(new_data);
+
+    ShufflePlan plan;
+    build_shuffle_plan(static_cast<std::uint32_t>(bit_mask),
+                       this->_nchannels,
+                       this->_depth,
+                       static_cast<std::uint8_t>(mask_size),
+                       plan);
+
+    detail::layer_parallel_for(this->npixels(),
+                               std::max(input_pixel_size, output_pixel_size),
+                               [&](std::size_t start, std::size_t count) {
+        layer_shuffle_planned(from + start * input_pixel_size,
+                              to + start * output_pixel_size,
+                              count,
+                              plan);
+    });
+
+    stdromano::mem_aligned_free(this->_data);
+    this->_data = new_data;
+    this->_nchannels = mask_size;
+    this->_unmodified = false;
+}
+
+/* Fused shuffle and convert */
+
+/*
+ * Pixels are shuffled and converted by chunks small enough to stay in L1 between the two steps, so
+ * the source and the destination are each streamed once
+ */
+static constexpr std::size_t SHUFFLE_CONVERT_CHUNK_PIXELS = 1024;
+
+/* plan is nullptr when the channels are kept as they are */
+void layer_shuffle_convert(const std::uint8_t* __restrict from,
+                           std::uint8_t* __restrict to,
+                           const ShufflePlan* plan,
+                           std::size_t npixels,
+                           std::uint8_t nchannels,
+                           std::uint8_t depth,
+                           std::uint8_t output_channels,
+                           std::uint8_t new_depth) noexcept
+{
+    /* 4 channels of 4 bytes at most */
+    alignas(32) std::uint8_t shuffled[SHUFFLE_CONVERT_CHUNK_PIXELS * 16];
+    alignas(32) std::uint8_t converted[SHUFFLE_CONVERT_CHUNK_PIXELS * 16];
+
+    const std::size_t input_pixel_size = layer_depth_as_byte_size(depth) * nchannels;
+    const std::size_t output_pixel_size = layer_depth_as_byte_size(new_depth) * output_channels;
+
+    /* The conversion kernels use aligned accesses, unaligned destinations go through a copy */
+    const bool is_aligned = (reinterpret_cast<std::uintptr_t>(to) % 32) == 0;
+
+    for(std::size_t start = 0; start < npixels; start += SHUFFLE_CONVERT_CHUNK_PIXELS)
     {
-        case stdromano::VectorizationMode_Scalar:
-            shuffle_scalar(this->_data,
-                           new_data,
-                           bit_mask,
-                           this->_parent->get_data_width(),
-                           this->_parent->get_data_height(),
+        const std::size_t count = std::min(SHUFFLE_CONVERT_CHUNK_PIXELS, npixels - start);
+
+        const std::uint8_t* src = from + start * input_pixel_size;
+        std::uint8_t* dst = to + start * output_pixel_size;
+
+        if(new_depth == depth)
+        {
+            if(plan != nullptr)
+            {
+                layer_shuffle_planned(src, dst, count, *plan);
+            }
+            else
+            {
+                std::memcpy(dst, src, count * output_pixel_size);
+            }
+
+            continue;
+        }
+
+        const std::uint8_t* convert_from = src;
+
+        if(plan != nullptr)
+        {
+            layer_shuffle_planned(src, shuffled, count, *plan);
+            convert_from = shuffled;
+        }
+
+        detail::layer_convert(convert_from,
+                              is_aligned ? dst : converted,
+                              depth,
+                              new_depth,
+                              count * output_channels);
+
+        if(!is_aligned)
+        {
+            std::memcpy(dst, converted, count * output_pixel_size);
+        }
+    }
+}
+
+bool Layer::shuffle_convert(const stdromano::StringD& mask,
+                            const std::uint8_t new_depth,
+                            void* to) const noexcept
+{
+    LOV_ASSERT(this->_data != nullptr, "Layer has not data loaded (data is nullptr)");
+
+    std::int32_t bit_mask = 0;
+    std::size_t mask_size = this->_nchannels;
+
+    if(!mask.empty())
+    {
+        std::tie(bit_mask, mask_size) = build_shuffle_mask(mask, this->_nchannels);
+
+        if(bit_mask == 0)
+        {
+            return false;
+        }
+    }
+
+    const std::size_t input_pixel_size = layer_depth_as_byte_size(this->_depth) * this->_nchannels;
+    const std::size_t output_pixel_size = layer_depth_as_byte_size(new_depth) * mask_size;
+
+    const std::uint8_t* from = this->data<std::uint8_t>();
+    std::uint8_t* dst = static_cast<std::uint8_t*>(to);
+
+    ShufflePlan plan;
+
+    if(bit_mask != 0)
+    {
+        build_shuffle_plan(static_cast<std::uint32_t>(bit_mask),
                            this->_nchannels,
                            this->_depth,
-                           static_cast<std::uint8_t>(mask_size));
-            break;
-        case stdromano::VectorizationMode_SSE:
-            shuffle_sse(this->_data,
-                        new_data,
-                        bit_mask,
-                        this->_parent->get_data_width(),
-                        this->_parent->get_data_height(),
-                        this->_nchannels,
-                        this->_depth,
-                        static_cast<std::uint8_t>(mask_size));
-            break;
-        case stdromano::VectorizationMode_AVX:
-            shuffle_avx(this->_data,
-                        new_data,
-                        bit_mask,
-                        this->_parent->get_data_width(),
-                        this->_parent->get_data_height(),
-                        this->_nchannels,
-                        this->_depth,
-                        static_cast<std::uint8_t>(mask_size));
-            break;
-        case stdromano::VectorizationMode_AVX2:
-            shuffle_avx2(this->_data,
-                         new_data,
-                         bit_mask,
-                         this->_parent->get_data_width(),
-                         this->_parent->get_data_height(),
-                         this->_nchannels,
-                         this->_depth,
-                         static_cast<std::uint8_t>(mask_size));
-            break;
-        default:
-            break;
+                           static_cast<std::uint8_t>(mask_size),
+                           plan);
+    }
+
+    detail::layer_parallel_for(this->npixels(),
+                               std::max(input_pixel_size, output_pixel_size),
+                               [&](std::size_t start, std::size_t count) {
+        layer_shuffle_convert(from + start * input_pixel_size,
+                              dst + start * output_pixel_size,
+                              bit_mask != 0 ? &plan : nullptr,
+                              count,
+                              this->_nchannels,
+                              this->_depth,
+                              static_cast<std::uint8_t>(mask_size),
+                              new_depth);
+    });
+
+    return true;
+}
+
+bool Layer::shuffle_convert(const stdromano::StringD& mask, const std::uint8_t new_depth) noexcept
+{
+    const std::size_t mask_size = mask.empty() ? this->_nchannels : mask.size();
+
+    if(mask.empty() && new_depth == this->_depth)
+    {
+        return true;
+    }
+
+    void* new_data = stdromano::mem_aligned_alloc(this->npixels() * mask_size * layer_depth_as_byte_size(new_depth),
+                                                  Layer::ALIGNMENT);
+
+    if(!this->shuffle_convert(mask, new_depth, new_data))
+    {
+        stdromano::mem_aligned_free(new_data);
+        return false;
     }
-#endif
 
     stdromano::mem_aligned_free(this->_data);
     this->_data = new_data;
-    this->_nchannels = mask_size;
-}
+    this->_nchannels = static_cast<std::uint8_t>(mask_size);
+    this->_depth = new_depth;
+    this->_unmodified = false;
 
+    return true;
+}
 
 LOV_NAMESPACE_END
@@ -0,0 +1,585 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+#include "OpenViewer/mapped_file.hpp"
+
+#include "stdromano/logger.hpp"
+#include "stdromano/vector.hpp"
+
+#if defined(LOV_WIN)
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif /* defined(LOV_WIN) */
+
+#include <algorithm>
+#include <cstring>
+
+LOV_NAMESPACE_BEGIN
+
+/* LazyMemoryFile */
+
+std::shared_ptr<const void> LazyMemoryFile::get() noexcept
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    if(this->_data == nullptr)
+    {
+        this->_data = this->_load();
+    }
+
+    return this->_data;
+}
+
+/* MemoryFiles */
+
+MemoryFiles::MemoryFiles() : _next_id(0)
+{
+}
+
+MemoryFiles& MemoryFiles::get_instance() noexcept
+{
+    static MemoryFiles memory_files;
+
+    return memory_files;
+}
+
+bool MemoryFiles::is_memory_path(const stdromano::StringD& path) noexcept
+{
+    return path.startswith(MemoryFiles::PATH_PREFIX);
+}
+
+stdromano::StringD MemoryFiles::add(std::shared_ptr<const void> data,
+                                    std::size_t size,
+                                    const stdromano::StringD& extension) noexcept
+{
+    return this->add_entry(Entry{ data, size, std::weak_ptr<LazyMemoryFile>() }, extension);
+}
+
+stdromano::StringD MemoryFiles::add(std::shared_ptr<LazyMemoryFile> file,
+                                    std::size_t size,
+                                    const stdromano::StringD& extension) noexcept
+{
+    return this->add_entry(Entry{ std::weak_ptr<const void>(), size, file }, extension);
+}
+
+stdromano::StringD MemoryFiles::add_entry(Entry&& new_entry, const stdromano::StringD& extension) noexcept
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    /* Forget the buffers nobody references anymore */
+    stdromano::Vector<stdromano::StringD> expired;
+
+    for(const auto& [path, entry] : this->_entries)
+    {
+        if(entry.data.expired() && entry.lazy.expired())
+        {
+            expired.push_back(path.copy());
+        }
+    }
+
+    for(const auto& path : expired)
+    {
+        this->_entries.erase(path);
+    }
+
+    const stdromano::StringD path = extension.empty() ?
+                                         stdromano::StringD("{}{}", MemoryFiles::PATH_PREFIX, this->_next_id) :
+                                         stdromano::StringD("{}{}.{}",
+                                                            MemoryFiles::PATH_PREFIX,
+                                                            this->_next_id,
+                                                            extension);
+
+    this->_next_id++;
+
+    this->_entries.emplace(path.copy(), std::move(new_entry));
+
+    return path;
+}
+
+std::shared_ptr<const void> MemoryFiles::find(const stdromano::StringD& path, std::size_t& size) const noexcept
+{
+    std::shared_ptr<LazyMemoryFile> lazy;
+
+    {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+
+        auto it = this->_entries.find(path);
+
+        if(it == this->_entries.end())
+        {
+            return nullptr;
+        }
+
+        size = it->second.size;
+
+        lazy = it->second.lazy.lock();
+
+        if(lazy == nullptr)
+        {
+            return it->second.data.lock();
+        }
+    }
+
+    /* Loading can be slow (inflating), the other buffers stay available meanwhile */
+    return lazy->get();
+}
+
+/* MappedFileScope */
+
+struct ScopedMapping
+{
+    stdromano::StringD path;
+    std::shared_ptr<const MappedFile> mapping;
+};
+
+static thread_local ScopedMapping scoped_mapping;
+
+MappedFileScope::MappedFileScope(const stdromano::StringD& path,
+                                 std::shared_ptr<const MappedFile> mapping) noexcept
+{
+    this->_previous_path = std::move(scoped_mapping.path);
+    this->_previous_mapping = std::move(scoped_mapping.mapping);
+
+    scoped_mapping.path = path.copy();
+    scoped_mapping.mapping = std::move(mapping);
+}
+
+MappedFileScope::~MappedFileScope() noexcept
+{
+    scoped_mapping.path = std::move(this->_previous_path);
+    scoped_mapping.mapping = std::move(this->_previous_mapping);
+}
+
+/* MappedFile */
+
+MappedFile::MappedFile() : _data(nullptr),
+                           _size(0)
+#if defined(LOV_WIN)
+                           , _file_handle(nullptr),
+                           _mapping_handle(nullptr)
+#endif /* defined(LOV_WIN) */
+{
+}
+
+MappedFile::MappedFile(const stdromano::StringD& path, std::uint8_t hint) : MappedFile()
+{
+    this->open(path, hint);
+}
+
+MappedFile::~MappedFile() noexcept
+{
+    this->close();
+}
+
+bool MappedFile::open_memory(const stdromano::StringD& path) noexcept
+{
+    std::size_t size = 0;
+
+    this->_memory = MemoryFiles::get_instance().find(path, size);
+
+    if(this->_memory == nullptr)
+    {
+        stdromano::log_error("No buffer is registered under \"{}\"", path);
+        return false;
+    }
+
+    this->_data = static_cast<const std::uint8_t*>(this->_memory.get());
+    this->_size = size;
+
+    return true;
+}
+
+bool MappedFile::open_scoped(const stdromano::StringD& path) noexcept
+{
+    const std::shared_ptr<const MappedFile>& mapping = scoped_mapping.mapping;
+
+    if(mapping == nullptr ||
+       !mapping->is_open() ||
+       std::strcmp(scoped_mapping.path.c_str(), path.c_str()) != 0)
+    {
+        return false;
+    }
+
+    /* Aliases the scoped mapping, which stays mapped as long as this file references it */
+    this->_memory = std::shared_ptr<const void>(mapping, mapping->data());
+    this->_data = mapping->data();
+    this->_size = mapping->size();
+
+    return true;
+}
+
+#if defined(LOV_WIN)
+bool MappedFile::open(const stdromano::StringD& path, std::uint8_t hint) noexcept
+{
+    this->close();
+
+    if(this->open_scoped(path))
+    {
+        return true;
+    }
+
+    if(MemoryFiles::is_memory_path(path))
+    {
+        return this->open_memory(path);
+    }
+
+    const DWORD flags = hint == MappedFileHint_Sequential ? FILE_FLAG_SEQUENTIAL_SCAN :
+                                                            FILE_FLAG_RANDOM_ACCESS;
+
+    HANDLE file = CreateFileA(path.c_str(),
+                              GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE,
+                              nullptr,
+                              OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | flags,
+                              nullptr);
+
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        stdromano::log_error("Cannot open file \"{}\" for mapping", path);
+        return false;
+    }
+
+    LARGE_INTEGER size;
+
+    if(!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        stdromano::log_error("Cannot map empty file \"{}\"", path);
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    if(mapping == nullptr)
+    {
+        stdromano::log_error("Cannot create file mapping of \"{}\"", path);
+        CloseHandle(file);
+        return false;
+    }
+
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+    if(data == nullptr)
+    {
+        stdromano::log_error("Cannot map file \"{}\"", path);
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    this->_file_handle = file;
+    this->_mapping_handle = mapping;
+    this->_data = static_cast<const std::uint8_t*>(data);
+    this->_size = static_cast<std::size_t>(size.QuadPart);
+
+    return true;
+}
+
+void MappedFile::close() noexcept
+{
+    if(this->_memory != nullptr)
+    {
+        this->_memory.reset();
+    }
+    else if(this->_data != nullptr)
+    {
+        UnmapViewOfFile(this->_data);
+        CloseHandle(this->_mapping_handle);
+        CloseHandle(this->_file_handle);
+    }
+
+    this->_data = nullptr;
+    this->_size = 0;
+    this->_file_handle = nullptr;
+    this->_mapping_handle = nullptr;
+}
+
+void MappedFile::advise(std::uint8_t hint) noexcept
+{
+    /* Access pattern can only be given when opening the file on Windows */
+    LOV_UNUSED(hint);
+}
+#else
+bool MappedFile::open(const stdromano::StringD& path, std::uint8_t hint) noexcept
+{
+    this->close();
+
+    if(this->open_scoped(path))
+    {
+        return true;
+    }
+
+    if(MemoryFiles::is_memory_path(path))
+    {
+        return this->open_memory(path);
+    }
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+
+    if(fd < 0)
+    {
+        stdromano::log_error("Cannot open file \"{}\" for mapping", path);
+        return false;
+    }
+
+    struct stat st;
+
+    if(fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        stdromano::log_error("Cannot map empty file \"{}\"", path);
+        ::close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+    /* The mapping keeps its own reference to the file */
+    ::close(fd);
+
+    if(data == MAP_FAILED)
+    {
+        stdromano::log_error("Cannot map file \"{}\"", path);
+        return false;
+    }
+
+    this->_data = static_cast<const std::uint8_t*>(data);
+    this->_size = static_cast<std::size_t>(st.st_size);
+
+    this->advise(hint);
+
+    return true;
+}
+
+void MappedFile::close() noexcept
+{
+    if(this->_memory != nullptr)
+    {
+        this->_memory.reset();
+    }
+    else if(this->_data != nullptr)
+    {
+        munmap(const_cast<std::uint8_t*>(this->_data), this->_size);
+    }
+
+    this->_data = nullptr;
+    this->_size = 0;
+}
+
+void MappedFile::advise(std::uint8_t hint) noexcept
+{
+    if(this->_data == nullptr || this->_memory != nullptr)
+    {
+        return;
+    }
+
+    const int advice = hint == MappedFileHint_Sequential ? POSIX_MADV_SEQUENTIAL :
+                                                           POSIX_MADV_RANDOM;
+
+    posix_madvise(const_cast<std::uint8_t*>(this->_data), this->_size, advice);
+}
+#endif /* defined(LOV_WIN) */
+
+/* FileReader */
+
+#if defined(LOV_WIN)
+FileReader::FileReader() : _handle(nullptr)
+{
+}
+
+bool FileReader::open(const stdromano::StringD& path) noexcept
+{
+    this->close();
+
+    HANDLE file = CreateFileA(path.c_str(),
+                              GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr,
+                              OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS,
+                              nullptr);
+
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        stdromano::log_error("Cannot open file \"{}\" for reading", path);
+        return false;
+    }
+
+    this->_handle = file;
+
+    return true;
+}
+
+void FileReader::close() noexcept
+{
+    if(this->_handle != nullptr)
+    {
+        CloseHandle(this->_handle);
+    }
+
+    this->_handle = nullptr;
+}
+
+bool FileReader::is_open() const noexcept
+{
+    return this->_handle != nullptr;
+}
+
+std::uint64_t FileReader::size() const noexcept
+{
+    LARGE_INTEGER size;
+
+    if(this->_handle == nullptr || !GetFileSizeEx(this->_handle, &size))
+    {
+        return 0;
+    }
+
+    return static_cast<std::uint64_t>(size.QuadPart);
+}
+
+std::uint64_t FileReader::identity() const noexcept
+{
+    BY_HANDLE_FILE_INFORMATION information;
+
+    if(this->_handle == nullptr || !GetFileInformationByHandle(this->_handle, &information))
+    {
+        return 0;
+    }
+
+    const std::uint64_t index = static_cast<std::uint64_t>(information.nFileIndexHigh) << 32 |
+                                static_cast<std::uint64_t>(information.nFileIndexLow);
+
+    return index ^ static_cast<std::uint64_t>(information.dwVolumeSerialNumber) << 40;
+}
+
+std::size_t FileReader::read(std::uint64_t offset, void* buffer, std::size_t size) const noexcept
+{
+    std::size_t read_size = 0;
+
+    while(read_size < size)
+    {
+        /* The offset is given with each read, the file pointer shared by the threads is not used */
+        OVERLAPPED overlapped;
+        std::memset(&overlapped, 0, sizeof(OVERLAPPED));
+        overlapped.Offset = static_cast<DWORD>(offset + read_size);
+        overlapped.OffsetHigh = static_cast<DWORD>((offset + read_size) >> 32);
+
+        const DWORD chunk_size = static_cast<DWORD>(std::min(size - read_size, static_cast<std::size_t>(1) << 30));
+
+        DWORD chunk_read_size = 0;
+
+        if(!ReadFile(this->_handle,
+                     static_cast<std::uint8_t*>(buffer) + read_size,
+                     chunk_size,
+                     &chunk_read_size,
+                     &overlapped) || chunk_read_size == 0)
+        {
+            break;
+        }
+
+        read_size += static_cast<std::size_t>(chunk_read_size);
+    }
+
+    return read_size;
+}
+#else
+FileReader::FileReader() : _fd(-1)
+{
+}
+
+bool FileReader::open(const stdromano::StringD& path) noexcept
+{
+    this->close();
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+
+    if(fd < 0)
+    {
+        stdromano::log_error("Cannot open file \"{}\" for reading", path);
+        return false;
+    }
+
+    this->_fd = fd;
+
+    return true;
+}
+
+void FileReader::close() noexcept
+{
+    if(this->_fd >= 0)
+    {
+        ::close(this->_fd);
+    }
+
+    this->_fd = -1;
+}
+
+bool FileReader::is_open() const noexcept
+{
+    return this->_fd >= 0;
+}
+
+std::uint64_t FileReader::size() const noexcept
+{
+    struct stat st;
+
+    if(this->_fd < 0 || fstat(this->_fd, &st) != 0)
+    {
+        return 0;
+    }
+
+    return static_cast<std::uint64_t>(st.st_size);
+}
+
+std::uint64_t FileReader::identity() const noexcept
+{
+    struct stat st;
+
+    if(this->_fd < 0 || fstat(this->_fd, &st) != 0)
+    {
+        return 0;
+    }
+
+    return static_cast<std::uint64_t>(st.st_ino) ^ static_cast<std::uint64_t>(st.st_dev) << 40;
+}
+
+std::size_t FileReader::read(std::uint64_t offset, void* buffer, std::size_t size) const noexcept
+{
+    std::size_t read_size = 0;
+
+    while(read_size < size)
+    {
+        const ssize_t result = pread(this->_fd,
+                                     static_cast<std::uint8_t*>(buffer) + read_size,
+                                     size - read_size,
+                                     static_cast<off_t>(offset + read_size));
+
+        if(result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if(result <= 0)
+        {
+            break;
+        }
+
+        read_size += static_cast<std::size_t>(result);
+    }
+
+    return read_size;
+}
+#endif /* defined(LOV_WIN) */
+
+FileReader::~FileReader() noexcept
+{
+    this->close();
+}
+
+LOV_NAMESPACE_END
@@ -0,0 +1,276 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+#include "OpenViewer/sequence_prefetcher.hpp"
+#include "OpenViewer/thread_pool.hpp"
+
+#include "stdromano/logger.hpp"
+
+#include <algorithm>
+
+LOV_NAMESPACE_BEGIN
+
+SequencePrefetcher::SequencePrefetcher(const stdromano::Vector<stdromano::StringD>& frame_paths,
+                                       std::int32_t first_frame,
+                                       std::uint32_t num_frames_ahead) : _frame_paths(frame_paths),
+                                                                         _first_frame(first_frame),
+                                                                         _playhead(first_frame),
+                                                                         _num_frames_ahead(num_frames_ahead),
+                                                                         _num_pending(0),
+                                                                         _direction(PlaybackDirection_Forward),
+                                                                         _stop(false)
+{
+}
+
+SequencePrefetcher::SequencePrefetcher(const ImageSequence& sequence,
+                                       std::uint32_t num_frames_ahead) : SequencePrefetcher(sequence.frame_paths(),
+                                                                                            sequence.first_frame(),
+                                                                                            num_frames_ahead)
+{
+}
+
+SequencePrefetcher::~SequencePrefetcher() noexcept
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    this->_stop = true;
+
+    /* Queued work still references the prefetcher, wait for it to drain */
+    this->_cv.wait(lock, [this]() { return this->_num_pending == 0; });
+}
+
+bool SequencePrefetcher::is_in_window(std::int32_t frame) const noexcept
+{
+    const std::int32_t num_frames = static_cast<std::int32_t>(this->_frame_paths.size());
+
+    if(num_frames == 0 || frame < this->first_frame() || frame > this->last_frame())
+    {
+        return false;
+    }
+
+    std::int32_t distance = this->_direction == PlaybackDirection_Forward ? frame - this->_playhead :
+                                                                            this->_playhead - frame;
+
+    if(distance < 0)
+    {
+        distance += num_frames;
+    }
+
+    return static_cast<std::uint32_t>(distance) <= this->_num_frames_ahead;
+}
+
+void SequencePrefetcher::schedule_frames() noexcept
+{
+    const std::int32_t num_frames = static_cast<std::int32_t>(this->_frame_paths.size());
+
+    if(num_frames == 0)
+    {
+        return;
+    }
+
+    /* Drop the loaded frames that fell behind the playhead, in-flight ones clean up themselves */
+    stdromano::Vector<std::int32_t> frames_to_drop;
+
+    for(const auto& it : this->_frames)
+    {
+        if(it.second.state == FrameState_Ready && !this->is_in_window(it.first))
+        {
+            frames_to_drop.push_back(it.first);
+        }
+    }
+
+    for(const std::int32_t frame : frames_to_drop)
+    {
+        this->_frames.erase(frame);
+    }
+
+    const std::int32_t step = this->_direction == PlaybackDirection_Forward ? 1 : -1;
+
+    const std::uint32_t num_frames_to_schedule = std::min(this->_num_frames_ahead,
+                                                          static_cast<std::uint32_t>(num_frames - 1));
+
+    for(std::uint32_t i = 0; i <= num_frames_to_schedule; i++)
+    {
+        std::int32_t frame = (this->_playhead - this->_first_frame + step * static_cast<std::int32_t>(i)) %
+                             num_frames;
+
+        if(frame < 0)
+        {
+            frame += num_frames;
+        }
+
+        frame += this->_first_frame;
+
+        if(this->_frames.find(frame) != this->_frames.end())
+        {
+            continue;
+        }
+
+        this->_frames.emplace(frame, PrefetchedFrame{ nullptr, FrameState_Queued });
+        this->_num_pending++;
+
+        ThreadPool::get_global_threadpool().add_work([this, frame]() { this->load_frame(frame); });
+    }
+}
+
+std::shared_ptr<Image> SequencePrefetcher::load_image(std::int32_t frame,
+                                                      const stdromano::Vector<stdromano::StringD>& layers) const noexcept
+{
+    const stdromano::StringD& path = this->_frame_paths[frame - this->_first_frame];
+
+    if(path.empty())
+    {
+        return nullptr;
+    }
+
+    std::shared_ptr<Image> image = std::make_shared<Image>(path);
+
+    if(!image->is_valid())
+    {
+        return nullptr;
+    }
+
+    const bool loaded = layers.empty() ? image->load_all_layers() : image->load_layers(layers);
+
+    if(!loaded)
+    {
+        stdromano::log_error("Error while prefetching frame {} ({})", frame, path);
+        return nullptr;
+    }
+
+    return image;
+}
+
+void SequencePrefetcher::load_frame(std::int32_t frame) noexcept
+{
+    /* set_layers may change them while the frame is decoded */
+    stdromano::Vector<stdromano::StringD> layers;
+
+    {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+
+        auto it = this->_frames.find(frame);
+
+        /* The frame has been taken by get_frame or is not needed anymore */
+        if(this->_stop || it == this->_frames.end() || it->second.state != FrameState_Queued ||
+           !this->is_in_window(frame))
+        {
+            if(it != this->_frames.end() && it->second.state == FrameState_Queued)
+            {
+                this->_frames.erase(frame);
+            }
+
+            this->_num_pending--;
+            this->_cv.notify_all();
+
+            return;
+        }
+
+        it->second.state = FrameState_Loading;
+
+        layers = this->_layers;
+    }
+
+    std::shared_ptr<Image> image = this->load_image(frame, layers);
+
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    auto it = this->_frames.find(frame);
+
+    if(it != this->_frames.end())
+    {
+        it->second.image = std::move(image);
+        it->second.state = FrameState_Ready;
+    }
+
+    this->_num_pending--;
+    this->_cv.notify_all();
+}
+
+void SequencePrefetcher::set_layers(const stdromano::Vector<stdromano::StringD>& layers) noexcept
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    this->_layers = layers;
+}
+
+void SequencePrefetcher::set_direction(std::uint8_t direction) noexcept
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    this->_direction = direction;
+    this->schedule_frames();
+}
+
+void SequencePrefetcher::set_num_frames_ahead(std::uint32_t num_frames_ahead) noexcept
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    this->_num_frames_ahead = num_frames_ahead;
+    this->schedule_frames();
+}
+
+void SequencePrefetcher::set_playhead(std::int32_t frame) noexcept
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    this->_playhead = frame;
+    this->schedule_frames();
+}
+
+std::shared_ptr<Image> SequencePrefetcher::get_frame(std::int32_t frame) noexcept
+{
+    if(frame < this->first_frame() || frame > this->last_frame())
+    {
+        stdromano::log_error("Frame {} is out of the sequence range [{}, {}]",
+                             frame,
+                             this->first_frame(),
+                             this->last_frame());
+        return nullptr;
+    }
+
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    this->_playhead = frame;
+    this->schedule_frames();
+
+    auto it = this->_frames.find(frame);
+
+    /* Decode it ourselves rather than waiting for its turn in the pool queue */
+    if(it->second.state == FrameState_Queued)
+    {
+        it->second.state = FrameState_Loading;
+
+        const stdromano::Vector<stdromano::StringD> layers = this->_layers;
+
+        lock.unlock();
+
+        std::shared_ptr<Image> image = this->load_image(frame, layers);
+
+        lock.lock();
+
+        it = this->_frames.find(frame);
+
+        if(it != this->_frames.end())
+        {
+            it->second.image = image;
+            it->second.state = FrameState_Ready;
+        }
+
+        this->_cv.notify_all();
+
+        return image;
+    }
+
+    this->_cv.wait(lock, [this, frame]() {
+        const auto frame_it = this->_frames.find(frame);
+        return frame_it == this->_frames.end() || frame_it->second.state == FrameState_Ready;
+    });
+
+    it = this->_frames.find(frame);
+
+    return it != this->_frames.end() ? it->second.image : nullptr;
+}
+
+LOV_NAMESPACE_END
@@ -0,0 +1,159 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+#include "OpenViewer/thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+LOV_NAMESPACE_BEGIN
+
+ThreadPool::ThreadPool(std::uint32_t num_threads) : _stop(false)
+{
+    if(num_threads == 0)
+    {
+        const std::uint32_t hw_threads = std::thread::hardware_concurrency();
+        num_threads = hw_threads > 1 ? hw_threads - 1 : 1;
+    }
+
+    this->_workers.reserve(num_threads);
+
+    for(std::uint32_t i = 0; i < num_threads; i++)
+    {
+        this->_workers.emplace_back([this]() { this->worker_loop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() noexcept
+{
+    {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        this->_stop = true;
+    }
+
+    this->_cv.notify_all();
+
+    for(std::thread& worker : this->_workers)
+    {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::get_global_threadpool() noexcept
+{
+    static ThreadPool pool;
+
+    return pool;
+}
+
+void ThreadPool::worker_loop() noexcept
+{
+    while(true)
+    {
+        std::function<void()> work;
+
+        {
+            std::unique_lock<std::mutex> lock(this->_mutex);
+
+            this->_cv.wait(lock, [this]() { return this->_stop || !this->_work.empty(); });
+
+            if(this->_stop && this->_work.empty())
+            {
+                return;
+            }
+
+            work = std::move(this->_work.front());
+            this->_work.pop_front();
+        }
+
+        work();
+    }
+}
+
+void ThreadPool::add_work(std::function<void()>&& work) noexcept
+{
+    {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        this->_work.push_back(std::move(work));
+    }
+
+    this->_cv.notify_one();
+}
+
+/*
+ * Helpers pull indices from a shared counter, and only the caller waits for the completion of
+ * all the indices. Helpers that start late (because the pool is busy) find no index left and
+ * return without touching func, so nested calls never deadlock
+ */
+struct ParallelForState
+{
+    const std::function<void(std::size_t)>* func;
+    std::size_t count;
+
+    std::atomic<std::size_t> next;
+    std::atomic<std::size_t> done;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    ParallelForState(const std::function<void(std::size_t)>* func,
+                     std::size_t count) : func(func),
+                                          count(count),
+                                          next(0),
+                                          done(0) {}
+
+    void run() noexcept
+    {
+        std::size_t i;
+
+        while((i = this->next.fetch_add(1, std::memory_order_relaxed)) < this->count)
+        {
+            (*this->func)(i);
+
+            if(this->done.fetch_add(1, std::memory_order_acq_rel) + 1 == this->count)
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->cv.notify_all();
+            }
+        }
+    }
+};
+
+void ThreadPool::parallel_for(std::size_t count, const std::function<void(std::size_t)>& func) noexcept
+{
+    if(count == 0)
+    {
+        return;
+    }
+
+    if(count == 1 || this->_workers.empty())
+    {
+        for(std::size_t i = 0; i < count; i++)
+        {
+            func(i);
+        }
+
+        return;
+    }
+
+    std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>(&func, count);
+
+    const std::size_t num_helpers = std::min(static_cast<std::size_t>(this->_workers.size()),
+                                             count - 1);
+
+    for(std::size_t i = 0; i < num_helpers; i++)
+    {
+        this->add_work([state]() { state->run(); });
+    }
+
+    state->run();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait(lock, [&state]() {
+        return state->done.load(std::memory_order_acquire) == state->count;
+    });
+}
+
+LOV_NAMESPACE_END
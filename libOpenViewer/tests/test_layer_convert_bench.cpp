@@ -0,0 +1,292 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+/*
+ * Converts the same values with every tier of the layer conversion kernels supported by the cpu,
+ * checks that they agree with the scalar kernels, then times the AVX2 and AVX512 tiers on a large
+ * buffer
+ */
+
+#include "OpenViewer/image.hpp"
+
+#include "stdromano/logger.hpp"
+#include "stdromano/memory.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+static constexpr std::uint8_t DEPTHS[] = {
+    LOV::LayerDepth_U8,
+    LOV::LayerDepth_U16,
+    LOV::LayerDepth_U32,
+    LOV::LayerDepth_F16,
+    LOV::LayerDepth_F32,
+};
+
+static constexpr std::uint8_t TIERS[] = {
+    LOV::detail::LayerConvertTier_Scalar,
+    LOV::detail::LayerConvertTier_SSE,
+    LOV::detail::LayerConvertTier_AVX,
+    LOV::detail::LayerConvertTier_AVX2,
+    LOV::detail::LayerConvertTier_AVX512,
+};
+
+static constexpr const char* TIER_NAMES[] = { "scalar", "sse", "avx", "avx2", "avx512" };
+
+/* Sizes around the vector widths, for the tails of the kernels */
+static constexpr std::size_t CHECK_SIZES[] = { 1, 7, 15, 16, 17, 31, 33, 1000, 1023 };
+static constexpr std::size_t MAX_CHECK_SIZE = 1023;
+
+static constexpr std::size_t BENCH_SIZE = 4096 * 4096;
+static constexpr std::uint32_t BENCH_RUNS = 5;
+
+/* Converting no value only tells whether the cpu supports the tier */
+static bool is_tier_supported(std::uint8_t tier) noexcept
+{
+    std::uint8_t from = 0;
+    std::uint16_t to = 0;
+
+    return LOV::detail::layer_convert_tier(&from, &to, LOV::LayerDepth_U8, LOV::LayerDepth_U16, 0, tier);
+}
+
+/* Deterministic values, floats slightly out of [0, 1] to exercise the clamping */
+static void fill_values(void* data, std::uint8_t depth, std::size_t size) noexcept
+{
+    std::uint32_t state = 0x9E3779B9u;
+
+    for(std::size_t i = 0; i < size; i++)
+    {
+        state = state * 1664525u + 1013904223u;
+
+        const float f = static_cast<float>(state >> 8) / static_cast<float>(1u << 24) * 1.2f - 0.1f;
+
+        switch(depth)
+        {
+            case LOV::LayerDepth_U8:
+                static_cast<std::uint8_t*>(data)[i] = static_cast<std::uint8_t>(state >> 24);
+                break;
+            case LOV::LayerDepth_U16:
+                static_cast<std::uint16_t*>(data)[i] = static_cast<std::uint16_t>(state >> 16);
+                break;
+            case LOV::LayerDepth_U32:
+                static_cast<std::uint32_t*>(data)[i] = state;
+                break;
+            case LOV::LayerDepth_F16:
+                static_cast<half*>(data)[i] = static_cast<half>(f);
+                break;
+            default:
+                static_cast<float*>(data)[i] = f;
+                break;
+        }
+    }
+}
+
+static double get_value(const void* data, std::uint8_t depth, std::size_t i) noexcept
+{
+    switch(depth)
+    {
+        case LOV::LayerDepth_U8:
+            return static_cast<double>(static_cast<const std::uint8_t*>(data)[i]);
+        case LOV::LayerDepth_U16:
+            return static_cast<double>(static_cast<const std::uint16_t*>(data)[i]);
+        case LOV::LayerDepth_U32:
+            return static_cast<double>(static_cast<const std::uint32_t*>(data)[i]);
+        case LOV::LayerDepth_F16:
+            return static_cast<double>(static_cast<float>(static_cast<const half*>(data)[i]));
+        default:
+            return static_cast<double>(static_cast<const float*>(data)[i]);
+    }
+}
+
+/*
+ * The vector kernels round to nearest where the scalar ones truncate, and U32 is computed in
+ * float, whose precision at 2^32 is 256
+ */
+static double tolerance(std::uint8_t depth, double expected) noexcept
+{
+    switch(depth)
+    {
+        case LOV::LayerDepth_U8:
+        case LOV::LayerDepth_U16:
+            return 1.0;
+        case LOV::LayerDepth_U32:
+            return 512.0;
+        default:
+            return 1e-3 * std::max(1.0, std::fabs(expected));
+    }
+}
+
+/* Returns the number of values differing from the scalar kernels, over all the sizes */
+static std::size_t check_tier(std::uint8_t tier, std::uint8_t from_depth, std::uint8_t to_depth) noexcept
+{
+    const std::size_t to_size = LOV::layer_depth_as_byte_size(to_depth);
+
+    void* from = stdromano::mem_aligned_alloc(MAX_CHECK_SIZE * sizeof(float), 64);
+    void* expected = stdromano::mem_aligned_alloc(MAX_CHECK_SIZE * sizeof(float), 64);
+    void* result = stdromano::mem_aligned_alloc((MAX_CHECK_SIZE + 16) * sizeof(float), 64);
+
+    std::size_t num_failures = 0;
+
+    for(const std::size_t size : CHECK_SIZES)
+    {
+        fill_values(from, from_depth, size);
+
+        /* The bytes past the converted values must not be written */
+        std::memset(result, 0xAB, (MAX_CHECK_SIZE + 16) * sizeof(float));
+
+        LOV::detail::layer_convert_tier(from, expected, from_depth, to_depth, size, LOV::detail::LayerConvertTier_Scalar);
+        LOV::detail::layer_convert_tier(from, result, from_depth, to_depth, size, tier);
+
+        for(std::size_t i = 0; i < size; i++)
+        {
+            const double e = get_value(expected, to_depth, i);
+            const double r = get_value(result, to_depth, i);
+
+            if(std::fabs(e - r) > tolerance(to_depth, e))
+            {
+                if(num_failures < 4)
+                {
+                    stdromano::log_error("{} conversion {} -> {} of {} values differs at {}: {} instead of {}",
+                                         TIER_NAMES[tier],
+                                         from_depth,
+                                         to_depth,
+                                         size,
+                                         i,
+                                         r,
+                                         e);
+                }
+
+                num_failures++;
+            }
+        }
+
+        const std::uint8_t* tail = static_cast<const std::uint8_t*>(result) + size * to_size;
+
+        for(std::size_t i = 0; i < 16 * sizeof(float); i++)
+        {
+            if(tail[i] != 0xAB)
+            {
+                stdromano::log_error("{} conversion {} -> {} of {} values writes past the end",
+                                     TIER_NAMES[tier],
+                                     from_depth,
+                                     to_depth,
+                                     size);
+
+                num_failures++;
+                break;
+            }
+        }
+    }
+
+    stdromano::mem_aligned_free(from);
+    stdromano::mem_aligned_free(expected);
+    stdromano::mem_aligned_free(result);
+
+    return num_failures;
+}
+
+/* Best time of a few runs, in milliseconds, converting by blocks like Layer::convert does */
+static double bench_tier(std::uint8_t tier,
+                         std::uint8_t from_depth,
+                         std::uint8_t to_depth,
+                         const void* from,
+                         void* to) noexcept
+{
+    constexpr std::size_t block_size = 65536;
+
+    const std::size_t from_size = LOV::layer_depth_as_byte_size(from_depth);
+    const std::size_t to_size = LOV::layer_depth_as_byte_size(to_depth);
+
+    double best_time = 0.0;
+
+    for(std::uint32_t run = 0; run < BENCH_RUNS; run++)
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        for(std::size_t i = 0; i < BENCH_SIZE; i += block_size)
+        {
+            LOV::detail::layer_convert_tier(static_cast<const std::uint8_t*>(from) + i * from_size,
+                                            static_cast<std::uint8_t*>(to) + i * to_size,
+                                            from_depth,
+                                            to_depth,
+                                            std::min(block_size, BENCH_SIZE - i),
+                                            tier);
+        }
+
+        const double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        best_time = run == 0 ? time : std::min(best_time, time);
+    }
+
+    return best_time;
+}
+
+int main()
+{
+    std::size_t num_failures = 0;
+
+    for(const std::uint8_t tier : TIERS)
+    {
+        if(!is_tier_supported(tier))
+        {
+            stdromano::log_debug("Skipping the {} tier, not supported by the cpu", TIER_NAMES[tier]);
+            continue;
+        }
+
+        for(const std::uint8_t from_depth : DEPTHS)
+        {
+            for(const std::uint8_t to_depth : DEPTHS)
+            {
+                if(from_depth != to_depth)
+                {
+                    num_failures += check_tier(tier, from_depth, to_depth);
+                }
+            }
+        }
+    }
+
+    void* from = stdromano::mem_aligned_alloc(BENCH_SIZE * sizeof(float), 64);
+    void* to = stdromano::mem_aligned_alloc(BENCH_SIZE * sizeof(float), 64);
+
+    const std::uint8_t bench_pairs[][2] = {
+        { LOV::LayerDepth_F32, LOV::LayerDepth_U8 },
+        { LOV::LayerDepth_F32, LOV::LayerDepth_U32 },
+        { LOV::LayerDepth_F32, LOV::LayerDepth_F16 },
+        { LOV::LayerDepth_F16, LOV::LayerDepth_F32 },
+        { LOV::LayerDepth_F16, LOV::LayerDepth_U8 },
+        { LOV::LayerDepth_U8, LOV::LayerDepth_F32 },
+        { LOV::LayerDepth_U16, LOV::LayerDepth_U8 },
+    };
+
+    for(const auto& pair : bench_pairs)
+    {
+        fill_values(from, pair[0], BENCH_SIZE);
+
+        for(const std::uint8_t tier : { LOV::detail::LayerConvertTier_AVX2, LOV::detail::LayerConvertTier_AVX512 })
+        {
+            if(!is_tier_supported(tier))
+            {
+                continue;
+            }
+
+            const double time = bench_tier(tier, pair[0], pair[1], from, to);
+
+            stdromano::log_debug("{} conversion {} -> {}: {:.2f} ms ({:.2f} Gvalues/s)",
+                                 TIER_NAMES[tier],
+                                 pair[0],
+                                 pair[1],
+                                 time,
+                                 static_cast<double>(BENCH_SIZE) / (time * 1e6));
+        }
+    }
+
+    stdromano::mem_aligned_free(from);
+    stdromano::mem_aligned_free(to);
+
+    stdromano::log_debug("Layer conversion tiers: {} differences with the scalar kernels", num_failures);
+
+    return num_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2022 - Present Romain Augier
+// All rights reserved.
+
+/*
+ * Decodes the same files from all the threads of the pool at once, some of them truncated so the
+ * codecs report errors meanwhile. Meant to be built with THREADSAN: the codecs, their per-thread
+ * contexts and the caches shared between the images must not race
+ */
+
+#include "OpenViewer/image.hpp"
+#include "OpenViewer/thread_pool.hpp"
+
+#include "stdromano/logger.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+static constexpr std::int32_t WIDTH = 256;
+static constexpr std::int32_t HEIGHT = 128;
+static constexpr std::uint8_t NCHANNELS = 4;
+
+static std::uint8_t pattern_value(std::int32_t x, std::int32_t y, std::uint32_t c) noexcept
+{
+    return static_cast<std::uint8_t>((x + y * 3 + c * 7) & 0xFF);
+}
+
+/* Writes an image filled with the pattern, with the given depth */
+static bool write_pattern_image(const stdromano::StringD& path, std::uint8_t depth) noexcept
+{
+    const Imath::Box2i window(Imath::V2i(0, 0), Imath::V2i(WIDTH - 1, HEIGHT - 1));
+
+    LOV::Image image(window, window);
+
+    LOV::Layer* layer = image.create_layer(LOV::Image::MAIN_LAYER_NAME, depth, NCHANNELS);
+    layer->allocate(layer->nbytes());
+
+    for(std::int32_t y = 0; y < HEIGHT; y++)
+    {
+        for(std::int32_t x = 0; x < WIDTH; x++)
+        {
+            for(std::uint32_t c = 0; c < NCHANNELS; c++)
+            {
+                const std::size_t index = (static_cast<std::size_t>(y) * WIDTH + x) * NCHANNELS + c;
+
+                if(depth == LOV::LayerDepth_U8)
+                {
+                    layer->data<std::uint8_t>()[index] = pattern_value(x, y, c);
+                }
+                else
+                {
+                    layer->data<float>()[index] = static_cast<float>(pattern_value(x, y, c)) / 255.0f;
+                }
+            }
+        }
+    }
+
+    return image.write(path);
+}
+
+/* Writes the start of the file up to its header, which the readers have to fail on */
+static bool write_truncated_copy(const std::filesystem::path& from, const std::filesystem::path& to) noexcept
+{
+    std::ifstream input(from, std::ios::binary);
+    const std::string bytes((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+    std::ofstream output(to, std::ios::binary);
+    output.write(bytes.data(), static_cast<std::streamsize>(std::min(bytes.size(), static_cast<std::size_t>(64))));
+
+    return input.good() || input.eof() ? output.good() : false;
+}
+
+/* Reads the main layer, or a region of it, and compares it to the pattern */
+static bool decode_pattern_image(const stdromano::StringD& path, std::uint8_t depth, bool use_roi) noexcept
+{
+    LOV::Image image(path);
+
+    if(!image.is_valid())
+    {
+        return false;
+    }
+
+    const Imath::Box2i roi(Imath::V2i(WIDTH / 4, HEIGHT / 4), Imath::V2i(WIDTH / 2, HEIGHT / 2));
+
+    const LOV::Layer* layer = use_roi ? image.get_layer(LOV::Image::MAIN_LAYER_NAME, roi) :
+                                        image.get_layer(LOV::Image::MAIN_LAYER_NAME);
+
+    if(layer == nullptr || layer->depth() != depth || layer->nchannels() != NCHANNELS)
+    {
+        return false;
+    }
+
+    /* Released variants are read again, from the frame cache or the file */
+    if(use_roi)
+    {
+        image.release_variants(LOV::Image::MAIN_LAYER_NAME);
+
+        layer = image.get_layer(LOV::Image::MAIN_LAYER_NAME, roi);
+
+        if(layer == nullptr || layer->depth() != depth || layer->nchannels() != NCHANNELS)
+        {
+            return false;
+        }
+    }
+
+    const Imath::Box2i& window = layer->window();
+
+    for(std::int32_t y = window.min.y; y <= window.max.y; y++)
+    {
+        for(std::int32_t x = window.min.x; x <= window.max.x; x++)
+        {
+            for(std::uint32_t c = 0; c < NCHANNELS; c++)
+            {
+                const std::size_t index = (static_cast<std::size_t>(y - window.min.y) * layer->width() +
+                                           static_cast<std::size_t>(x - window.min.x)) * NCHANNELS + c;
+
+                const float value = depth == LOV::LayerDepth_U8 ?
+                                        static_cast<float>(layer->data<std::uint8_t>()[index]) :
+                                        layer->data<float>()[index] * 255.0f;
+
+                if(value != static_cast<float>(pattern_value(x, y, c)))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+int main()
+{
+    std::error_code ec;
+
+    const std::filesystem::path directory = std::filesystem::temp_directory_path(ec) / "lov_test_parallel_decode";
+    std::filesystem::create_directories(directory, ec);
+
+    const stdromano::StringD png_path((directory / "pattern.png").string().c_str());
+    const stdromano::StringD exr_path((directory / "pattern.exr").string().c_str());
+    const stdromano::StringD truncated_path((directory / "truncated.png").string().c_str());
+
+    if(!write_pattern_image(png_path, LOV::LayerDepth_U8) ||
+       !write_pattern_image(exr_path, LOV::LayerDepth_F32) ||
+       !write_truncated_copy(png_path.c_str(), truncated_path.c_str()))
+    {
+        stdromano::log_error("Cannot write the test images in \"{}\"", directory.string().c_str());
+        return 1;
+    }
+
+    LOV::ThreadPool& pool = LOV::ThreadPool::get_global_threadpool();
+
+    const std::size_t num_decodes = 16 * (static_cast<std::size_t>(pool.num_threads()) + 1);
+
+    std::atomic<std::size_t> num_failures(0);
+
+    pool.parallel_for(num_decodes, [&](std::size_t i) {
+        bool success;
+
+        switch(i % 5)
+        {
+            case 0:
+                success = decode_pattern_image(png_path, LOV::LayerDepth_U8, false);
+                break;
+            case 1:
+                success = decode_pattern_image(png_path, LOV::LayerDepth_U8, true);
+                break;
+            case 2:
+                success = decode_pattern_image(exr_path, LOV::LayerDepth_F32, false);
+                break;
+            case 3:
+                success = decode_pattern_image(exr_path, LOV::LayerDepth_F32, true);
+                break;
+            default:
+                success = !decode_pattern_image(truncated_path, LOV::LayerDepth_U8, false);
+                break;
+        }
+
+        if(!success)
+        {
+            stdromano::log_error("Parallel decode {} gave an unexpected result", i);
+            num_failures.fetch_add(1);
+        }
+    });
+
+    std::filesystem::remove_all(directory, ec);
+
+    stdromano::log_debug("{} parallel decodes, {} failures", num_decodes, num_failures.load());
+
+    return num_failures.load() == 0 ? 0 : 1;
+}